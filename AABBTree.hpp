@@ -0,0 +1,453 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <cstdint>
+#include <cassert>
+#include <cmath>
+
+//"AABBTree" is a bounding volume hierarchy over boxes that move (e.g., the scene's objects), updated as they move rather than rebuilt:
+// each item is a leaf whose "fat" box is its tight box grown by 'margin', so small moves don't change the tree at all;
+// an item that leaves its fat box is removed and reinserted, refitting the boxes of its old and new ancestors on the way up.
+//Insertion picks the sibling that adds the least surface area, and rotations keep sibling subtrees within one level of each other
+// (as in Box2D's b2DynamicTree), so queries visit O(log n) nodes plus those leading to results.
+//Queries test fat boxes on the way down and tight boxes at the leaves, so results are exact (for the boxes).
+
+template< typename T >
+struct AABBTree {
+	struct Box {
+		glm::vec3 min = glm::vec3(0.0f);
+		glm::vec3 max = glm::vec3(0.0f);
+	};
+
+	float margin = 0.2f; //fat boxes reach this far past tight boxes on every side
+	float predict = 4.0f; //...and this many times the last move() further in the direction of motion
+
+	//add an item with a (tight) box; returns its leaf, which names the item until it is removed:
+	uint32_t insert(Box const &box, T const &value);
+	void remove(uint32_t leaf);
+	//change an item's box; returns true if it had to be reinserted (because it left its fat box, or shrank well inside it):
+	bool move(uint32_t leaf, Box const &box);
+
+	T const &value(uint32_t leaf) const { return nodes[leaf].value; }
+	Box const &box(uint32_t leaf) const { return nodes[leaf].tight; }
+	uint32_t size() const { return leaves; }
+	uint32_t height() const { return root == -1U ? 0 : uint32_t(nodes[root].height); }
+
+	//queries (callbacks are passed leaves):
+
+	//items whose boxes overlap 'box'; 'fn(leaf)' returns false to stop early:
+	template< typename Fn >
+	void query_overlap(Box const &box, Fn const &fn) const;
+
+	//items whose boxes are not entirely outside the view volume of 'world_to_clip' (the same test Scene::draw uses); 'fn(leaf)' as above:
+	template< typename Fn >
+	void query_frustum(glm::mat4 const &world_to_clip, Fn const &fn) const;
+
+	//items whose boxes are hit by origin + t * direction for some 0 <= t <= t_max:
+	// 'fn(leaf, t)' is passed the entry distance and returns the new t_max
+	// (return 't' to only look for nearer hits, e.g. to find the closest; return 't_max' to see every hit; return a negative number to stop):
+	template< typename Fn >
+	void query_ray(glm::vec3 const &origin, glm::vec3 const &direction, float t_max, Fn const &fn) const;
+
+	//the item whose box is nearest 'point' (distance zero if inside), among those within 'max_distance' for which 'accept(leaf)' is true:
+	// returns -1U if there is no such item.
+	template< typename Fn >
+	uint32_t query_nearest(glm::vec3 const &point, float max_distance, Fn const &accept) const;
+
+	//internals:
+	struct Node {
+		Box fat; //leaves: tight box grown by margin; internal nodes: union of children's fat boxes
+		uint32_t parent = -1U; //(next free node, for nodes in the free list)
+		uint32_t children[2] = { -1U, -1U }; //(-1U for leaves)
+		int32_t height = 0; //0 for leaves, -1 for free nodes
+		Box tight; //(leaves only)
+		T value = T(); //(leaves only)
+	};
+	std::vector< Node > nodes;
+	uint32_t root = -1U;
+	uint32_t free_nodes = -1U;
+	uint32_t leaves = 0;
+
+	bool is_leaf(uint32_t node) const { return nodes[node].children[0] == -1U; }
+	uint32_t allocate_node();
+	void free_node(uint32_t node);
+	void insert_leaf(uint32_t leaf);
+	void remove_leaf(uint32_t leaf);
+	uint32_t balance(uint32_t node); //rotate 'node' if its subtrees' heights differ by more than one; returns the node now in its place
+	void refit(uint32_t node); //recompute an internal node's box and height from its children
+	void refit_ancestors(uint32_t node); //rebalance and refit 'node' and the nodes above it
+
+	static Box merge(Box const &a, Box const &b) {
+		Box ret;
+		ret.min = glm::min(a.min, b.min);
+		ret.max = glm::max(a.max, b.max);
+		return ret;
+	}
+	static Box grow(Box const &box, float amount) {
+		Box ret;
+		ret.min = box.min - glm::vec3(amount);
+		ret.max = box.max + glm::vec3(amount);
+		return ret;
+	}
+	static bool contains(Box const &outer, Box const &inner) {
+		return outer.min.x <= inner.min.x && outer.min.y <= inner.min.y && outer.min.z <= inner.min.z
+		    && inner.max.x <= outer.max.x && inner.max.y <= outer.max.y && inner.max.z <= outer.max.z;
+	}
+	static bool overlaps(Box const &a, Box const &b) {
+		return a.min.x <= b.max.x && b.min.x <= a.max.x
+		    && a.min.y <= b.max.y && b.min.y <= a.max.y
+		    && a.min.z <= b.max.z && b.min.z <= a.max.z;
+	}
+	static float area(Box const &box) { //(half the surface area; only used for comparisons)
+		glm::vec3 size = box.max - box.min;
+		return size.x * size.y + size.y * size.z + size.z * size.x;
+	}
+	static float distance2(Box const &box, glm::vec3 const &point) {
+		glm::vec3 d = glm::max(glm::max(box.min - point, point - box.max), glm::vec3(0.0f));
+		return glm::dot(d, d);
+	}
+	//entry distance of the ray (with per-axis reciprocal direction) into the box, or infinity if it misses within [0, t_max]:
+	static float ray_enter(Box const &box, glm::vec3 const &origin, glm::vec3 const &inv_direction, float t_max) {
+		float enter = 0.0f;
+		float exit = t_max;
+		for (uint32_t a = 0; a < 3; ++a) {
+			float t0 = (box.min[a] - origin[a]) * inv_direction[a];
+			float t1 = (box.max[a] - origin[a]) * inv_direction[a];
+			if (t0 > t1) std::swap(t0, t1);
+			//(NaN from 0 * infinity, for rays in a box's plane, leaves enter/exit alone)
+			enter = (t0 > enter ? t0 : enter);
+			exit = (t1 < exit ? t1 : exit);
+		}
+		return (enter <= exit ? enter : std::numeric_limits< float >::infinity());
+	}
+};
+
+//------------------------------------------------
+
+template< typename T >
+uint32_t AABBTree< T >::allocate_node() {
+	if (free_nodes == -1U) {
+		nodes.emplace_back();
+		return uint32_t(nodes.size() - 1);
+	}
+	uint32_t node = free_nodes;
+	free_nodes = nodes[node].parent;
+	nodes[node] = Node();
+	return node;
+}
+
+template< typename T >
+void AABBTree< T >::free_node(uint32_t node) {
+	nodes[node].value = T();
+	nodes[node].height = -1;
+	nodes[node].parent = free_nodes;
+	free_nodes = node;
+}
+
+template< typename T >
+uint32_t AABBTree< T >::insert(Box const &box, T const &value) {
+	uint32_t leaf = allocate_node();
+	nodes[leaf].tight = box;
+	nodes[leaf].fat = grow(box, margin);
+	nodes[leaf].value = value;
+	insert_leaf(leaf);
+	++leaves;
+	return leaf;
+}
+
+template< typename T >
+void AABBTree< T >::remove(uint32_t leaf) {
+	assert(leaf < nodes.size() && is_leaf(leaf) && nodes[leaf].height == 0 && "should be a leaf of this tree");
+	remove_leaf(leaf);
+	free_node(leaf);
+	--leaves;
+}
+
+template< typename T >
+bool AABBTree< T >::move(uint32_t leaf, Box const &box) {
+	assert(leaf < nodes.size() && is_leaf(leaf) && nodes[leaf].height == 0 && "should be a leaf of this tree");
+	glm::vec3 ahead = (0.5f * predict) * ((box.min + box.max) - (nodes[leaf].tight.min + nodes[leaf].tight.max));
+	glm::vec3 ahead_min = glm::min(ahead, glm::vec3(0.0f));
+	glm::vec3 ahead_max = glm::max(ahead, glm::vec3(0.0f));
+	nodes[leaf].tight = box;
+	//(fat boxes much bigger than needed are also replaced, so an item that shrinks doesn't stay big in the tree)
+	Box loose = grow(box, 4.0f * margin);
+	loose.min += ahead_min;
+	loose.max += ahead_max;
+	if (contains(nodes[leaf].fat, box) && contains(loose, nodes[leaf].fat)) return false;
+	remove_leaf(leaf);
+	//(items tend to keep moving the way they were going, so the new fat box also reaches a few moves ahead)
+	nodes[leaf].fat = grow(box, margin);
+	nodes[leaf].fat.min += ahead_min;
+	nodes[leaf].fat.max += ahead_max;
+	insert_leaf(leaf);
+	return true;
+}
+
+template< typename T >
+void AABBTree< T >::refit(uint32_t node) {
+	Node &n = nodes[node];
+	Node const &a = nodes[n.children[0]];
+	Node const &b = nodes[n.children[1]];
+	n.fat = merge(a.fat, b.fat);
+	n.height = 1 + std::max(a.height, b.height);
+}
+
+template< typename T >
+void AABBTree< T >::refit_ancestors(uint32_t at) {
+	while (at != -1U) {
+		Box old_fat = nodes[at].fat;
+		int32_t old_height = nodes[at].height;
+		uint32_t now = balance(at);
+		refit(now);
+		//(once a node comes out unchanged, nothing above it can change either)
+		if (now == at && nodes[at].height == old_height && nodes[at].fat.min == old_fat.min && nodes[at].fat.max == old_fat.max) break;
+		at = nodes[now].parent;
+	}
+}
+
+template< typename T >
+void AABBTree< T >::insert_leaf(uint32_t leaf) {
+	if (root == -1U) {
+		root = leaf;
+		nodes[leaf].parent = -1U;
+		return;
+	}
+
+	//find the best sibling: stop where pairing with the current node is cheaper than going down into either child
+	// (cost is the area of the new parent, plus the growth of every ancestor on the way down):
+	Box const box = nodes[leaf].fat;
+	uint32_t node = root;
+	while (!is_leaf(node)) {
+		float node_area = area(nodes[node].fat);
+		float combined_area = area(merge(nodes[node].fat, box));
+		float cost = 2.0f * combined_area;
+		float inherited = 2.0f * (combined_area - node_area);
+
+		float child_cost[2];
+		for (uint32_t c = 0; c < 2; ++c) {
+			Box const &child = nodes[nodes[node].children[c]].fat;
+			child_cost[c] = area(merge(child, box)) + inherited;
+			if (!is_leaf(nodes[node].children[c])) child_cost[c] -= area(child);
+		}
+		if (cost < child_cost[0] && cost < child_cost[1]) break;
+		node = nodes[node].children[child_cost[0] <= child_cost[1] ? 0 : 1];
+	}
+	uint32_t sibling = node;
+
+	//put a new parent in the sibling's place:
+	uint32_t old_parent = nodes[sibling].parent;
+	uint32_t new_parent = allocate_node();
+	nodes[new_parent].parent = old_parent;
+	nodes[new_parent].children[0] = sibling;
+	nodes[new_parent].children[1] = leaf;
+	nodes[sibling].parent = new_parent;
+	nodes[leaf].parent = new_parent;
+	if (old_parent == -1U) {
+		root = new_parent;
+	} else {
+		Node &p = nodes[old_parent];
+		p.children[p.children[0] == sibling ? 0 : 1] = new_parent;
+	}
+
+	refit_ancestors(new_parent);
+}
+
+template< typename T >
+void AABBTree< T >::remove_leaf(uint32_t leaf) {
+	if (leaf == root) {
+		root = -1U;
+		return;
+	}
+
+	//replace the leaf's parent with the leaf's sibling:
+	uint32_t parent = nodes[leaf].parent;
+	uint32_t grandparent = nodes[parent].parent;
+	uint32_t sibling = nodes[parent].children[nodes[parent].children[0] == leaf ? 1 : 0];
+	free_node(parent);
+	nodes[sibling].parent = grandparent;
+	if (grandparent == -1U) {
+		root = sibling;
+		return;
+	}
+	Node &g = nodes[grandparent];
+	g.children[g.children[0] == parent ? 0 : 1] = sibling;
+
+	refit_ancestors(grandparent);
+}
+
+template< typename T >
+uint32_t AABBTree< T >::balance(uint32_t a) {
+	if (is_leaf(a)) return a;
+
+	//if one child is more than a level taller, it takes a's place, and a takes the shorter of its children's places:
+	int32_t diff = nodes[nodes[a].children[1]].height - nodes[nodes[a].children[0]].height;
+	if (diff >= -1 && diff <= 1) return a;
+	uint32_t tall_side = (diff > 1 ? 1 : 0);
+	uint32_t tall = nodes[a].children[tall_side];
+
+	//tall moves up:
+	uint32_t parent = nodes[a].parent;
+	nodes[tall].parent = parent;
+	if (parent == -1U) {
+		root = tall;
+	} else {
+		Node &p = nodes[parent];
+		p.children[p.children[0] == a ? 0 : 1] = tall;
+	}
+
+	//tall's taller child stays with it; the other moves to a:
+	uint32_t f = nodes[tall].children[0];
+	uint32_t g = nodes[tall].children[1];
+	uint32_t keep = (nodes[f].height > nodes[g].height ? f : g);
+	uint32_t give = (keep == f ? g : f);
+	nodes[tall].children[0] = a;
+	nodes[tall].children[1] = keep;
+	nodes[a].parent = tall;
+	nodes[a].children[tall_side] = give;
+	nodes[give].parent = a;
+
+	//(a leaf inserted next to a tall subtree leaves a node lopsided by more than one level, so a and then tall may need more rotations)
+	refit(balance(a));
+	refit(tall);
+	return balance(tall);
+}
+
+template< typename T >
+template< typename Fn >
+void AABBTree< T >::query_overlap(Box const &box, Fn const &fn) const {
+	if (root == -1U) return;
+	uint32_t stack[64];
+	uint32_t stack_size = 0;
+	stack[stack_size++] = root;
+	while (stack_size > 0) {
+		uint32_t node = stack[--stack_size];
+		Node const &n = nodes[node];
+		if (!overlaps(n.fat, box)) continue;
+		if (is_leaf(node)) {
+			if (overlaps(n.tight, box) && !fn(node)) return;
+		} else {
+			assert(stack_size + 2 <= sizeof(stack) / sizeof(stack[0]));
+			stack[stack_size++] = n.children[1];
+			stack[stack_size++] = n.children[0];
+		}
+	}
+}
+
+template< typename T >
+template< typename Fn >
+void AABBTree< T >::query_frustum(glm::mat4 const &world_to_clip, Fn const &fn) const {
+	if (root == -1U) return;
+
+	//the view volume is where -w <= x,y,z <= w in clip space, so its planes are (row 3) +/- (rows 0, 1, 2) of world_to_clip:
+	glm::vec4 planes[6];
+	glm::vec4 w = glm::vec4(world_to_clip[0][3], world_to_clip[1][3], world_to_clip[2][3], world_to_clip[3][3]);
+	for (uint32_t r = 0; r < 3; ++r) {
+		glm::vec4 row = glm::vec4(world_to_clip[0][r], world_to_clip[1][r], world_to_clip[2][r], world_to_clip[3][r]);
+		planes[2*r+0] = w + row;
+		planes[2*r+1] = w - row;
+	}
+	//is the box outside (-1), straddling (0), or inside (1) the volume?
+	auto classify = [&planes](Box const &box) {
+		glm::vec3 center = 0.5f * (box.max + box.min);
+		glm::vec3 extent = 0.5f * (box.max - box.min);
+		int32_t ret = 1;
+		for (auto const &plane : planes) {
+			float d = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+			float r = std::abs(plane.x) * extent.x + std::abs(plane.y) * extent.y + std::abs(plane.z) * extent.z;
+			if (d + r < 0.0f) return -1;
+			if (d - r < 0.0f) ret = 0;
+		}
+		return ret;
+	};
+
+	//(subtrees entirely inside are reported without further tests, so the second entry says whether to test)
+	std::pair< uint32_t, bool > stack[64];
+	uint32_t stack_size = 0;
+	stack[stack_size++] = std::make_pair(root, true);
+	while (stack_size > 0) {
+		uint32_t node = stack[--stack_size].first;
+		bool test = stack[stack_size].second;
+		Node const &n = nodes[node];
+		if (test) {
+			int32_t where = classify(is_leaf(node) ? n.tight : n.fat);
+			if (where < 0) continue;
+			if (where > 0) test = false;
+		}
+		if (is_leaf(node)) {
+			if (!fn(node)) return;
+		} else {
+			assert(stack_size + 2 <= sizeof(stack) / sizeof(stack[0]));
+			stack[stack_size++] = std::make_pair(n.children[1], test);
+			stack[stack_size++] = std::make_pair(n.children[0], test);
+		}
+	}
+}
+
+template< typename T >
+template< typename Fn >
+void AABBTree< T >::query_ray(glm::vec3 const &origin, glm::vec3 const &direction, float t_max, Fn const &fn) const {
+	if (root == -1U) return;
+	glm::vec3 inv_direction = glm::vec3(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+
+	uint32_t stack[64];
+	uint32_t stack_size = 0;
+	stack[stack_size++] = root;
+	while (stack_size > 0) {
+		uint32_t node = stack[--stack_size];
+		Node const &n = nodes[node];
+		if (is_leaf(node)) {
+			float t = ray_enter(n.tight, origin, inv_direction, t_max);
+			if (t == std::numeric_limits< float >::infinity()) continue;
+			t_max = fn(node, t);
+			if (t_max < 0.0f) return;
+		} else {
+			if (ray_enter(n.fat, origin, inv_direction, t_max) == std::numeric_limits< float >::infinity()) continue;
+			assert(stack_size + 2 <= sizeof(stack) / sizeof(stack[0]));
+			stack[stack_size++] = n.children[1];
+			stack[stack_size++] = n.children[0];
+		}
+	}
+}
+
+template< typename T >
+template< typename Fn >
+uint32_t AABBTree< T >::query_nearest(glm::vec3 const &point, float max_distance, Fn const &accept) const {
+	if (root == -1U) return -1U;
+
+	//best-first: visit nodes in order of distance, until the nearest unvisited node is further than the best item so far:
+	uint32_t best = -1U;
+	float best_distance2 = max_distance * max_distance;
+	std::vector< std::pair< float, uint32_t > > heap; //(distance^2, node), closest on top
+	auto closer = [](std::pair< float, uint32_t > const &a, std::pair< float, uint32_t > const &b) {
+		return a.first > b.first;
+	};
+	heap.emplace_back(distance2(nodes[root].fat, point), root);
+	while (!heap.empty()) {
+		std::pop_heap(heap.begin(), heap.end(), closer);
+		std::pair< float, uint32_t > top = heap.back();
+		heap.pop_back();
+		if (top.first > best_distance2) break;
+
+		Node const &n = nodes[top.second];
+		if (is_leaf(top.second)) {
+			float d2 = distance2(n.tight, point);
+			if (d2 <= best_distance2 && accept(top.second)) {
+				best = top.second;
+				best_distance2 = d2;
+			}
+		} else {
+			for (uint32_t c = 0; c < 2; ++c) {
+				float d2 = distance2(nodes[n.children[c]].fat, point);
+				if (d2 > best_distance2) continue;
+				heap.emplace_back(d2, n.children[c]);
+				std::push_heap(heap.begin(), heap.end(), closer);
+			}
+		}
+	}
+	return best;
+}
@@ -0,0 +1,137 @@
+#include "FlowField.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+FlowField::FlowField(WalkMesh const &walk_mesh_) : walk_mesh(walk_mesh_) {
+	uint32_t count = uint32_t(walk_mesh.polygons.size());
+	targets.assign(count, glm::vec3(0.0f));
+	directions.assign(count, glm::vec3(0.0f));
+	distances.assign(count, std::numeric_limits< float >::infinity());
+	next.assign(count, -1U);
+
+	centroids.reserve(count);
+	portals.reserve(walk_mesh.polygon_vertices.size());
+	for (auto const &polygon : walk_mesh.polygons) {
+		glm::vec3 sum = glm::vec3(0.0f);
+		for (uint32_t i = polygon.begin; i < polygon.end; ++i) {
+			uint32_t j = (i + 1 < polygon.end ? i + 1 : polygon.begin);
+			glm::vec3 const &a = walk_mesh.vertices[walk_mesh.polygon_vertices[i]];
+			glm::vec3 const &b = walk_mesh.vertices[walk_mesh.polygon_vertices[j]];
+			sum += a;
+			portals.emplace_back(0.5f * (a + b));
+		}
+		centroids.emplace_back(sum / float(polygon.end - polygon.begin));
+	}
+}
+
+bool FlowField::set_goal(WalkMesh::WalkPoint const &goal) {
+	goal_point = walk_mesh.world_point(goal);
+	uint32_t polygon = (goal.triangle_index < walk_mesh.triangle_polygons.size() ? walk_mesh.triangle_polygons[goal.triangle_index] : -1U);
+	if (polygon == goal_polygon) return false;
+	goal_polygon = polygon;
+	++rebuilds;
+
+	std::fill(targets.begin(), targets.end(), glm::vec3(0.0f));
+	std::fill(directions.begin(), directions.end(), glm::vec3(0.0f));
+	std::fill(distances.begin(), distances.end(), std::numeric_limits< float >::infinity());
+	std::fill(next.begin(), next.end(), -1U);
+	if (goal_polygon >= walk_mesh.polygons.size()) return true;
+
+	//Dijkstra outward from the goal polygon:
+	// travel between polygons goes centroid -> shared edge midpoint -> centroid,
+	// and each polygon points at the midpoint of the edge it was reached across.
+	typedef std::pair< float, uint32_t > OpenEntry;
+	auto later = [](OpenEntry const &a, OpenEntry const &b) { return a.first > b.first; }; //heap order that puts the lowest distance on top
+	open.clear();
+	distances[goal_polygon] = 0.0f;
+	open.emplace_back(0.0f, goal_polygon);
+
+	while (!open.empty()) {
+		std::pop_heap(open.begin(), open.end(), later);
+		OpenEntry top = open.back();
+		open.pop_back();
+
+		uint32_t at = top.second;
+		if (top.first > distances[at]) continue; //superseded by a shorter route
+
+		WalkMesh::Polygon const &polygon = walk_mesh.polygons[at];
+		for (uint32_t i = polygon.begin; i < polygon.end; ++i) {
+			uint32_t from = walk_mesh.polygon_neighbors[i];
+			if (from == -1U) continue;
+
+			glm::vec3 const &portal = portals[i];
+			float distance = top.first + glm::distance(centroids[at], portal) + glm::distance(portal, centroids[from]);
+			if (distance >= distances[from]) continue;
+
+			distances[from] = distance;
+			next[from] = at;
+			targets[from] = portal;
+			//(the edge midpoint and centroid are both on 'from', so this direction is in its plane)
+			glm::vec3 to_portal = portal - centroids[from];
+			float length = glm::length(to_portal);
+			directions[from] = (length > 0.0f ? to_portal / length : glm::vec3(0.0f));
+
+			open.emplace_back(distance, from);
+			std::push_heap(open.begin(), open.end(), later);
+		}
+	}
+
+	return true;
+}
+
+glm::vec3 FlowField::direction(WalkMesh::WalkPoint const &wp) const {
+	assert(wp.triangle_index < walk_mesh.triangle_polygons.size());
+	uint32_t p = walk_mesh.triangle_polygons[wp.triangle_index];
+	if (p == goal_polygon) {
+		glm::vec3 to_goal = goal_point - walk_mesh.world_point(wp);
+		float length = glm::length(to_goal);
+		return (length > 0.0f ? to_goal / length : glm::vec3(0.0f));
+	}
+	if (next[p] == -1U) return glm::vec3(0.0f); //(unreachable, or there is no goal; targets[p] means nothing)
+	glm::vec3 to_target = targets[p] - walk_mesh.world_point(wp);
+	float length = glm::length(to_target);
+	//(agents sitting on the target fall back to the centroid's direction, which carries them across the edge)
+	return (length > 1e-4f ? to_target / length : directions[p]);
+}
+
+void FlowField::steps(WalkMesh::WalkPoints const &agents, float distance, std::vector< float > *step_x_, std::vector< float > *step_y_, std::vector< float > *step_z_) const {
+	assert(step_x_ && step_y_ && step_z_);
+	auto &step_x = *step_x_;
+	auto &step_y = *step_y_;
+	auto &step_z = *step_z_;
+
+	size_t count = agents.size();
+	step_x.resize(count);
+	step_y.resize(count);
+	step_z.resize(count);
+
+	for (size_t i = 0; i < count; ++i) {
+		uint32_t t = agents.triangle_index[i];
+		glm::uvec3 const &tri = walk_mesh.triangles[t];
+		glm::vec3 at = agents.weight_x[i] * walk_mesh.vertices[tri.x]
+		             + agents.weight_y[i] * walk_mesh.vertices[tri.y]
+		             + agents.weight_z[i] * walk_mesh.vertices[tri.z];
+		uint32_t p = walk_mesh.triangle_polygons[t];
+		glm::vec3 step;
+		if (p == goal_polygon) {
+			step = goal_point - at;
+			float length = glm::length(step);
+			if (length > distance) step *= distance / length;
+		} else if (next[p] == -1U) {
+			//(agents that can't reach the goal, or when there is none, stay put)
+			step = glm::vec3(0.0f);
+		} else {
+			//same as direction(), scaled by 'distance'; steps that reach the target carry on along the centroid's direction,
+			// which takes them across the target's edge (rather than back and forth along it, for agents that arrive beside the target):
+			step = targets[p] - at;
+			float length = glm::length(step);
+			if (length > distance) step *= distance / length;
+			else step += directions[p] * (distance - length);
+		}
+		step_x[i] = step.x;
+		step_y[i] = step.y;
+		step_z[i] = step.z;
+	}
+}
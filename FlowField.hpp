@@ -0,0 +1,54 @@
+#pragma once
+
+#include "WalkMesh.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstdint>
+#include <utility>
+
+//"FlowField" steers any number of agents toward one goal on a WalkMesh:
+// a single Dijkstra pass outward from the goal's polygon (see WalkMesh::polygons) records, for every polygon, the direction toward the goal,
+// so each agent only needs to look up the entry for the polygon containing its current triangle.
+//(for a few agents that need tidy paths, see PathFinder instead)
+
+struct FlowField {
+	FlowField(WalkMesh const &walk_mesh);
+
+	WalkMesh const &walk_mesh;
+
+	//set the goal; the field is only rebuilt when the goal moves to a different polygon:
+	// returns true if the field was rebuilt.
+	bool set_goal(WalkMesh::WalkPoint const &goal);
+
+	//direction an agent at 'wp' should move (unit length; zero if the goal is unreachable):
+	// agents head for the midpoint of the edge into the next polygon (which, since polygons are convex, they are sure to cross),
+	// and agents in the goal polygon head straight for the goal.
+	glm::vec3 direction(WalkMesh::WalkPoint const &wp) const;
+
+	//compute a step of (at most) 'distance' toward the goal for every agent, for use with WalkMesh::walk_many:
+	// (agents closer to the goal than 'distance' step exactly onto it; agents closer to their target than that step through it;
+	//  agents that can't reach the goal get a zero step)
+	void steps(WalkMesh::WalkPoints const &agents, float distance, std::vector< float > *step_x, std::vector< float > *step_y, std::vector< float > *step_z) const;
+
+	//current goal:
+	uint32_t goal_polygon = -1U;
+	glm::vec3 goal_point = glm::vec3(0.0f);
+
+	//per-polygon results of the last rebuild:
+	std::vector< glm::vec3 > targets; //midpoint of the edge into the next polygon on the way to the goal
+	std::vector< glm::vec3 > directions; //unit direction from the centroid to the target (zero if unreachable)
+	std::vector< float > distances; //path length from polygon centroid to the goal polygon's centroid (infinity if unreachable)
+	std::vector< uint32_t > next; //next polygon on the way to the goal (-1U for the goal polygon or if unreachable)
+
+	//counters, for tuning:
+	uint32_t rebuilds = 0;
+
+	//precomputed per-polygon geometry:
+	std::vector< glm::vec3 > centroids; //(average of the polygon's corners)
+	std::vector< glm::vec3 > portals; //parallel to walk_mesh.polygon_vertices: midpoint of the edge across which polygon_neighbors[i] lies
+
+	//scratch space for rebuilding:
+	std::vector< std::pair< float, uint32_t > > open; //heap of (distance, polygon)
+};
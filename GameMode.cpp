@@ -4,6 +4,7 @@
 #include "Load.hpp"
 #include "MeshBuffer.hpp"
 #include "Scene.hpp"
+#include "LevelStreamer.hpp"
 #include "gl_errors.hpp" //helper for dumpping OpenGL error messages
 #include "check_fb.hpp" //helper for checking currently bound OpenGL framebuffer
 #include "read_chunk.hpp" //helper for reading a vector of structures from a file
@@ -23,13 +24,21 @@
 #include <map>
 #include <cstddef>
 #include <random>
-#include <cstring>
+#include <algorithm>
+#include <limits>
 
 #include <iostream>
 
 
+//if the level has been split into chunks for streaming (by build_chunks; see meshes/Makefile), only the meshes that aren't streamed are loaded up front:
+// (checked once, on first use)
+static bool level_is_chunked() {
+	static bool chunked = std::ifstream(data_path("maze.chunks"), std::ios::binary).good();
+	return chunked;
+}
+
 Load< MeshBuffer > meshes(LoadTagDefault, [](){
-	return new MeshBuffer(data_path("maze.pnct"));
+	return new MeshBuffer(data_path(level_is_chunked() ? "maze.resident.pnct" : "maze.pnct"));
 });
 
 Load< GLuint > meshes_for_texture_program(LoadTagDefault, [](){
@@ -162,6 +171,20 @@ std::vector<Spider*> spiders;
 
 Scene::Transform* statue = nullptr;
 
+//world-space copies of the static scenery, built by the scene loader, and the objects that draw them:
+MeshBuffer *static_meshes = nullptr;
+std::vector< Scene::Object * > static_batch_objects;
+
+//the walls' ranges of 'meshes' and where they were, noted by the scene loader before batching merges them into "static batch" objects:
+struct WallPart {
+	GLuint start, count;
+	glm::mat4 local_to_world;
+};
+std::vector< WallPart > wall_parts;
+
+//(optional) streams the static scenery in and out around the player, adding and removing objects as it goes:
+LevelStreamer *streamer = nullptr;
+
 Load< Scene > scene(LoadTagDefault, [](){
 	Scene *ret = new Scene;
 
@@ -169,34 +192,29 @@ Load< Scene > scene(LoadTagDefault, [](){
 	Scene::Object::ProgramInfo texture_program_info;
 	texture_program_info.program = texture_program->program;
 	texture_program_info.vao = *meshes_for_texture_program;
-	texture_program_info.mvp_mat4  = texture_program->object_to_clip_mat4;
-	texture_program_info.mv_mat4x3 = texture_program->object_to_light_mat4x3;
-	texture_program_info.itmv_mat3 = texture_program->normal_to_light_mat3;
+	texture_program_info.object_constants_block = texture_program->object_constants_block;
+	texture_program_info.instanced_bool = texture_program->instanced_bool;
+	texture_program_info.instance_base_int = texture_program->instance_base_int;
+	texture_program_info.world_to_clip_mat4 = texture_program->world_to_clip_mat4;
 
 	Scene::Object::ProgramInfo depth_program_info;
 	depth_program_info.program = depth_program->program;
 	depth_program_info.vao = *meshes_for_depth_program;
-	depth_program_info.mvp_mat4  = depth_program->object_to_clip_mat4;
+	depth_program_info.object_constants_block = depth_program->object_constants_block;
+	depth_program_info.instanced_bool = depth_program->instanced_bool;
+	depth_program_info.instance_base_int = depth_program->instance_base_int;
+	depth_program_info.world_to_clip_mat4 = depth_program->world_to_clip_mat4;
 
 
 	//load transform hierarchy:
+	bool chunked = level_is_chunked();
 	ret->load(data_path("maze.scene"), [&](Scene &s, Scene::Transform *t, std::string const &m){
+		if (chunked && !meshes->meshes.count(m)) return; //(streamed by 'streamer', below)
 		Scene::Object *obj = s.new_object(t);
 		std::cerr << "Loading: " << m << std::endl;
 
 		obj->programs[Scene::Object::ProgramTypeDefault] = texture_program_info;
-		if (t->name == "Wall") {
-			obj->programs[Scene::Object::ProgramTypeDefault].textures[0] = *stone_spec_tex;
-		} else if (std::strstr(t->name.c_str(), "Spider") != NULL) {
-			spiders.push_back(new Spider(t));
-			obj->programs[Scene::Object::ProgramTypeDefault].textures[0] = *spider_tex;
-		}else if (t->name == "Suzanne") {
-			obj->programs[Scene::Object::ProgramTypeDefault].textures[0] = *marble_tex;
-			statue = t;
-		}
-		else{
-			obj->programs[Scene::Object::ProgramTypeDefault].textures[0] = *white_tex;
-		}
+		obj->programs[Scene::Object::ProgramTypeDefault].textures[0] = *white_tex; //(special objects are re-textured below)
 
 		obj->programs[Scene::Object::ProgramTypeShadow] = depth_program_info;
 
@@ -206,31 +224,108 @@ Load< Scene > scene(LoadTagDefault, [](){
 
 		obj->programs[Scene::Object::ProgramTypeShadow].start = mesh.start;
 		obj->programs[Scene::Object::ProgramTypeShadow].count = mesh.count;
+
+		//coarser versions of the mesh (built by build_lods; see meshes/Makefile), for when the object is far away:
+		for (uint32_t l = 0; l < mesh.lods.size() && l < Scene::Object::ProgramInfo::LodCount; ++l) {
+			Scene::Object::ProgramInfo::Lod lod;
+			lod.start = mesh.lods[l].start;
+			lod.count = mesh.lods[l].count;
+			lod.max_size = mesh.lods[l].max_size;
+			obj->programs[Scene::Object::ProgramTypeDefault].lods[l] = lod;
+			obj->programs[Scene::Object::ProgramTypeShadow].lods[l] = lod;
+		}
+
+		obj->has_bounds = true;
+		obj->bounds_min = mesh.min;
+		obj->bounds_max = mesh.max;
+
+		//everything but the spiders (below) stays put:
+		obj->is_static = true;
 	});
 
-	std::cerr << "Finish loading" << std::endl;
+	//find the special objects by name:
+	for (Scene::Object *obj : ret->objects_named("Wall")) {
+		obj->programs[Scene::Object::ProgramTypeDefault].textures[0] = *stone_spec_tex;
+		Scene::Object::ProgramInfo const &info = obj->programs[Scene::Object::ProgramTypeDefault];
+		wall_parts.emplace_back(WallPart{ info.start, info.count, obj->transform->make_local_to_world() });
+	}
+	for (Scene::Object *obj : ret->objects_with_prefix("Spider")) {
+		spiders.push_back(new Spider(obj->transform));
+		obj->programs[Scene::Object::ProgramTypeDefault].textures[0] = *spider_tex;
+		obj->is_static = false;
+	}
+	for (Scene::Object *obj : ret->objects_named("Suzanne")) {
+		obj->programs[Scene::Object::ProgramTypeDefault].textures[0] = *marble_tex;
+		statue = obj->transform;
+	}
 
-	//look up the camera:
-	for (Scene::Camera *c = ret->first_camera; c != nullptr; c = c->alloc_next) {
-		if (c->transform->name == "Camera") {
-			if (camera) throw std::runtime_error("Multiple 'Camera' objects in scene.");
-			camera = c;
+	//merge static objects that share a material into world-space meshes:
+	std::vector< Scene::StaticBatch > batches = ret->batch_static_objects();
+	if (!batches.empty()) {
+		std::vector< MeshBuffer::Bake > bakes;
+		for (auto const &batch : batches) {
+			bakes.emplace_back();
+			bakes.back().name = "static batch " + std::to_string(bakes.size() - 1);
+			for (auto const &part : batch.parts) {
+				MeshBuffer::Bake::Part bake_part;
+				bake_part.start = part.start;
+				bake_part.count = part.count;
+				bake_part.transform = part.local_to_world;
+				bakes.back().parts.emplace_back(bake_part);
+			}
+		}
+		static_meshes = new MeshBuffer(*meshes, bakes);
+		GLuint static_texture_vao = static_meshes->make_vao_for_program(texture_program->program);
+		GLuint static_depth_vao = static_meshes->make_vao_for_program(depth_program->program);
+		for (uint32_t b = 0; b < batches.size(); ++b) {
+			MeshBuffer::Mesh const &mesh = static_meshes->lookup(bakes[b].name);
+			Scene::Object *obj = batches[b].object;
+			obj->programs[Scene::Object::ProgramTypeDefault].vao = static_texture_vao;
+			obj->programs[Scene::Object::ProgramTypeDefault].start = mesh.start;
+			obj->programs[Scene::Object::ProgramTypeDefault].count = mesh.count;
+			obj->programs[Scene::Object::ProgramTypeShadow].vao = static_depth_vao;
+			obj->programs[Scene::Object::ProgramTypeShadow].start = mesh.start;
+			obj->programs[Scene::Object::ProgramTypeShadow].count = mesh.count;
+			static_batch_objects.emplace_back(obj);
 		}
 	}
-	if (!camera) throw std::runtime_error("No 'Camera' camera in scene.");
+
+	if (chunked) {
+		streamer = new LevelStreamer(data_path("maze.chunks"), ret);
+		Scene::Object::ProgramInfo streamed_texture_info = texture_program_info;
+		streamed_texture_info.vao = streamer->make_vao_for_program(texture_program->program);
+		Scene::Object::ProgramInfo streamed_depth_info = depth_program_info;
+		streamed_depth_info.vao = streamer->make_vao_for_program(depth_program->program);
+		streamer->on_object = [=](Scene::Object *obj, std::string const &name, MeshBuffer::Mesh const &mesh) {
+			obj->programs[Scene::Object::ProgramTypeDefault] = streamed_texture_info;
+			obj->programs[Scene::Object::ProgramTypeDefault].textures[0] = (name == "Wall" ? *stone_spec_tex : *white_tex);
+			obj->programs[Scene::Object::ProgramTypeDefault].start = mesh.start;
+			obj->programs[Scene::Object::ProgramTypeDefault].count = mesh.count;
+
+			obj->programs[Scene::Object::ProgramTypeShadow] = streamed_depth_info;
+			obj->programs[Scene::Object::ProgramTypeShadow].start = mesh.start;
+			obj->programs[Scene::Object::ProgramTypeShadow].count = mesh.count;
+		};
+	}
+
+	std::cerr << "Finish loading" << std::endl;
+
+	//look up the camera:
+	Scene::Named< Scene::Camera > named_cameras = ret->cameras_named("Camera");
+	if (named_cameras.size() > 1) throw std::runtime_error("Multiple 'Camera' objects in scene.");
+	if (named_cameras.empty()) throw std::runtime_error("No 'Camera' camera in scene.");
+	camera = *named_cameras.begin();
 
     std::cerr << "Finish Camera" << std::endl;
 	//look up the spotlight:
-	for (Scene::Lamp *l = ret->first_lamp; l != nullptr; l = l->alloc_next) {
-		if (l->transform->name == "Lamp") {
-			spot = l;
-			spot_lights.push_back(l);
-		}
-		if (std::strstr(l->transform->name.c_str(), "SpotLight") != NULL) {
-		    spot_lights.push_back(l);
-		}
+	Scene::Named< Scene::Lamp > named_spots = ret->lamps_named("Lamp");
+	if (named_spots.empty()) throw std::runtime_error("No 'Spot' spotlight in scene.");
+	spot = *(named_spots.end() - 1);
+	for (Scene::Lamp *l : ret->lamps_with_prefix("SpotLight")) {
+		spot_lights.push_back(l);
 	}
-	if (!spot) throw std::runtime_error("No 'Spot' spotlight in scene.");
+	//texture_program only applies the shadow map to the last light, so the (shadow-casting) spotlight goes last:
+	spot_lights.push_back(spot);
 
 	std::cerr << "Finish Light" << std::endl;
 	return ret;
@@ -239,15 +334,73 @@ Load< Scene > scene(LoadTagDefault, [](){
 GameMode::GameMode() {
 	std::cerr << "START" << std::endl;
 
-	this->walk_mesh = new WalkMesh(data_path("maze.w"));
+	//prefer the cooked walkmesh (built by cook_walkmesh; see meshes/Makefile), which is memory-mapped instead of parsed:
+	std::string walk_mesh_filename = data_path("maze.wc");
+	if (!std::ifstream(walk_mesh_filename, std::ios::binary).good()) {
+		walk_mesh_filename = data_path("maze.w");
+	}
+	this->walk_mesh = new WalkMesh(walk_mesh_filename);
 	walk_point = this->walk_mesh->start(glm::vec3(-20.0f, -20.0f, 1.5f));
 
+	//use the potentially visible set (built by build_pvs; see meshes/Makefile) if there is one:
+	std::string pvs_filename = data_path("maze.pvs");
+	if (std::ifstream(pvs_filename, std::ios::binary).good()) {
+		pvs = new PVS(pvs_filename);
+	} else {
+		std::cerr << "NOTE: no '" << pvs_filename << "'; drawing without a PVS." << std::endl;
+	}
+
+	path_finder = new PathFinder(*walk_mesh);
+	for (auto spider : spiders) {
+		spider->start(*walk_mesh);
+	}
+
+	//gather everything that doesn't move (i.e., all but the spiders) for line-of-sight checks:
+	static_geometry = new TriangleBVH;
+	for (Scene::Object *obj : scene->objects) {
+		if (!obj->is_static) continue;
+		Scene::Object::ProgramInfo const &info = obj->programs[Scene::Object::ProgramTypeDefault];
+		//(static batches draw from the baked buffer, already in world space)
+		bool baked = std::find(static_batch_objects.begin(), static_batch_objects.end(), obj) != static_batch_objects.end();
+		MeshBuffer const &source = (baked ? *static_meshes : *meshes);
+		static_geometry->add_triangles(source.positions.data() + info.start, info.count, obj->transform->make_local_to_world());
+	}
+	if (streamer) {
+		//(streamed scenery keeps its world-space positions loaded; its objects aren't in the scene yet, so aren't added twice)
+		static_geometry->add_triangles(streamer->positions.data(), uint32_t(streamer->positions.size()));
+	}
+	static_geometry->add_walkmesh(*walk_mesh);
+	static_geometry->build();
+
+	//the walls hide most of the maze from any one spot, so they are the occluders for occlusion culling:
+	occlusion = new OcclusionBuffer();
+	//(batched walls are no longer objects named "Wall", so they are found through the parts noted before batching)
+	for (auto const &part : wall_parts) {
+		occlusion->add_occluders(meshes->positions.data() + part.start, part.count, part.local_to_world);
+	}
+	if (streamer) {
+		auto f = streamer->meshes.find("Wall");
+		if (f != streamer->meshes.end()) {
+			occlusion->add_occluders(streamer->positions.data() + f->second.start, f->second.count, glm::mat4(1.0f));
+		}
+		//(static_geometry and the occluders hold their own copies, so the streamer's needn't stay around too)
+		std::vector< glm::vec3 >().swap(streamer->positions);
+		streamer->meshes.clear();
+
+		//bring in the scenery around the start before the first frame:
+		streamer->load_around(walk_mesh->world_point(walk_point));
+	}
+
 	auto position = walk_mesh->world_point(walk_point);
 	std::cerr << "WalkPoint" << walk_point.triangle.x << "," << walk_point.triangle.y << "," << walk_point.triangle.z << std::endl;
 	std::cerr << "position" << position.x << "," << position.y << "," << position.z << std::endl;
 }
 
 GameMode::~GameMode() {
+	delete occlusion;
+	delete pvs;
+	delete static_geometry;
+	delete path_finder;
 }
 
 bool GameMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size) {
@@ -378,15 +531,31 @@ void GameMode::update(float elapsed) {
 	spot->transform->position.y = camera->transform->position.y;
 	spot->transform->position.z = camera->transform->position.z - 0.75f;
 
+	//load scenery the player is approaching (and unload what they've left behind):
+	if (streamer) streamer->update(walk_mesh->world_point(walk_point));
+
 	for (auto spider : spiders) {
-		spider->update(elapsed);
+		spider->update(elapsed, *path_finder, walk_point, static_geometry);
+	}
+
+	//only spiders near the player can catch them, so ask the scene's object tree for what's nearby rather than checking every spider:
+	// (a spider's origin is inside its bounds, so any spider within reach has bounds overlapping the box around the player)
+	scene->update_transforms();
+	glm::vec2 player = glm::vec2(camera->transform->position.x, camera->transform->position.y);
+	AABBTree< Scene::Object const * >::Box reach;
+	reach.min = glm::vec3(player - glm::vec2(0.5f), -std::numeric_limits< float >::infinity());
+	reach.max = glm::vec3(player + glm::vec2(0.5f), std::numeric_limits< float >::infinity());
+	scene->object_tree.query_overlap(reach, [&](uint32_t leaf) {
+		Scene::Object const *object = scene->object_tree.value(leaf);
+		if (object->is_static) return true; //(only spiders move)
 		if (glm::distance(
-				glm::vec2(spider->transform->position.x, spider->transform->position.y),
-				glm::vec2(camera->transform->position.x, camera->transform->position.y)) < 0.5) {
+				glm::vec2(object->transform->position.x, object->transform->position.y),
+				player) < 0.5) {
 		    std::cerr << "GAME OVER" << std::endl;
 		    game_over = true;
 		}
-	}
+		return true;
+	});
 
 	if (glm::distance(
 			glm::vec2(statue->position.x, statue->position.y),
@@ -480,6 +649,9 @@ struct Framebuffers {
 void GameMode::draw(glm::uvec2 const &drawable_size) {
 	fbs.allocate(drawable_size, glm::uvec2(1024, 1024));
 
+	//bring cached world matrices up to date with this frame's updates (the draws below all use them):
+	scene->update_transforms();
+
 	//Draw scene to shadow map for spotlight:
 	glBindFramebuffer(GL_FRAMEBUFFER, fbs.shadow_fb);
 	glViewport(0, 0, fbs.shadow_size.x, fbs.shadow_size.y);
@@ -493,7 +665,7 @@ void GameMode::draw(glm::uvec2 const &drawable_size) {
 	glCullFace(GL_FRONT);
 	glEnable(GL_CULL_FACE);
 
-	scene->draw(spot, Scene::Object::ProgramTypeShadow);
+	scene->draw(spot, Scene::Object::ProgramTypeShadow, nullptr, pvs);
 
 	glDisable(GL_CULL_FACE);
 
@@ -517,74 +689,43 @@ void GameMode::draw(glm::uvec2 const &drawable_size) {
 	glBlendEquation(GL_FUNC_ADD);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-	//set up light positions:
-	glUseProgram(texture_program->program);
+	//set up lights (everything goes to the program's uniform buffer in one upload):
+	TextureProgram::Lights lights;
 
 	//don't use distant directional light at all (color == 0):
-	glUniform3fv(texture_program->sun_color_vec3, 1, glm::value_ptr(glm::vec3(0.0f, 0.0f, 0.0f)));
-	glUniform3fv(texture_program->sun_direction_vec3, 1, glm::value_ptr(glm::normalize(glm::vec3(0.0f, 0.0f,-1.0f))));
+	lights.sun_color = glm::vec4(0.0f, 0.0f, 0.0f, 0.0f);
+	lights.sun_direction = glm::vec4(glm::normalize(glm::vec3(0.0f, 0.0f,-1.0f)), 0.0f);
 	//use hemisphere light for subtle ambient light:
-	glUniform3fv(texture_program->sky_color_vec3, 1, glm::value_ptr(glm::vec3(0.2f, 0.2f, 0.3f)));
-	glUniform3fv(texture_program->sky_direction_vec3, 1, glm::value_ptr(glm::vec3(0.0f, 0.0f, 1.0f)));
-//
-//	{
-//	    Scene::Lamp* spot = spot_lights[0];
-//		glm::mat4 world_to_spot =
-//				//This matrix converts from the spotlight's clip space ([-1,1]^3) into depth map texture coordinates ([0,1]^2) and depth map Z values ([0,1]):
-//				glm::mat4(
-//						0.5f, 0.0f, 0.0f, 0.0f,
-//						0.0f, 0.5f, 0.0f, 0.0f,
-//						0.0f, 0.0f, 0.5f, 0.0f,
-//						0.5f, 0.5f, 0.5f + 0.00001f /* <-- bias */, 1.0f
-//				)
-//				//this is the world-to-clip matrix used when rendering the shadow map:
-//				* spot->make_projection() * spot->transform->make_world_to_local();
-//
-//		glUniformMatrix4fv(texture_program->light_to_spot_mat4, 1, GL_FALSE, glm::value_ptr(world_to_spot));
-//
-//		glm::mat4 spot_to_world = spot->transform->make_local_to_world();
-//		std::string position_name = "spot_positions[0]";
-//		GLint spot_potision = glGetUniformLocation(texture_program->program, position_name.c_str());
-//		glUniform3fv(spot_potision, 1, glm::value_ptr(glm::vec3(spot_to_world[3])));
-//		glUniform3fv(texture_program->spot_direction_vec3, 1, glm::value_ptr(-glm::vec3(spot_to_world[2])));
-//		glUniform3fv(texture_program->spot_color_vec3, 1, glm::value_ptr(glm::vec3(1.0f, 1.0f, 1.0f)));
-//
-//		glm::vec2 spot_outer_inner = glm::vec2(std::cos(0.5f * spot->fov), std::cos(0.85f * 0.5f * spot->fov));
-//		glUniform2fv(texture_program->spot_outer_inner_vec2, 1, glm::value_ptr(spot_outer_inner));
-//	}
-	{
-	    for (int i = 0; i < 12; i++) {
-	    	Scene::Lamp* spot = spot_lights[i];
-			glm::mat4 world_to_spot =
-							  //This matrix converts from the spotlight's clip space ([-1,1]^3) into depth map texture coordinates ([0,1]^2) and depth map Z values ([0,1]):
-							  glm::mat4(
-									  0.5f, 0.0f, 0.0f, 0.0f,
-									  0.0f, 0.5f, 0.0f, 0.0f,
-									  0.0f, 0.0f, 0.5f, 0.0f,
-									  0.5f, 0.5f, 0.5f + 0.00001f /* <-- bias */, 1.0f
-							  )
-							  //this is the world-to-clip matrix used when rendering the shadow map:
-							  * spot->make_projection() * spot->transform->make_world_to_local();
-
-			std::string light_to_spot_name= "light_to_spots[" + std::to_string(i) + "]";
-			GLint light_to_spot_position = glGetUniformLocation(texture_program->program, light_to_spot_name.c_str());
-
-			glUniformMatrix4fv(light_to_spot_position, 1, GL_FALSE, glm::value_ptr(world_to_spot));
-
-			glm::mat4 spot_to_world = spot->transform->make_local_to_world();
-			std::string position_name = "spot_positions[" + std::to_string(i) + "]";
-			std::string direction_name = "spot_directions[" + std::to_string(i) + "]";
-			GLint spot_potision = glGetUniformLocation(texture_program->program, position_name.c_str());
-			GLint spot_direction= glGetUniformLocation(texture_program->program, direction_name.c_str());
-			glUniform3fv(spot_potision, 1, glm::value_ptr(glm::vec3(spot_to_world[3])));
-			glUniform3fv(spot_direction, 1, glm::value_ptr(-glm::vec3(spot_to_world[2])));
-			glUniform3fv(texture_program->spot_color_vec3, 1, glm::value_ptr(glm::vec3(1.0f, 1.0f, 1.0f)));
-
-			glm::vec2 spot_outer_inner = glm::vec2(std::cos(0.4f * spot->fov), std::cos(0.85f * 0.4f * spot->fov));
-			glUniform2fv(texture_program->spot_outer_inner_vec2, 1, glm::value_ptr(spot_outer_inner));
-		}
+	lights.sky_color = glm::vec4(0.2f, 0.2f, 0.3f, 0.0f);
+	lights.sky_direction = glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+
+	assert(spot_lights.size() >= TextureProgram::SpotCount);
+	for (uint32_t i = 0; i < TextureProgram::SpotCount; ++i) {
+		Scene::Lamp *spot_light = spot_lights[i];
+		lights.light_to_spots[i] =
+			//This matrix converts from the spotlight's clip space ([-1,1]^3) into depth map texture coordinates ([0,1]^2) and depth map Z values ([0,1]):
+			glm::mat4(
+				0.5f, 0.0f, 0.0f, 0.0f,
+				0.0f, 0.5f, 0.0f, 0.0f,
+				0.0f, 0.0f, 0.5f, 0.0f,
+				0.5f, 0.5f, 0.5f + 0.00001f /* <-- bias */, 1.0f
+			)
+			//this is the world-to-clip matrix used when rendering the shadow map:
+			* spot_light->make_projection() * spot_light->transform->world_to_local;
+
+		glm::mat4 const &spot_to_world = spot_light->transform->local_to_world;
+		lights.spot_positions[i] = glm::vec4(glm::vec3(spot_to_world[3]), 1.0f);
+		lights.spot_directions[i] = glm::vec4(-glm::vec3(spot_to_world[2]), 0.0f);
 	}
-	glUniform3fv(texture_program->camera_position_vec3, 1, glm::value_ptr(camera->transform->position));
+	//(all spots share a color and falloff; the falloff comes from the shadow-casting spot)
+	lights.spot_color = glm::vec4(1.0f, 1.0f, 1.0f, 0.0f);
+	lights.spot_outer_inner = glm::vec4(std::cos(0.4f * spot->fov), std::cos(0.85f * 0.4f * spot->fov), 0.0f, 0.0f);
+	lights.camera_position = glm::vec4(camera->transform->position, 1.0f);
+
+	glBindBuffer(GL_UNIFORM_BUFFER, texture_program->lights_buffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(lights), &lights);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, TextureProgram::LightsBinding, texture_program->lights_buffer);
 
 	//This code binds texture index 1 to the shadow map:
 	// (note that this is a bit brittle -- it depends on none of the objects in the scene having a texture of index 1 set in their material data; otherwise scene::draw would unbind this texture):
@@ -596,7 +737,9 @@ void GameMode::draw(glm::uvec2 const &drawable_size) {
 	//NOTE: however, these are parameters of the texture object, not the binding point, so there is no need to set them *each frame*. I'm doing it here so that you are likely to see that they are being set.
 	glActiveTexture(GL_TEXTURE0);
 
-	scene->draw(camera);
+	//rasterize the walls from the camera's point of view, so objects hidden behind them can be skipped:
+	occlusion->render(camera->make_projection() * camera->transform->world_to_local);
+	scene->draw(camera, Scene::Object::ProgramTypeDefault, nullptr, pvs, occlusion);
 
 	glActiveTexture(GL_TEXTURE1);
 	glBindTexture(GL_TEXTURE_2D, 0);
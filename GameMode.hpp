@@ -3,7 +3,11 @@
 #include "Mode.hpp"
 
 #include "WalkMesh.hpp"
+#include "PathFinder.hpp"
+#include "TriangleBVH.hpp"
 #include "MeshBuffer.hpp"
+#include "PVS.hpp"
+#include "OcclusionBuffer.hpp"
 #include "GL.hpp"
 
 #include <SDL.h>
@@ -42,6 +46,10 @@ struct GameMode : public Mode {
 	bool mouse_captured = true;
 	WalkMesh* walk_mesh;
 	WalkMesh::WalkPoint walk_point;
+	PathFinder *path_finder = nullptr; //used by spiders to chase the player
+	TriangleBVH *static_geometry = nullptr; //static scene geometry + walkmesh, for line-of-sight checks
+	PVS *pvs = nullptr; //(optional) which parts of the maze can see each other, for skipping hidden objects when drawing
+	OcclusionBuffer *occlusion = nullptr; //the maze walls, rasterized on the CPU each frame, for skipping objects behind them
 
 	bool game_over = false;
 	bool win = false;
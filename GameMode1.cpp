@@ -148,14 +148,12 @@ Load< Scene > scene(LoadTagDefault, [](){
 	Scene::Object::ProgramInfo texture_program_info;
 	texture_program_info.program = texture_program->program;
 	texture_program_info.vao = *meshes_for_texture_program;
-	texture_program_info.mvp_mat4  = texture_program->object_to_clip_mat4;
-	texture_program_info.mv_mat4x3 = texture_program->object_to_light_mat4x3;
-	texture_program_info.itmv_mat3 = texture_program->normal_to_light_mat3;
+	texture_program_info.object_constants_block = texture_program->object_constants_block;
 
 	Scene::Object::ProgramInfo depth_program_info;
 	depth_program_info.program = depth_program->program;
 	depth_program_info.vao = *meshes_for_depth_program;
-	depth_program_info.mvp_mat4  = depth_program->object_to_clip_mat4;
+	depth_program_info.object_constants_block = depth_program->object_constants_block;
 
 
 	//load transform hierarchy:
@@ -163,9 +161,9 @@ Load< Scene > scene(LoadTagDefault, [](){
 		Scene::Object *obj = s.new_object(t);
 
 		obj->programs[Scene::Object::ProgramTypeDefault] = texture_program_info;
-		if (t->name == "Platform") {
+		if (s.name(t) == "Platform") {
 			obj->programs[Scene::Object::ProgramTypeDefault].textures[0] = *wood_tex;
-		} else if (t->name == "Pedestal") {
+		} else if (s.name(t) == "Pedestal") {
 			obj->programs[Scene::Object::ProgramTypeDefault].textures[0] = *marble_tex;
 		} else {
 			obj->programs[Scene::Object::ProgramTypeDefault].textures[0] = *white_tex;
@@ -182,38 +180,28 @@ Load< Scene > scene(LoadTagDefault, [](){
 	});
 
 	//look up camera parent transform:
-	for (Scene::Transform *t = ret->first_transform; t != nullptr; t = t->alloc_next) {
-		if (t->name == "CameraParent") {
-			if (camera_parent_transform) throw std::runtime_error("Multiple 'CameraParent' transforms in scene.");
-			camera_parent_transform = t;
-		}
-		if (t->name == "SpotParent") {
-			if (spot_parent_transform) throw std::runtime_error("Multiple 'SpotParent' transforms in scene.");
-			spot_parent_transform = t;
-		}
+	Scene::Named< Scene::Transform > camera_parents = ret->transforms_named("CameraParent");
+	if (camera_parents.size() > 1) throw std::runtime_error("Multiple 'CameraParent' transforms in scene.");
+	if (camera_parents.empty()) throw std::runtime_error("No 'CameraParent' transform in scene.");
+	camera_parent_transform = *camera_parents.begin();
 
-	}
-	if (!camera_parent_transform) throw std::runtime_error("No 'CameraParent' transform in scene.");
-	if (!spot_parent_transform) throw std::runtime_error("No 'SpotParent' transform in scene.");
+	Scene::Named< Scene::Transform > spot_parents = ret->transforms_named("SpotParent");
+	if (spot_parents.size() > 1) throw std::runtime_error("Multiple 'SpotParent' transforms in scene.");
+	if (spot_parents.empty()) throw std::runtime_error("No 'SpotParent' transform in scene.");
+	spot_parent_transform = *spot_parents.begin();
 
 	//look up the camera:
-	for (Scene::Camera *c = ret->first_camera; c != nullptr; c = c->alloc_next) {
-		if (c->transform->name == "Camera") {
-			if (camera) throw std::runtime_error("Multiple 'Camera' objects in scene.");
-			camera = c;
-		}
-	}
-	if (!camera) throw std::runtime_error("No 'Camera' camera in scene.");
+	Scene::Named< Scene::Camera > named_cameras = ret->cameras_named("Camera");
+	if (named_cameras.size() > 1) throw std::runtime_error("Multiple 'Camera' objects in scene.");
+	if (named_cameras.empty()) throw std::runtime_error("No 'Camera' camera in scene.");
+	camera = *named_cameras.begin();
 
 	//look up the spotlight:
-	for (Scene::Lamp *l = ret->first_lamp; l != nullptr; l = l->alloc_next) {
-		if (l->transform->name == "Spot") {
-			if (spot) throw std::runtime_error("Multiple 'Spot' objects in scene.");
-			if (l->type != Scene::Lamp::Spot) throw std::runtime_error("Lamp 'Spot' is not a spotlight.");
-			spot = l;
-		}
-	}
-	if (!spot) throw std::runtime_error("No 'Spot' spotlight in scene.");
+	Scene::Named< Scene::Lamp > named_spots = ret->lamps_named("Spot");
+	if (named_spots.size() > 1) throw std::runtime_error("Multiple 'Spot' objects in scene.");
+	if (named_spots.empty()) throw std::runtime_error("No 'Spot' spotlight in scene.");
+	spot = *named_spots.begin();
+	if (spot->type != Scene::Lamp::Spot) throw std::runtime_error("Lamp 'Spot' is not a spotlight.");
 
 	return ret;
 });
@@ -371,17 +359,23 @@ void GameMode::draw(glm::uvec2 const &drawable_size) {
 	glBlendEquation(GL_FUNC_ADD);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-	//set up light positions:
-	glUseProgram(texture_program->program);
+	//set up lights (everything goes to the program's uniform buffer in one upload):
+	TextureProgram::Lights lights;
 
 	//don't use distant directional light at all (color == 0):
-	glUniform3fv(texture_program->sun_color_vec3, 1, glm::value_ptr(glm::vec3(0.0f, 0.0f, 0.0f)));
-	glUniform3fv(texture_program->sun_direction_vec3, 1, glm::value_ptr(glm::normalize(glm::vec3(0.0f, 0.0f,-1.0f))));
+	lights.sun_color = glm::vec4(0.0f, 0.0f, 0.0f, 0.0f);
+	lights.sun_direction = glm::vec4(glm::normalize(glm::vec3(0.0f, 0.0f,-1.0f)), 0.0f);
 	//use hemisphere light for subtle ambient light:
-	glUniform3fv(texture_program->sky_color_vec3, 1, glm::value_ptr(glm::vec3(0.2f, 0.2f, 0.3f)));
-	glUniform3fv(texture_program->sky_direction_vec3, 1, glm::value_ptr(glm::vec3(0.0f, 0.0f, 1.0f)));
-
-	glm::mat4 world_to_spot =
+	lights.sky_color = glm::vec4(0.2f, 0.2f, 0.3f, 0.0f);
+	lights.sky_direction = glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+
+	//only one spot, in the last slot (the one that uses the shadow map); the other slots point nowhere, so they add no light:
+	for (uint32_t i = 0; i < TextureProgram::SpotCount; ++i) {
+		lights.light_to_spots[i] = glm::mat4(1.0f);
+		lights.spot_positions[i] = glm::vec4(0.0f);
+		lights.spot_directions[i] = glm::vec4(0.0f);
+	}
+	lights.light_to_spots[TextureProgram::SpotCount-1] =
 		//This matrix converts from the spotlight's clip space ([-1,1]^3) into depth map texture coordinates ([0,1]^2) and depth map Z values ([0,1]):
 		glm::mat4(
 			0.5f, 0.0f, 0.0f, 0.0f,
@@ -392,15 +386,17 @@ void GameMode::draw(glm::uvec2 const &drawable_size) {
 		//this is the world-to-clip matrix used when rendering the shadow map:
 		* spot->make_projection() * spot->transform->make_world_to_local();
 
-	glUniformMatrix4fv(texture_program->light_to_spot_mat4, 1, GL_FALSE, glm::value_ptr(world_to_spot));
-
 	glm::mat4 spot_to_world = spot->transform->make_local_to_world();
-	glUniform3fv(texture_program->spot_position_vec3, 1, glm::value_ptr(glm::vec3(spot_to_world[3])));
-	glUniform3fv(texture_program->spot_direction_vec3, 1, glm::value_ptr(-glm::vec3(spot_to_world[2])));
-	glUniform3fv(texture_program->spot_color_vec3, 1, glm::value_ptr(glm::vec3(1.0f, 1.0f, 1.0f)));
+	lights.spot_positions[TextureProgram::SpotCount-1] = glm::vec4(glm::vec3(spot_to_world[3]), 1.0f);
+	lights.spot_directions[TextureProgram::SpotCount-1] = glm::vec4(-glm::vec3(spot_to_world[2]), 0.0f);
+	lights.spot_color = glm::vec4(1.0f, 1.0f, 1.0f, 0.0f);
+
+	lights.spot_outer_inner = glm::vec4(std::cos(0.5f * spot->fov), std::cos(0.85f * 0.5f * spot->fov), 0.0f, 0.0f);
 
-	glm::vec2 spot_outer_inner = glm::vec2(std::cos(0.5f * spot->fov), std::cos(0.85f * 0.5f * spot->fov));
-	glUniform2fv(texture_program->spot_outer_inner_vec2, 1, glm::value_ptr(spot_outer_inner));
+	glBindBuffer(GL_UNIFORM_BUFFER, texture_program->lights_buffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(lights), &lights);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, TextureProgram::LightsBinding, texture_program->lights_buffer);
 
 	//This code binds texture index 1 to the shadow map:
 	// (note that this is a bit brittle -- it depends on none of the objects in the scene having a texture of index 1 set in their material data; otherwise scene::draw would unbind this texture):
@@ -0,0 +1,341 @@
+#include "LevelStreamer.hpp"
+#include "read_chunk.hpp"
+
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include <cstddef>
+#include <cassert>
+
+LevelStreamer::LevelStreamer(std::string const &filename_, Scene *scene_, uint32_t slots) : filename(filename_), scene(scene_) {
+	assert(scene);
+	if (slots == 0) throw std::runtime_error("LevelStreamer needs at least one slot.");
+
+	std::ifstream file(filename, std::ios::binary);
+	if (!file) throw std::runtime_error("Failed to open chunks file '" + filename + "'.");
+
+	std::vector< Header > headers;
+	read_chunk(file, "lch0", &headers);
+	if (headers.size() != 1) throw std::runtime_error("Chunks file '" + filename + "' should have exactly one header.");
+	header = headers[0];
+	read_chunk(file, "str0", &names);
+	std::vector< ChunkInfo > infos;
+	read_chunk(file, "lci0", &infos);
+	std::vector< ResidentMesh > resident;
+	read_chunk(file, "lcm0", &resident);
+	read_chunk(file, "lcp0", &positions);
+	data_start = uint32_t(file.tellg());
+
+	chunks.resize(infos.size());
+	for (uint32_t i = 0; i < infos.size(); ++i) {
+		ChunkInfo const &info = infos[i];
+		if (info.vertices > header.max_vertices) {
+			throw std::runtime_error("Chunks file '" + filename + "' has a chunk with more than max_vertices vertices.");
+		}
+		chunks[i].info = info;
+	}
+	for (auto const &r : resident) {
+		if (!(r.name_begin <= r.name_end && r.name_end <= names.size())) {
+			throw std::runtime_error("Chunks file '" + filename + "' has a resident mesh with out-of-range name begin/end.");
+		}
+		if (!(r.vertex_begin <= r.vertex_end && r.vertex_end <= positions.size())) {
+			throw std::runtime_error("Chunks file '" + filename + "' has a resident mesh with out-of-range vertex begin/end.");
+		}
+		MeshBuffer::Mesh mesh;
+		mesh.start = r.vertex_begin;
+		mesh.count = r.vertex_end - r.vertex_begin;
+		if (mesh.count) {
+			mesh.min = mesh.max = positions[mesh.start];
+			for (GLuint v = mesh.start + 1; v < mesh.start + mesh.count; ++v) {
+				mesh.min = glm::min(mesh.min, positions[v]);
+				mesh.max = glm::max(mesh.max, positions[v]);
+			}
+		}
+		meshes.insert(std::make_pair(std::string(names.begin() + r.name_begin, names.begin() + r.name_end), mesh));
+	}
+
+	//vertex buffer with room for 'slots' chunks of the largest size:
+	glGenBuffers(1, &vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(slots) * header.max_vertices * sizeof(Vertex), nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	for (uint32_t s = 0; s < slots; ++s) {
+		free_slots.emplace_back(slots - 1 - s);
+	}
+
+	reader = std::thread(&LevelStreamer::read_loop, this);
+}
+
+LevelStreamer::~LevelStreamer() {
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		quit = true;
+	}
+	requested.notify_all();
+	reader.join();
+
+	for (auto &chunk : chunks) {
+		if (chunk.state == Chunk::Resident) remove_chunk(chunk);
+	}
+	glDeleteBuffers(1, &vbo);
+}
+
+GLuint LevelStreamer::make_vao_for_program(GLuint program) const {
+	return MeshBuffer::make_vao_for_program(program, vbo,
+		MeshBuffer::Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Position)),
+		MeshBuffer::Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Normal)),
+		MeshBuffer::Attrib(4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), offsetof(Vertex, Color)),
+		MeshBuffer::Attrib(2, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, TexCoord))
+	);
+}
+
+//distance in xy from a point to a box:
+static float distance_xy(glm::vec3 const &min, glm::vec3 const &max, glm::vec3 const &point) {
+	glm::vec2 d = glm::max(glm::max(glm::vec2(min) - glm::vec2(point), glm::vec2(point) - glm::vec2(max)), glm::vec2(0.0f));
+	return glm::length(d);
+}
+
+void LevelStreamer::update(glm::vec3 const &position) {
+	stats = Stats();
+
+	finish_reads(false);
+
+	//drop chunks that are now too far away, and list those close enough to load:
+	candidates.clear();
+	for (uint32_t i = 0; i < chunks.size(); ++i) {
+		Chunk &chunk = chunks[i];
+		float distance = distance_xy(chunk.info.min, chunk.info.max, position);
+		if (chunk.state == Chunk::Unloaded) {
+			if (distance < load_radius) candidates.emplace_back(distance, i);
+		} else {
+			chunk.wanted = (distance < unload_radius);
+			if (!chunk.wanted && chunk.state != Chunk::Reading) remove_chunk(chunk);
+		}
+	}
+
+	//start reading the closest of them, as long as there are slots to put them in:
+	std::sort(candidates.begin(), candidates.end());
+	for (auto const &candidate : candidates) {
+		if (free_slots.empty()) {
+			//make room by dropping the furthest chunk that is only being kept because it is inside unload_radius:
+			uint32_t furthest = -1U;
+			float furthest_distance = load_radius;
+			for (uint32_t i = 0; i < chunks.size(); ++i) {
+				Chunk const &chunk = chunks[i];
+				if (chunk.state == Chunk::Unloaded || chunk.state == Chunk::Reading) continue;
+				float distance = distance_xy(chunk.info.min, chunk.info.max, position);
+				if (distance >= furthest_distance) {
+					furthest = i;
+					furthest_distance = distance;
+				}
+			}
+			if (furthest == -1U) break;
+			remove_chunk(chunks[furthest]);
+		}
+		start_chunk(candidate.second);
+	}
+
+	//upload read chunks, closest first, until the budget runs out:
+	candidates.clear();
+	for (uint32_t i = 0; i < chunks.size(); ++i) {
+		Chunk const &chunk = chunks[i];
+		if (chunk.state == Chunk::Uploading) {
+			candidates.emplace_back(distance_xy(chunk.info.min, chunk.info.max, position), i);
+		}
+	}
+	std::sort(candidates.begin(), candidates.end());
+	uint32_t budget = upload_budget;
+	for (auto const &candidate : candidates) {
+		if (budget == 0) break;
+		Chunk &chunk = chunks[candidate.second];
+		if (upload_chunk(chunk, &budget)) add_chunk(chunk);
+	}
+
+	for (auto const &chunk : chunks) {
+		if (chunk.state == Chunk::Resident) ++stats.resident;
+		else if (chunk.state != Chunk::Unloaded) ++stats.pending;
+	}
+}
+
+void LevelStreamer::load_around(glm::vec3 const &position) {
+	uint32_t budget = upload_budget;
+	upload_budget = -1U;
+	update(position);
+	while (std::any_of(chunks.begin(), chunks.end(), [](Chunk const &chunk){ return chunk.state == Chunk::Reading; })) {
+		finish_reads(true);
+		update(position);
+	}
+	upload_budget = budget;
+}
+
+void LevelStreamer::start_chunk(uint32_t index) {
+	Chunk &chunk = chunks[index];
+	assert(chunk.state == Chunk::Unloaded);
+	assert(!free_slots.empty());
+
+	chunk.slot = free_slots.back();
+	free_slots.pop_back();
+	chunk.state = Chunk::Reading;
+	chunk.wanted = true;
+	chunk.uploaded = 0;
+
+	Read read;
+	read.chunk = index;
+	if (!spare_data.empty()) {
+		read.data.swap(spare_data.back());
+		spare_data.pop_back();
+	}
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		requests.emplace_back(std::move(read));
+	}
+	requested.notify_one();
+}
+
+void LevelStreamer::finish_reads(bool wait) {
+	std::unique_lock< std::mutex > lock(mutex);
+	if (wait) {
+		finished.wait(lock, [this](){ return !results.empty() || !read_error.empty(); });
+	}
+	if (!read_error.empty()) throw std::runtime_error(read_error);
+
+	while (!results.empty()) {
+		Read read = std::move(results.front());
+		results.pop_front();
+
+		Chunk &chunk = chunks[read.chunk];
+		assert(chunk.state == Chunk::Reading);
+		chunk.data.swap(read.data);
+		if (read.data.capacity()) {
+			spare_data.emplace_back();
+			spare_data.back().swap(read.data);
+		}
+
+		//check the vertex data before uploading any of it:
+		char const *at = chunk.data.data();
+		Vertex const *vertices = nullptr;
+		size_t count = 0;
+		map_chunk(at, at + chunk.data.size(), "pnct", &vertices, &count);
+		if (count != chunk.info.vertices) {
+			throw std::runtime_error("Chunks file '" + filename + "' has a chunk with the wrong number of vertices.");
+		}
+
+		chunk.state = Chunk::Uploading;
+		if (!chunk.wanted) remove_chunk(chunk);
+	}
+}
+
+bool LevelStreamer::upload_chunk(Chunk &chunk, uint32_t *budget) {
+	assert(chunk.state == Chunk::Uploading);
+	assert(budget);
+
+	//(vertices start just past the "pnct" chunk header, as checked by finish_reads)
+	uint32_t total = chunk.info.vertices * uint32_t(sizeof(Vertex));
+	uint32_t count = std::min(total - chunk.uploaded, *budget);
+	if (count) {
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		glBufferSubData(GL_ARRAY_BUFFER,
+			GLintptr(chunk.slot) * header.max_vertices * sizeof(Vertex) + chunk.uploaded,
+			count, chunk.data.data() + 8 + chunk.uploaded);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		chunk.uploaded += count;
+		*budget -= count;
+		stats.uploaded += count;
+	}
+	return chunk.uploaded == total;
+}
+
+void LevelStreamer::add_chunk(Chunk &chunk) {
+	assert(chunk.state == Chunk::Uploading);
+
+	char const *at = chunk.data.data();
+	char const *end = at + chunk.data.size();
+	Vertex const *vertices = nullptr;
+	size_t vertex_count = 0;
+	map_chunk(at, end, "pnct", &vertices, &vertex_count);
+	ChunkPart const *parts = nullptr;
+	size_t part_count = 0;
+	map_chunk(at, end, "lcq0", &parts, &part_count);
+
+	//one object (on its own transform, named for the object the triangles came from) per part:
+	GLuint first = GLuint(chunk.slot * header.max_vertices);
+	for (size_t p = 0; p < part_count; ++p) {
+		ChunkPart const &part = parts[p];
+		if (!(part.name_begin <= part.name_end && part.name_end <= names.size())) {
+			throw std::runtime_error("Chunks file '" + filename + "' has a chunk part with out-of-range name begin/end.");
+		}
+		if (!(part.vertex_begin <= part.vertex_end && part.vertex_end <= vertex_count)) {
+			throw std::runtime_error("Chunks file '" + filename + "' has a chunk part with out-of-range vertex begin/end.");
+		}
+		Scene::Transform *transform = scene->new_transform();
+		scene->set_name(transform, std::string(names.begin() + part.name_begin, names.begin() + part.name_end));
+		Scene::Object *object = scene->new_object(transform);
+		object->is_static = true;
+		object->has_bounds = true;
+		object->bounds_min = part.min;
+		object->bounds_max = part.max;
+
+		MeshBuffer::Mesh mesh;
+		mesh.start = first + part.vertex_begin;
+		mesh.count = part.vertex_end - part.vertex_begin;
+		mesh.min = part.min;
+		mesh.max = part.max;
+		if (on_object) on_object(object, scene->name(transform), mesh);
+		chunk.objects.emplace_back(object);
+	}
+
+	chunk.state = Chunk::Resident;
+	spare_data.emplace_back();
+	spare_data.back().swap(chunk.data);
+	++stats.loaded;
+}
+
+void LevelStreamer::remove_chunk(Chunk &chunk) {
+	assert(chunk.state == Chunk::Uploading || chunk.state == Chunk::Resident);
+
+	if (chunk.state == Chunk::Resident) ++stats.unloaded;
+	for (Scene::Object *object : chunk.objects) {
+		Scene::Transform *transform = object->transform;
+		scene->delete_object(object);
+		scene->delete_transform(transform);
+	}
+	chunk.objects.clear();
+	if (chunk.data.capacity()) {
+		spare_data.emplace_back();
+		spare_data.back().swap(chunk.data);
+	}
+
+	//(freed slots go to the back of the line, so the GPU is unlikely to still be drawing from a slot when it is refilled)
+	free_slots.insert(free_slots.begin(), chunk.slot);
+	chunk.slot = -1U;
+	chunk.state = Chunk::Unloaded;
+	chunk.wanted = false;
+	chunk.uploaded = 0;
+}
+
+void LevelStreamer::read_loop() {
+	std::ifstream file(filename, std::ios::binary);
+
+	std::unique_lock< std::mutex > lock(mutex);
+	while (true) {
+		requested.wait(lock, [this](){ return quit || !requests.empty(); });
+		if (quit) break;
+		Read read = std::move(requests.front());
+		requests.pop_front();
+		lock.unlock();
+
+		//(chunk infos don't change after construction, so reading them here doesn't need the lock)
+		ChunkInfo const &info = chunks[read.chunk].info;
+		read.data.resize(info.size);
+		bool ok = bool(file.seekg(std::streamoff(data_start) + info.offset))
+		       && bool(file.read(read.data.data(), info.size));
+
+		lock.lock();
+		if (!ok) {
+			read_error = "Failed to read chunk (" + std::to_string(info.x) + ", " + std::to_string(info.y) + ") from '" + filename + "'.";
+			file.clear();
+		}
+		results.emplace_back(std::move(read));
+		finished.notify_one();
+	}
+}
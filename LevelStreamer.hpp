@@ -0,0 +1,159 @@
+#pragma once
+
+#include "GL.hpp"
+#include "Scene.hpp"
+#include "MeshBuffer.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <deque>
+#include <map>
+#include <string>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+//"LevelStreamer" keeps the part of a level near the player loaded, reading it from a '.chunks' file (made by build_chunks):
+// the level's static scenery is split into square chunks on a grid (as world-space triangles, grouped by the name of the object they came from);
+// chunks within 'load_radius' of the player are read by a background thread, uploaded into slots of one vertex buffer at most
+// 'upload_budget' bytes per update(), and then added to the scene as objects; chunks beyond 'unload_radius' are removed.
+// (the gap between the radii keeps a player walking along a chunk border from loading and unloading the same chunks over and over)
+//Vertex buffer memory is bounded: the buffer holds 'slots' chunks, and chunks are only read once they have a slot.
+//Line-of-sight geometry is not: every chunk's triangle positions (without the other vertex data) are read up front for gameplay,
+// e.g. line-of-sight checks, so that memory grows with the level's size (12 bytes per triangle corner).
+// (callers that copy the positions elsewhere, e.g. into a TriangleBVH, may clear 'positions' afterward; 'meshes' then refers to nothing)
+
+struct LevelStreamer {
+	//open a '.chunks' file (reading its index and resident positions), and allocate a vertex buffer for 'slots' chunks:
+	// objects for loaded chunks are added to 'scene'.
+	LevelStreamer(std::string const &filename, Scene *scene, uint32_t slots = 24);
+	~LevelStreamer(); //(removes loaded chunks' objects from the scene)
+	LevelStreamer(LevelStreamer const &) = delete;
+
+	//tuning:
+	float load_radius = 12.0f; //chunks with bounds (in xy) closer than this to the player are loaded...
+	float unload_radius = 16.0f; //...and stay loaded until they are further than this
+	uint32_t upload_budget = 64 * 1024; //bytes of vertex data sent to OpenGL per update()
+
+	//called for each object made for a loaded chunk, with the name of the object its triangles came from and their range in the vertex buffer:
+	// (the object's transform, bounds, and is_static are already set; the callback should set up programs as Scene::load's callback does)
+	std::function< void(Scene::Object *, std::string const &name, MeshBuffer::Mesh const &mesh) > on_object;
+
+	//call once per frame, on the thread with the OpenGL context, with the player's position:
+	void update(glm::vec3 const &position);
+
+	//load every chunk within load_radius of 'position' right away, ignoring the upload budget (e.g., before the first frame):
+	void load_around(glm::vec3 const &position);
+
+	//build a vertex array object that links the vertex buffer (laid out like a '.pnct' MeshBuffer) to a program's attributes:
+	GLuint make_vao_for_program(GLuint program) const;
+
+	//world-space triangle corners of all streamed scenery, grouped by the name of the object they came from (like MeshBuffer's):
+	// (not bounded by 'slots'; see above)
+	std::vector< glm::vec3 > positions;
+	std::map< std::string, MeshBuffer::Mesh > meshes;
+
+	//counts from the last update(), for tuning:
+	struct Stats {
+		uint32_t resident = 0; //chunks in the scene
+		uint32_t pending = 0; //chunks being read or uploaded
+		uint32_t uploaded = 0; //bytes sent to OpenGL
+		uint32_t loaded = 0; //chunks added to the scene
+		uint32_t unloaded = 0; //chunks removed from the scene
+	} stats;
+
+	//------ file format ------
+	//A '.chunks' file is a series of chunks (see read_chunk.hpp):
+	// "lch0": one Header
+	// "str0": names
+	// "lci0": ChunkInfo for each non-empty chunk
+	// "lcm0": ResidentMesh for each object name (its range of "lcp0")
+	// "lcp0": world-space positions (glm::vec3) of the triangle corners of all chunks
+	// ...followed by each chunk's data at ChunkInfo::offset (counting from the end of "lcp0"):
+	// "pnct": world-space vertices (as in a '.pnct' file)
+	// "lcq0": ChunkPart for each object name in the chunk
+	struct Header {
+		glm::vec2 origin = glm::vec2(0.0f); //lower-left corner of the grid
+		float chunk_size = 8.0f; //width and height of a chunk
+		uint32_t width = 0, height = 0; //in chunks
+		uint32_t max_vertices = 0; //most vertices in any one chunk (the size of a slot)
+	};
+	static_assert(sizeof(Header) == 4*2 + 4 + 4*2 + 4, "Header is packed.");
+	struct ChunkInfo {
+		uint32_t x, y; //grid coordinates
+		glm::vec3 min, max; //bounds of the chunk's triangles (which may stick out of its grid square)
+		uint32_t offset, size; //bytes of chunk data
+		uint32_t vertices;
+	};
+	static_assert(sizeof(ChunkInfo) == 4*2 + 4*3*2 + 4*2 + 4, "ChunkInfo is packed.");
+	struct ResidentMesh {
+		uint32_t name_begin, name_end;
+		uint32_t vertex_begin, vertex_end; //in "lcp0"
+	};
+	static_assert(sizeof(ResidentMesh) == 4*4, "ResidentMesh is packed.");
+	struct ChunkPart {
+		uint32_t name_begin, name_end;
+		uint32_t vertex_begin, vertex_end; //in the chunk's "pnct"
+		glm::vec3 min, max;
+	};
+	static_assert(sizeof(ChunkPart) == 4*4 + 4*3*2, "ChunkPart is packed.");
+	struct Vertex {
+		glm::vec3 Position;
+		glm::vec3 Normal;
+		glm::u8vec4 Color;
+		glm::vec2 TexCoord;
+	};
+	static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
+
+	//internals:
+	std::string filename;
+	Scene *scene;
+	Header header;
+	std::vector< char > names;
+	uint32_t data_start = 0; //file offset of the first chunk's data
+
+	GLuint vbo = 0;
+	std::vector< uint32_t > free_slots;
+
+	struct Chunk {
+		ChunkInfo info;
+		enum State : uint8_t {
+			Unloaded,
+			Reading, //waiting for the reader thread
+			Uploading, //data read; 'uploaded' bytes of vertices sent so far
+			Resident, //objects are in the scene
+		} state = Unloaded;
+		bool wanted = false; //(chunks that stop being wanted while being read are dropped when the read finishes)
+		uint32_t slot = -1U;
+		uint32_t uploaded = 0;
+		std::vector< char > data; //(while uploading)
+		std::vector< Scene::Object * > objects; //(while resident; each on its own transform)
+	};
+	std::vector< Chunk > chunks;
+	std::vector< std::pair< float, uint32_t > > candidates; //scratch space for update(): (distance, chunk index)
+
+	void start_chunk(uint32_t index); //take a slot and ask the reader thread for a chunk
+	void finish_reads(bool wait); //collect chunks read by the reader thread (waiting for at least one, if 'wait')
+	bool upload_chunk(Chunk &chunk, uint32_t *budget); //send up to 'budget' bytes; returns true if all vertices are sent
+	void add_chunk(Chunk &chunk); //make objects for an uploaded chunk
+	void remove_chunk(Chunk &chunk); //delete a chunk's objects (if resident) and free its slot
+
+	//reader thread, which reads requested chunks' data:
+	struct Read {
+		uint32_t chunk;
+		std::vector< char > data;
+	};
+	std::thread reader;
+	std::mutex mutex;
+	std::condition_variable requested;
+	std::condition_variable finished;
+	std::deque< Read > requests; //(guarded by mutex)
+	std::deque< Read > results; //(guarded by mutex)
+	std::string read_error; //(guarded by mutex) set if a read fails; update() then throws it
+	bool quit = false; //(guarded by mutex)
+	std::vector< std::vector< char > > spare_data; //buffers to reuse for reads, so (once warmed up) reads don't allocate
+	void read_loop();
+};
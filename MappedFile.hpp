@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+//"MappedFile" maps a whole file read-only into memory; the mapping lasts as long as the MappedFile.
+// (pages are only read from disk as they are touched, so this is a cheap way to load large binary blobs)
+
+struct MappedFile {
+	//note: will throw if the file can't be opened or mapped.
+	MappedFile(std::string const &filename);
+	~MappedFile();
+
+	MappedFile(MappedFile const &) = delete;
+	MappedFile &operator=(MappedFile const &) = delete;
+
+	char const *data = nullptr;
+	size_t size = 0;
+
+	//internals:
+#ifdef _WIN32
+	void *file_handle = nullptr;
+	void *mapping_handle = nullptr;
+#else
+	int fd = -1;
+#endif
+};
@@ -10,8 +10,10 @@
 #include <string>
 #include <set>
 #include <cstddef>
+#include <cstring>
+#include <algorithm>
 
-MeshBuffer::MeshBuffer(std::string const &filename) {
+MeshBuffer::MeshBuffer(std::string const &filename, bool keep_vertex_data) {
 	glGenBuffers(1, &vbo);
 
 	std::ifstream file(filename, std::ios::binary);
@@ -34,6 +36,11 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 
 		total = GLuint(data.size()); //store total for later checks on index
 
+		positions.reserve(data.size());
+		for (auto const &v : data) positions.emplace_back(v.Position);
+		vertex_size = sizeof(Vertex);
+		if (keep_vertex_data) vertex_data.assign(reinterpret_cast< char const * >(data.data()), reinterpret_cast< char const * >(data.data() + data.size()));
+
 		//store attrib locations:
 		Position = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Position));
 
@@ -54,6 +61,11 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 
 		total = GLuint(data.size()); //store total for later checks on index
 
+		positions.reserve(data.size());
+		for (auto const &v : data) positions.emplace_back(v.Position);
+		vertex_size = sizeof(Vertex);
+		if (keep_vertex_data) vertex_data.assign(reinterpret_cast< char const * >(data.data()), reinterpret_cast< char const * >(data.data() + data.size()));
+
 		//store attrib locations:
 		Position = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Position));
 		Normal = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Normal));
@@ -76,6 +88,11 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 
 		total = GLuint(data.size()); //store total for later checks on index
 
+		positions.reserve(data.size());
+		for (auto const &v : data) positions.emplace_back(v.Position);
+		vertex_size = sizeof(Vertex);
+		if (keep_vertex_data) vertex_data.assign(reinterpret_cast< char const * >(data.data()), reinterpret_cast< char const * >(data.data() + data.size()));
+
 		//store attrib locations:
 		Position = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Position));
 		Normal = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Normal));
@@ -100,6 +117,11 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 
 		total = GLuint(data.size()); //store total for later checks on index
 
+		positions.reserve(data.size());
+		for (auto const &v : data) positions.emplace_back(v.Position);
+		vertex_size = sizeof(Vertex);
+		if (keep_vertex_data) vertex_data.assign(reinterpret_cast< char const * >(data.data()), reinterpret_cast< char const * >(data.data() + data.size()));
+
 		//store attrib locations:
 		Position = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Position));
 		Normal = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Normal));
@@ -123,6 +145,7 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 		std::vector< IndexEntry > index;
 		read_chunk(file, "idx0", &index);
 
+		std::vector< Mesh * > indexed; //(the mesh made for each index entry, for the level-of-detail chunk below)
 		for (auto const &entry : index) {
 			if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
 				throw std::runtime_error("index entry has out-of-range name begin/end");
@@ -134,10 +157,45 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 			Mesh mesh;
 			mesh.start = entry.vertex_begin;
 			mesh.count = entry.vertex_end - entry.vertex_begin;
-			bool inserted = meshes.insert(std::make_pair(name, mesh)).second;
-			if (!inserted) {
+			if (mesh.count) {
+				mesh.min = mesh.max = positions[mesh.start];
+				for (GLuint i = mesh.start + 1; i < mesh.start + mesh.count; ++i) {
+					mesh.min = glm::min(mesh.min, positions[i]);
+					mesh.max = glm::max(mesh.max, positions[i]);
+				}
+			}
+			auto inserted = meshes.insert(std::make_pair(name, mesh));
+			if (!inserted.second) {
 				std::cerr << "WARNING: mesh name '" + name + "' in filename '" + filename + "' collides with existing mesh." << std::endl;
 			}
+			indexed.emplace_back(&inserted.first->second);
+		}
+
+		//(optional) levels of detail, as added by build_lods:
+		if (file.peek() != EOF) {
+			struct LodEntry {
+				uint32_t mesh; //index entry of the full-detail mesh
+				uint32_t vertex_begin, vertex_end;
+				float max_size;
+			};
+			static_assert(sizeof(LodEntry) == 16, "LOD entry should be packed");
+
+			std::vector< LodEntry > lods;
+			read_chunk(file, "lod0", &lods);
+
+			for (auto const &entry : lods) {
+				if (entry.mesh >= indexed.size()) {
+					throw std::runtime_error("level-of-detail entry has out-of-range mesh index");
+				}
+				if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= total)) {
+					throw std::runtime_error("level-of-detail entry has out-of-range vertex start/count");
+				}
+				Mesh::Lod lod;
+				lod.start = entry.vertex_begin;
+				lod.count = entry.vertex_end - entry.vertex_begin;
+				lod.max_size = entry.max_size;
+				indexed[entry.mesh]->lods.emplace_back(lod);
+			}
 		}
 	}
 
@@ -156,6 +214,97 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 	*/
 }
 
+MeshBuffer::MeshBuffer(MeshBuffer const &source, std::vector< Bake > const &bakes, bool keep_vertex_data) {
+	if (source.Position.size != 3 || source.Position.type != GL_FLOAT) {
+		throw std::runtime_error("Can only bake meshes with three-float positions.");
+	}
+	if (source.Normal.size != 0 && (source.Normal.size != 3 || source.Normal.type != GL_FLOAT)) {
+		throw std::runtime_error("Can only bake meshes with three-float normals.");
+	}
+
+	Position = source.Position;
+	Normal = source.Normal;
+	Color = source.Color;
+	TexCoord = source.TexCoord;
+	vertex_size = source.vertex_size;
+
+	GLuint total = GLuint(source.positions.size());
+
+	//(sources without a CPU-side copy are read back from their vertex buffer)
+	glBindBuffer(GL_ARRAY_BUFFER, source.vbo);
+	for (auto const &bake : bakes) {
+		Mesh mesh;
+		mesh.start = GLuint(positions.size());
+		for (auto const &part : bake.parts) {
+			if (!(part.start <= total && part.count <= total - part.start)) {
+				throw std::runtime_error("Baked part of '" + bake.name + "' has out-of-range vertex start/count.");
+			}
+			glm::mat3 normal_transform = glm::inverse(glm::transpose(glm::mat3(part.transform)));
+			//mirroring transforms flip triangles, so swap two corners of each to keep them front-facing:
+			bool flip = glm::determinant(glm::mat3(part.transform)) < 0.0f;
+
+			size_t first = positions.size(); //(index of the part's first vertex in this buffer)
+			size_t begin = vertex_data.size();
+			if (!source.vertex_data.empty()) {
+				vertex_data.insert(vertex_data.end(),
+					source.vertex_data.begin() + size_t(part.start) * vertex_size,
+					source.vertex_data.begin() + size_t(part.start + part.count) * vertex_size);
+			} else if (part.count) {
+				vertex_data.resize(begin + size_t(part.count) * vertex_size);
+				glGetBufferSubData(GL_ARRAY_BUFFER, GLintptr(part.start) * vertex_size, GLsizeiptr(part.count) * vertex_size, &vertex_data[begin]);
+			}
+			for (GLuint i = 0; i < part.count; ++i) {
+				char *vertex = &vertex_data[begin + size_t(i) * vertex_size];
+				glm::vec3 position;
+				std::memcpy(&position, vertex + Position.offset, sizeof(position));
+				position = glm::vec3(part.transform * glm::vec4(position, 1.0f));
+				std::memcpy(vertex + Position.offset, &position, sizeof(position));
+				if (Normal.size) {
+					glm::vec3 normal;
+					std::memcpy(&normal, vertex + Normal.offset, sizeof(normal));
+					normal = glm::normalize(normal_transform * normal);
+					std::memcpy(vertex + Normal.offset, &normal, sizeof(normal));
+				}
+				positions.emplace_back(position);
+			}
+			if (flip) {
+				std::vector< char > temp(vertex_size);
+				for (GLuint i = 0; i + 2 < part.count; i += 3) {
+					char *b = &vertex_data[begin + size_t(i + 1) * vertex_size];
+					char *c = &vertex_data[begin + size_t(i + 2) * vertex_size];
+					std::memcpy(temp.data(), b, vertex_size);
+					std::memcpy(b, c, vertex_size);
+					std::memcpy(c, temp.data(), vertex_size);
+					std::swap(positions[first + i + 1], positions[first + i + 2]);
+				}
+			}
+		}
+		mesh.count = GLuint(positions.size()) - mesh.start;
+		if (mesh.count) {
+			mesh.min = mesh.max = positions[mesh.start];
+			for (GLuint i = mesh.start + 1; i < mesh.start + mesh.count; ++i) {
+				mesh.min = glm::min(mesh.min, positions[i]);
+				mesh.max = glm::max(mesh.max, positions[i]);
+			}
+		}
+		bool inserted = meshes.insert(std::make_pair(bake.name, mesh)).second;
+		if (!inserted) {
+			std::cerr << "WARNING: baked mesh name '" + bake.name + "' collides with existing mesh." << std::endl;
+		}
+	}
+
+	//upload data:
+	glGenBuffers(1, &vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferData(GL_ARRAY_BUFFER, vertex_data.size(), vertex_data.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	if (!keep_vertex_data) {
+		vertex_data.clear();
+		vertex_data.shrink_to_fit();
+	}
+}
+
 const MeshBuffer::Mesh &MeshBuffer::lookup(std::string const &name) const {
 	auto f = meshes.find(name);
 	if (f == meshes.end()) {
@@ -165,6 +314,11 @@ const MeshBuffer::Mesh &MeshBuffer::lookup(std::string const &name) const {
 }
 
 GLuint MeshBuffer::make_vao_for_program(GLuint program) const {
+	return make_vao_for_program(program, vbo, Position, Normal, Color, TexCoord);
+}
+
+GLuint MeshBuffer::make_vao_for_program(GLuint program, GLuint vbo,
+	Attrib const &Position, Attrib const &Normal, Attrib const &Color, Attrib const &TexCoord) {
 	//create a new vertex array object:
 	GLuint vao = 0;
 	glGenVertexArrays(1, &vao);
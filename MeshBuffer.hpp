@@ -1,7 +1,12 @@
 #pragma once
 
 #include "GL.hpp"
+
+#include <glm/glm.hpp>
+
 #include <map>
+#include <vector>
+#include <string>
 
 //"MeshBuffer" holds a collection of meshes loaded from a file
 // (note that meshes in a single collection will share a vbo/vao)
@@ -31,13 +36,39 @@ struct MeshBuffer {
 
 	//construct from a file:
 	// note: will throw if file fails to read.
-	MeshBuffer(std::string const &filename);
+	// (the CPU-side copy of the vertex data, below, is only kept if 'keep_vertex_data' is set)
+	MeshBuffer(std::string const &filename, bool keep_vertex_data = false);
+
+	//construct by baking transformed copies of meshes from another buffer (e.g., to merge static objects into world-space batches):
+	// each Bake becomes a mesh called 'name' holding the vertices of all its parts, in order, with positions and normals transformed by each part's matrix.
+	// (the new buffer has the same vertex layout as 'source', so it can be drawn with the same programs)
+	// (the source's vertices come from its CPU-side copy if it kept one, and are read back from its vbo if not)
+	struct Bake {
+		struct Part {
+			GLuint start = 0, count = 0; //vertex range in 'source'
+			glm::mat4 transform = glm::mat4(1.0f);
+		};
+		std::string name;
+		std::vector< Part > parts;
+	};
+	MeshBuffer(MeshBuffer const &source, std::vector< Bake > const &bakes, bool keep_vertex_data = false);
 
 	//look up a particular mesh in the DB:
 	// note: will throw if mesh not found.
 	struct Mesh {
 		GLuint start = 0;
 		GLuint count = 0;
+		//object-space bounding box of the mesh's vertices (computed at load; used for culling):
+		glm::vec3 min = glm::vec3(0.0f);
+		glm::vec3 max = glm::vec3(0.0f);
+		//(optional) coarser versions of the mesh, finest first, from the file's "lod0" chunk (see build_lods):
+		// each is meant to be drawn once the mesh covers less than 'max_size' of the view's height.
+		struct Lod {
+			GLuint start = 0;
+			GLuint count = 0;
+			float max_size = 0.0f;
+		};
+		std::vector< Lod > lods;
 	};
 	const Mesh &lookup(std::string const &name) const;
 	
@@ -45,6 +76,17 @@ struct MeshBuffer {
 	//  will throw if program defines attributes not contained in this buffer
 	//  and warn if this buffer contains attributes not active in the program
 	GLuint make_vao_for_program(GLuint program) const;
+	//(the same, for any vertex buffer laid out as described by the given attribs, e.g. the one LevelStreamer streams into)
+	static GLuint make_vao_for_program(GLuint program, GLuint vbo,
+		Attrib const &Position, Attrib const &Normal, Attrib const &Color, Attrib const &TexCoord);
+
+	//CPU-side copy of vertex positions (meshes are triangle lists, so mesh.start..mesh.start+mesh.count are its triangles' corners):
+	// (kept for building ray / collision structures like TriangleBVH)
+	std::vector< glm::vec3 > positions;
+
+	//CPU-side copy of the interleaved vertex data, as uploaded to vbo (empty unless constructed with 'keep_vertex_data'):
+	std::vector< char > vertex_data;
+	GLsizei vertex_size = 0; //bytes per vertex
 
 	//internals:
 	std::map< std::string, Mesh > meshes;
@@ -0,0 +1,443 @@
+#include "OcclusionBuffer.hpp"
+#include "WorkerPool.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCCLUSION_USE_SSE 1
+#include <emmintrin.h>
+#endif
+
+//occluders are clustered in groups of at most this many triangles:
+static constexpr uint32_t ClusterSize = 32;
+
+//render() draws this many of the nearest clusters before checking the others against them:
+static constexpr uint32_t NearestClusters = 8;
+
+//render() projects occluders in ranges of this many clusters, and rasterizes in bands of this many tile rows:
+static constexpr uint32_t ProjectGrain = 16;
+static constexpr uint32_t RasterGrain = 4;
+
+OcclusionBuffer::OcclusionBuffer(uint32_t width_, uint32_t height_) {
+	tiles_x = std::max(1U, (width_ + TileWidth - 1) / TileWidth);
+	tiles_y = std::max(1U, (height_ + TileHeight - 1) / TileHeight);
+	width = tiles_x * TileWidth;
+	height = tiles_y * TileHeight;
+	tiles.resize(tiles_x * tiles_y);
+}
+
+void OcclusionBuffer::add_occluders(glm::vec3 const *positions, uint32_t count, glm::mat4 const &to_world) {
+	for (uint32_t i = 0; i + 2 < count; i += 3) {
+		glm::vec3 a = glm::vec3(to_world * glm::vec4(positions[i+0], 1.0f));
+		glm::vec3 b = glm::vec3(to_world * glm::vec4(positions[i+1], 1.0f));
+		glm::vec3 c = glm::vec3(to_world * glm::vec4(positions[i+2], 1.0f));
+		glm::vec3 n = glm::cross(b - a, c - a);
+		if (!(glm::dot(n, n) > 0.0f)) continue;
+		occluders.emplace_back(a);
+		occluders.emplace_back(b);
+		occluders.emplace_back(c);
+	}
+	clusters.clear(); //(rebuilt by the next render())
+}
+
+void OcclusionBuffer::build_clusters() {
+	//split the triangles at the median centroid along the longest axis until groups are small enough:
+	uint32_t triangles = uint32_t(occluders.size() / 3);
+	std::vector< uint32_t > order(triangles);
+	std::vector< glm::vec3 > centroids(triangles);
+	for (uint32_t t = 0; t < triangles; ++t) {
+		order[t] = t;
+		centroids[t] = (occluders[3*t+0] + occluders[3*t+1] + occluders[3*t+2]) / 3.0f;
+	}
+
+	clusters.clear();
+	std::vector< std::pair< uint32_t, uint32_t > > todo;
+	if (triangles) todo.emplace_back(0, triangles);
+	while (!todo.empty()) {
+		uint32_t begin = todo.back().first;
+		uint32_t end = todo.back().second;
+		todo.pop_back();
+
+		glm::vec3 min = centroids[order[begin]];
+		glm::vec3 max = min;
+		for (uint32_t i = begin; i < end; ++i) {
+			min = glm::min(min, centroids[order[i]]);
+			max = glm::max(max, centroids[order[i]]);
+		}
+		if (end - begin > ClusterSize) {
+			glm::vec3 size = max - min;
+			uint32_t axis = (size.x >= size.y && size.x >= size.z ? 0 : (size.y >= size.z ? 1 : 2));
+			uint32_t mid = begin + (end - begin) / 2;
+			std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end, [&](uint32_t a, uint32_t b) {
+				return centroids[a][axis] < centroids[b][axis];
+			});
+			todo.emplace_back(begin, mid);
+			todo.emplace_back(mid, end);
+			continue;
+		}
+
+		Cluster cluster;
+		cluster.begin = begin;
+		cluster.end = end;
+		cluster.min = cluster.max = occluders[3 * order[begin]];
+		for (uint32_t i = begin; i < end; ++i) {
+			for (uint32_t v = 0; v < 3; ++v) {
+				cluster.min = glm::min(cluster.min, occluders[3 * order[i] + v]);
+				cluster.max = glm::max(cluster.max, occluders[3 * order[i] + v]);
+			}
+		}
+		clusters.emplace_back(cluster);
+	}
+
+	//store triangles in cluster order:
+	std::vector< glm::vec3 > sorted;
+	sorted.reserve(occluders.size());
+	for (uint32_t t : order) {
+		sorted.emplace_back(occluders[3*t+0]);
+		sorted.emplace_back(occluders[3*t+1]);
+		sorted.emplace_back(occluders[3*t+2]);
+	}
+	occluders = std::move(sorted);
+}
+
+void OcclusionBuffer::render(glm::mat4 const &world_to_clip_) {
+	world_to_clip = world_to_clip_;
+	tiles.assign(tiles_x * tiles_y, Tile());
+	rendered = true;
+
+	if (clusters.empty() && !occluders.empty()) build_clusters();
+
+	//find clusters in view (as in Scene::draw, a box is out if it is entirely behind one of the view volume's planes):
+	glm::vec4 planes[5];
+	glm::vec4 w = glm::vec4(world_to_clip[0][3], world_to_clip[1][3], world_to_clip[2][3], world_to_clip[3][3]);
+	for (uint32_t r = 0; r < 3; ++r) {
+		glm::vec4 row = glm::vec4(world_to_clip[0][r], world_to_clip[1][r], world_to_clip[2][r], world_to_clip[3][r]);
+		planes[r] = w + row;
+		if (r < 2) planes[3 + r] = w - row; //(no far plane; occluders past it don't hide anything anyway)
+	}
+	view_clusters.clear();
+	for (uint32_t c = 0; c < clusters.size(); ++c) {
+		Cluster const &cluster = clusters[c];
+		glm::vec3 center = 0.5f * (cluster.max + cluster.min);
+		glm::vec3 extent = 0.5f * (cluster.max - cluster.min);
+		bool outside = false;
+		for (auto const &plane : planes) {
+			float d = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+			float r = std::abs(plane.x) * extent.x + std::abs(plane.y) * extent.y + std::abs(plane.z) * extent.z;
+			if (d + r < 0.0f) {
+				outside = true;
+				break;
+			}
+		}
+		if (outside) continue;
+		ViewCluster view;
+		view.cluster = c;
+		view.depth = w.x * center.x + w.y * center.y + w.z * center.z + w.w;
+		view_clusters.emplace_back(view);
+	}
+	//nearest first, so nearer occluders fill tiles before further ones get to them:
+	std::sort(view_clusters.begin(), view_clusters.end(), [](ViewCluster const &a, ViewCluster const &b) {
+		return a.depth < b.depth;
+	});
+
+	//draw the nearest few clusters, then skip any of the rest that are already hidden behind them:
+	// (in a maze, most of what is in the view volume is behind the first few walls)
+	uint32_t nearest = std::min(uint32_t(view_clusters.size()), NearestClusters);
+	draw_clusters(0, nearest);
+	view_clusters.erase(std::remove_if(view_clusters.begin() + nearest, view_clusters.end(), [this](ViewCluster const &view) {
+		Cluster const &cluster = clusters[view.cluster];
+		return !box_visible(0.5f * (cluster.max + cluster.min), 0.5f * (cluster.max - cluster.min));
+	}), view_clusters.end());
+	draw_clusters(nearest, uint32_t(view_clusters.size()));
+}
+
+void OcclusionBuffer::draw_clusters(uint32_t begin, uint32_t end) {
+	uint32_t slots = 0;
+	for (uint32_t v = begin; v < end; ++v) {
+		view_clusters[v].first = slots;
+		slots += 2 * (clusters[view_clusters[v].cluster].end - clusters[view_clusters[v].cluster].begin);
+	}
+	screen_triangles.resize(slots);
+
+	WorkerPool &pool = WorkerPool::shared();
+	pool.parallel_for(end - begin, ProjectGrain, [this, begin](uint32_t b, uint32_t e) {
+		project(begin + b, begin + e);
+	});
+	//(many occluders end up off screen, so drop the empty entries before every band has to skip over them)
+	screen_triangles.erase(std::remove_if(screen_triangles.begin(), screen_triangles.end(), [](ScreenTriangle const &tri) {
+		return tri.min_tile_x > tri.max_tile_x;
+	}), screen_triangles.end());
+	//(each band of tile rows only writes its own tiles, so bands don't need to coordinate)
+	pool.parallel_for(tiles_y, RasterGrain, [this](uint32_t b, uint32_t e) {
+		rasterize(b, e);
+	});
+}
+
+//set up a clip-space triangle (with w > 0 at every vertex) for rasterizing, or mark it empty if it covers no pixels:
+static void setup_triangle(glm::vec4 const &p0, glm::vec4 const &p1, glm::vec4 const &p2, uint32_t width, uint32_t height, OcclusionBuffer::ScreenTriangle &out) {
+	out.min_tile_x = out.min_tile_y = 0;
+	out.max_tile_x = out.max_tile_y = -1;
+
+	//pixel coordinates and depth:
+	//(done in double, so huge triangles that reach past the near corners of the view don't lose pixel-level precision)
+	glm::vec4 const *p[3] = { &p0, &p1, &p2 };
+	double x[3], y[3], z[3];
+	for (uint32_t i = 0; i < 3; ++i) {
+		double inv_w = 1.0 / double(p[i]->w);
+		x[i] = (double(p[i]->x) * inv_w * 0.5 + 0.5) * double(width);
+		y[i] = (double(p[i]->y) * inv_w * 0.5 + 0.5) * double(height);
+		z[i] = double(p[i]->z) * inv_w;
+	}
+
+	double area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+	if (!(std::abs(area) > 1e-12)) return; //(also catches NaNs)
+	//(occluders hide things from both sides, so wind everything counter-clockwise rather than culling back faces)
+	if (area < 0.0) {
+		std::swap(x[1], x[2]);
+		std::swap(y[1], y[2]);
+		std::swap(z[1], z[2]);
+		area = -area;
+	}
+
+	double min_x = std::min(x[0], std::min(x[1], x[2]));
+	double max_x = std::max(x[0], std::max(x[1], x[2]));
+	double min_y = std::min(y[0], std::min(y[1], y[2]));
+	double max_y = std::max(y[0], std::max(y[1], y[2]));
+	if (max_x < 0.0 || max_y < 0.0 || min_x > double(width) || min_y > double(height)) return;
+
+	//inside is to the left of each (counter-clockwise) edge:
+	for (uint32_t i = 0; i < 3; ++i) {
+		uint32_t j = (i + 1) % 3;
+		double A = -(y[j] - y[i]);
+		double B = x[j] - x[i];
+		out.edges[i][0] = A;
+		out.edges[i][1] = B;
+		out.edges[i][2] = -(A * x[i] + B * y[i]);
+	}
+
+	out.depth[0] = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) / area;
+	out.depth[1] = ((x[1] - x[0]) * (z[2] - z[0]) - (x[2] - x[0]) * (z[1] - z[0])) / area;
+	out.depth[2] = z[0] - out.depth[0] * x[0] - out.depth[1] * y[0];
+	out.min_depth = float(std::min(z[0], std::min(z[1], z[2])));
+	out.max_depth = float(std::max(z[0], std::max(z[1], z[2])));
+
+	int32_t tiles_x = int32_t(width / OcclusionBuffer::TileWidth);
+	int32_t tiles_y = int32_t(height / OcclusionBuffer::TileHeight);
+	out.min_tile_x = std::max(0, int32_t(std::floor(min_x / OcclusionBuffer::TileWidth)));
+	out.min_tile_y = std::max(0, int32_t(std::floor(min_y / OcclusionBuffer::TileHeight)));
+	out.max_tile_x = std::min(tiles_x - 1, int32_t(std::floor(max_x / OcclusionBuffer::TileWidth)));
+	out.max_tile_y = std::min(tiles_y - 1, int32_t(std::floor(max_y / OcclusionBuffer::TileHeight)));
+}
+
+void OcclusionBuffer::project(uint32_t begin, uint32_t end) {
+	for (uint32_t v = begin; v < end; ++v) {
+		Cluster const &cluster = clusters[view_clusters[v].cluster];
+		for (uint32_t t = cluster.begin; t < cluster.end; ++t) {
+			ScreenTriangle *out = &screen_triangles[view_clusters[v].first + 2 * (t - cluster.begin)];
+			out[0].min_tile_x = out[1].min_tile_x = 0;
+			out[0].max_tile_x = out[1].max_tile_x = -1;
+
+			glm::vec4 clip[3];
+			for (uint32_t i = 0; i < 3; ++i) {
+				clip[i] = world_to_clip * glm::vec4(occluders[3 * t + i], 1.0f);
+			}
+
+			//skip triangles entirely outside one of the side or near planes of the view volume:
+			bool beyond[5] = { true, true, true, true, true };
+			for (uint32_t i = 0; i < 3; ++i) {
+				beyond[0] = beyond[0] && (clip[i].x < -clip[i].w);
+				beyond[1] = beyond[1] && (clip[i].x > clip[i].w);
+				beyond[2] = beyond[2] && (clip[i].y < -clip[i].w);
+				beyond[3] = beyond[3] && (clip[i].y > clip[i].w);
+				beyond[4] = beyond[4] && (clip[i].z < -clip[i].w);
+			}
+			if (beyond[0] || beyond[1] || beyond[2] || beyond[3] || beyond[4]) continue;
+
+			//clip to the near plane (z >= -w), which leaves a triangle or a quad:
+			glm::vec4 poly[4];
+			uint32_t corners = 0;
+			for (uint32_t i = 0; i < 3; ++i) {
+				glm::vec4 const &a = clip[i];
+				glm::vec4 const &b = clip[(i + 1) % 3];
+				float da = a.z + a.w;
+				float db = b.z + b.w;
+				if (da >= 0.0f) poly[corners++] = a;
+				if ((da >= 0.0f) != (db >= 0.0f)) poly[corners++] = a + (b - a) * (da / (da - db));
+			}
+			if (corners < 3) continue;
+			bool behind = false;
+			for (uint32_t i = 0; i < corners; ++i) {
+				if (!(poly[i].w > 0.0f)) behind = true;
+			}
+			if (behind) continue;
+
+			setup_triangle(poly[0], poly[1], poly[2], width, height, out[0]);
+			if (corners == 4) setup_triangle(poly[0], poly[2], poly[3], width, height, out[1]);
+		}
+	}
+}
+
+//which pixel centers of the tile with first pixel center (x0,y0) are inside the triangle:
+static uint32_t coverage_mask(OcclusionBuffer::ScreenTriangle const &tri, double x0, double y0) {
+	uint32_t mask = 0;
+#ifdef OCCLUSION_USE_SSE
+	//a tile row is two groups of four pixels:
+	__m128 offsets = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+	__m128 lo_x[3], hi_x[3];
+	float B[3], base[3];
+	for (uint32_t e = 0; e < 3; ++e) {
+		float A = float(tri.edges[e][0]);
+		B[e] = float(tri.edges[e][1]);
+		base[e] = float(tri.edges[e][0] * x0 + tri.edges[e][1] * y0 + tri.edges[e][2]);
+		lo_x[e] = _mm_mul_ps(_mm_set1_ps(A), offsets);
+		hi_x[e] = _mm_add_ps(lo_x[e], _mm_set1_ps(4.0f * A));
+	}
+	for (uint32_t r = 0; r < OcclusionBuffer::TileHeight; ++r) {
+		__m128 in_lo = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		__m128 in_hi = in_lo;
+		for (uint32_t e = 0; e < 3; ++e) {
+			__m128 row = _mm_set1_ps(base[e] + B[e] * float(r));
+			in_lo = _mm_and_ps(in_lo, _mm_cmpge_ps(_mm_add_ps(row, lo_x[e]), _mm_setzero_ps()));
+			in_hi = _mm_and_ps(in_hi, _mm_cmpge_ps(_mm_add_ps(row, hi_x[e]), _mm_setzero_ps()));
+		}
+		uint32_t bits = uint32_t(_mm_movemask_ps(in_lo)) | (uint32_t(_mm_movemask_ps(in_hi)) << 4);
+		mask |= bits << (r * OcclusionBuffer::TileWidth);
+	}
+#else //OCCLUSION_USE_SSE
+	float A[3], B[3], base[3];
+	for (uint32_t e = 0; e < 3; ++e) {
+		A[e] = float(tri.edges[e][0]);
+		B[e] = float(tri.edges[e][1]);
+		base[e] = float(tri.edges[e][0] * x0 + tri.edges[e][1] * y0 + tri.edges[e][2]);
+	}
+	for (uint32_t r = 0; r < OcclusionBuffer::TileHeight; ++r) {
+		for (uint32_t c = 0; c < OcclusionBuffer::TileWidth; ++c) {
+			bool inside = true;
+			for (uint32_t e = 0; e < 3; ++e) {
+				if (!(base[e] + B[e] * float(r) + A[e] * float(c) >= 0.0f)) inside = false;
+			}
+			if (inside) mask |= 1U << (r * OcclusionBuffer::TileWidth + c);
+		}
+	}
+#endif //OCCLUSION_USE_SSE
+	return mask;
+}
+
+//fold pixels 'coverage' of a tile, covered by an occluder at 'depth' or nearer, into the tile:
+static void merge_tile(OcclusionBuffer::Tile &tile, uint32_t coverage, float depth) {
+	if (!(depth < tile.far_depth)) return; //(nothing new)
+	if (coverage == ~0U) {
+		tile.far_depth = depth;
+		if (!(tile.near_depth < depth)) tile.mask = 0; //(masked layer isn't any nearer anymore)
+		return;
+	}
+	//start the masked layer over if it is empty, or if this triangle is much nearer than it
+	// (merging would push the triangle back to the layer's depth; this is the usual masked-occlusion heuristic):
+	if (tile.mask == 0 || tile.near_depth - depth > tile.far_depth - tile.near_depth) {
+		tile.mask = coverage;
+		tile.near_depth = depth;
+	} else {
+		tile.mask |= coverage;
+		tile.near_depth = std::max(tile.near_depth, depth);
+	}
+	//a full masked layer becomes the far layer:
+	if (tile.mask == ~0U) {
+		tile.far_depth = tile.near_depth;
+		tile.mask = 0;
+	}
+}
+
+void OcclusionBuffer::rasterize(uint32_t begin, uint32_t end) {
+	double const span_x = double(TileWidth - 1);
+	double const span_y = double(TileHeight - 1);
+	for (ScreenTriangle const &tri : screen_triangles) {
+		int32_t ty0 = std::max(tri.min_tile_y, int32_t(begin));
+		int32_t ty1 = std::min(tri.max_tile_y, int32_t(end) - 1);
+		for (int32_t ty = ty0; ty <= ty1; ++ty) {
+			for (int32_t tx = tri.min_tile_x; tx <= tri.max_tile_x; ++tx) {
+				Tile &tile = tiles[ty * tiles_x + tx];
+				if (!(tri.min_depth < tile.far_depth)) continue; //(already hidden here)
+
+				//first pixel center of the tile:
+				double x0 = double(tx * TileWidth) + 0.5;
+				double y0 = double(ty * TileHeight) + 0.5;
+
+				//range of each edge function over the tile's pixel centers, to skip or fill whole tiles:
+				bool outside = false;
+				bool inside = true;
+				for (uint32_t e = 0; e < 3; ++e) {
+					double A = tri.edges[e][0], B = tri.edges[e][1];
+					double v = A * x0 + B * y0 + tri.edges[e][2];
+					double lo = v + std::min(0.0, A * span_x) + std::min(0.0, B * span_y);
+					double hi = v + std::max(0.0, A * span_x) + std::max(0.0, B * span_y);
+					if (hi < 0.0) outside = true;
+					if (lo < 0.0) inside = false;
+				}
+				if (outside) continue;
+				uint32_t coverage = (inside ? ~0U : coverage_mask(tri, x0, y0));
+				if (coverage == 0) continue;
+
+				//the covered pixels are no further than the depth plane's furthest tile corner (or the triangle's furthest vertex):
+				double d = tri.depth[0] * x0 + tri.depth[1] * y0 + tri.depth[2]
+					+ std::max(0.0, tri.depth[0] * span_x) + std::max(0.0, tri.depth[1] * span_y);
+				merge_tile(tile, coverage, std::min(float(d), tri.max_depth));
+			}
+		}
+	}
+}
+
+bool OcclusionBuffer::box_visible(glm::vec3 const &center, glm::vec3 const &extent) const {
+	if (!rendered) return true;
+
+	//project the corners (as center +/- each scaled axis):
+	glm::vec4 c = world_to_clip * glm::vec4(center, 1.0f);
+	glm::vec4 axes[3] = {
+		world_to_clip[0] * extent.x,
+		world_to_clip[1] * extent.y,
+		world_to_clip[2] * extent.z,
+	};
+	float min_x = float(width), max_x = 0.0f;
+	float min_y = float(height), max_y = 0.0f;
+	float min_depth = 1.0f;
+	for (uint32_t i = 0; i < 8; ++i) {
+		glm::vec4 p = c
+			+ ((i & 1) ? axes[0] : -axes[0])
+			+ ((i & 2) ? axes[1] : -axes[1])
+			+ ((i & 4) ? axes[2] : -axes[2]);
+		if (!(p.z >= -p.w) || !(p.w > 0.0f)) return true; //(crosses the near plane)
+		float x = (p.x / p.w * 0.5f + 0.5f) * float(width);
+		float y = (p.y / p.w * 0.5f + 0.5f) * float(height);
+		min_x = std::min(min_x, x); max_x = std::max(max_x, x);
+		min_y = std::min(min_y, y); max_y = std::max(max_y, y);
+		min_depth = std::min(min_depth, p.z / p.w);
+	}
+
+	//every pixel the box's screen rectangle touches:
+	if (!(max_x >= 0.0f && max_y >= 0.0f && min_x < float(width) && min_y < float(height))) return true; //(off screen; left to frustum culling)
+	int32_t px0 = std::max(0, int32_t(std::floor(min_x)));
+	int32_t py0 = std::max(0, int32_t(std::floor(min_y)));
+	int32_t px1 = std::min(int32_t(width) - 1, int32_t(std::floor(max_x)));
+	int32_t py1 = std::min(int32_t(height) - 1, int32_t(std::floor(max_y)));
+
+	//the box is hidden in a tile if it is behind the far layer, or if the tile's mask covers it and it is behind the masked layer:
+	for (int32_t ty = py0 / int32_t(TileHeight); ty <= py1 / int32_t(TileHeight); ++ty) {
+		int32_t ly0 = std::max(py0 - ty * int32_t(TileHeight), 0);
+		int32_t ly1 = std::min(py1 - ty * int32_t(TileHeight), int32_t(TileHeight) - 1);
+		for (int32_t tx = px0 / int32_t(TileWidth); tx <= px1 / int32_t(TileWidth); ++tx) {
+			Tile const &tile = tiles[ty * tiles_x + tx];
+			if (min_depth > tile.far_depth) continue;
+			if (!(min_depth > tile.near_depth) || tile.mask == 0) return true;
+
+			int32_t lx0 = std::max(px0 - tx * int32_t(TileWidth), 0);
+			int32_t lx1 = std::min(px1 - tx * int32_t(TileWidth), int32_t(TileWidth) - 1);
+			uint32_t row = ((2U << (lx1 - lx0)) - 1U) << lx0;
+			uint32_t rect = 0;
+			for (int32_t ly = ly0; ly <= ly1; ++ly) {
+				rect |= row << (ly * int32_t(TileWidth));
+			}
+			if (rect & ~tile.mask) return true;
+		}
+	}
+	return false;
+}
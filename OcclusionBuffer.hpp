@@ -0,0 +1,79 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstdint>
+
+//"OcclusionBuffer" is a small depth buffer, drawn on the CPU, for skipping objects hidden behind big static occluders (e.g., maze walls):
+// render() rasterizes the occluder triangles from a viewpoint (splitting the work over the shared WorkerPool),
+// then box_visible() checks whether any part of a box could be seen past them.
+//Depth is kept per 8x4-pixel tile rather than per pixel (as in "masked" software occlusion culling):
+// each tile has a far depth that holds for all of its pixels, plus a nearer depth that holds for the pixels in a coverage mask;
+// triangles are merged into the masked layer, which becomes the tile's far depth once it covers the whole tile.
+//Coverage is sampled at pixel centers (like OpenGL), and tiles never claim a depth nearer than the occluders drawn over them,
+// so a box is only reported hidden if it is behind occluders at every pixel it touches.
+//Nothing here calls OpenGL, so it can be used (and checked) without a window.
+
+struct OcclusionBuffer {
+	enum : uint32_t { TileWidth = 8, TileHeight = 4 }; //(so a tile's coverage mask fits in 32 bits)
+
+	//buffer size in pixels, rounded up to whole tiles; it doesn't need to match the window's size or shape:
+	OcclusionBuffer(uint32_t width = 256, uint32_t height = 128);
+
+	//occluders, as world-space triangles (three vertices each):
+	std::vector< glm::vec3 > occluders;
+
+	//add the triangles (three vertices each) of a mesh, transformed by 'to_world':
+	// (degenerate triangles are skipped; occluders should be solid, since both sides of every triangle hide what's behind it)
+	void add_occluders(glm::vec3 const *positions, uint32_t count, glm::mat4 const &to_world);
+
+	//clear and rasterize the occluders as seen through 'world_to_clip' (an OpenGL-style projection, depth in [-1,1]):
+	void render(glm::mat4 const &world_to_clip);
+
+	//could any part of the world-space box (center +/- extent) be seen past the occluders from the last render()'s viewpoint?
+	// (boxes that cross the near plane are always visible, as is everything before the first render())
+	bool box_visible(glm::vec3 const &center, glm::vec3 const &extent) const;
+
+	//internals:
+	uint32_t width, height; //in pixels
+	uint32_t tiles_x, tiles_y;
+	glm::mat4 world_to_clip = glm::mat4(1.0f); //from the last render()
+	bool rendered = false;
+
+	struct Tile {
+		float far_depth = 1.0f; //every pixel is covered by an occluder at this (NDC) depth or nearer; 1.0 if nothing is drawn
+		float near_depth = 1.0f; //pixels in 'mask' are also covered at this depth or nearer
+		uint32_t mask = 0; //bit (y * TileWidth + x) for pixel (x,y) of the tile
+	};
+	std::vector< Tile > tiles; //tiles_x by tiles_y, row-major, starting at the bottom left
+
+	//occluder triangles are grouped into small spatially-coherent clusters (built by the first render() after occluders change),
+	// so render() can skip whole clusters that are out of view, and draw the rest nearest-first:
+	struct Cluster {
+		glm::vec3 min, max; //bounds
+		uint32_t begin, end; //triangles [begin,end) of 'occluders' (counting triangles, not vertices)
+	};
+	std::vector< Cluster > clusters;
+	void build_clusters();
+
+	struct ViewCluster {
+		uint32_t cluster;
+		uint32_t first; //first slot in screen_triangles (two per triangle)
+		float depth; //clip-space w of the cluster's center, for sorting
+	};
+	std::vector< ViewCluster > view_clusters; //clusters in view for the current render()
+
+	//occluders after near-plane clipping and projection, up to two per occluder (clipping a triangle can leave a quad):
+	struct ScreenTriangle {
+		double edges[3][3]; //(A, B, C) for each edge; pixel (x,y) is inside if A * x + B * y + C >= 0 for all three
+		double depth[3]; //NDC depth at pixel (x,y) is depth[0] * x + depth[1] * y + depth[2]
+		float min_depth, max_depth;
+		int32_t min_tile_x, min_tile_y, max_tile_x, max_tile_y; //(inclusive; empty if min > max)
+	};
+	std::vector< ScreenTriangle > screen_triangles;
+
+	void draw_clusters(uint32_t begin, uint32_t end); //project and rasterize view_clusters [begin,end)
+	void project(uint32_t begin, uint32_t end); //triangles of view_clusters [begin,end) -> screen_triangles
+	void rasterize(uint32_t begin, uint32_t end); //all screen_triangles -> tile rows [begin,end)
+};
@@ -0,0 +1,113 @@
+#include "PVS.hpp"
+#include "read_chunk.hpp"
+
+#include <fstream>
+#include <stdexcept>
+#include <cmath>
+#include <algorithm>
+
+//fixed-size header stored in the 'pvh0' chunk:
+struct PVSHeader {
+	glm::vec2 origin;
+	float cell_size;
+	uint32_t width, height;
+};
+static_assert(sizeof(PVSHeader) == 20, "PVSHeader is packed.");
+
+PVS::PVS(std::string const &filename) {
+	std::ifstream file(filename, std::ios::binary);
+	if (!file) {
+		throw std::runtime_error("Failed to open PVS '" + filename + "'.");
+	}
+
+	std::vector< PVSHeader > header;
+	read_chunk(file, "pvh0", &header);
+	if (header.size() != 1) {
+		throw std::runtime_error("PVS '" + filename + "' should have exactly one header.");
+	}
+	origin = header[0].origin;
+	cell_size = header[0].cell_size;
+	width = header[0].width;
+	height = header[0].height;
+
+	read_chunk(file, "pvc0", &cell_rows);
+	read_chunk(file, "pvr0", &rows);
+	read_chunk(file, "pvb0", &bits);
+
+	if (!(cell_size > 0.0f)) {
+		throw std::runtime_error("PVS '" + filename + "' has a non-positive cell size.");
+	}
+	if (cell_rows.size() != size_t(width) * size_t(height)) {
+		throw std::runtime_error("PVS '" + filename + "' doesn't match its grid size.");
+	}
+	for (uint32_t row : cell_rows) {
+		if (row != -1U && row >= rows.size()) {
+			throw std::runtime_error("PVS '" + filename + "' has an out-of-range row index.");
+		}
+	}
+	for (auto const &row : rows) {
+		if (!(row.min_x <= row.max_x && row.max_x < width && row.min_y <= row.max_y && row.max_y < height)) {
+			throw std::runtime_error("PVS '" + filename + "' has a row outside the grid.");
+		}
+		size_t count = size_t(row.max_x - row.min_x + 1) * size_t(row.max_y - row.min_y + 1);
+		if (row.first > bits.size() || (count + 31) / 32 > bits.size() - row.first) {
+			throw std::runtime_error("PVS '" + filename + "' has a row past the end of its bits.");
+		}
+	}
+}
+
+void PVS::save(std::string const &filename) const {
+	std::ofstream file(filename, std::ios::binary);
+
+	PVSHeader header;
+	header.origin = origin;
+	header.cell_size = cell_size;
+	header.width = width;
+	header.height = height;
+
+	write_chunk(file, "pvh0", std::vector< PVSHeader >(1, header));
+	write_chunk(file, "pvc0", cell_rows);
+	write_chunk(file, "pvr0", rows);
+	write_chunk(file, "pvb0", bits);
+}
+
+uint32_t PVS::cell_at(glm::vec3 const &point) const {
+	float x = std::floor((point.x - origin.x) / cell_size);
+	float y = std::floor((point.y - origin.y) / cell_size);
+	if (!(x >= 0.0f && x < float(width) && y >= 0.0f && y < float(height))) return -1U;
+	uint32_t cell = uint32_t(y) * width + uint32_t(x);
+	return (cell_rows[cell] == -1U ? -1U : cell);
+}
+
+bool PVS::box_visible(uint32_t from, glm::vec3 const &min, glm::vec3 const &max) const {
+	if (from == -1U) return true;
+
+	float x0 = std::floor((min.x - origin.x) / cell_size);
+	float y0 = std::floor((min.y - origin.y) / cell_size);
+	float x1 = std::floor((max.x - origin.x) / cell_size);
+	float y1 = std::floor((max.y - origin.y) / cell_size);
+	if (!(x0 >= 0.0f && y0 >= 0.0f && x1 < float(width) && y1 < float(height))) return true;
+
+	//only the part of the box inside the row's rectangle can be visible:
+	Row const &row = rows[cell_rows[from]];
+	uint32_t min_x = std::max(uint32_t(x0), row.min_x);
+	uint32_t min_y = std::max(uint32_t(y0), row.min_y);
+	uint32_t max_x = std::min(uint32_t(x1), row.max_x);
+	uint32_t max_y = std::min(uint32_t(y1), row.max_y);
+	if (min_x > max_x || min_y > max_y) return false;
+
+	uint32_t const *row_bits = &bits[row.first];
+	uint32_t stride = row.max_x - row.min_x + 1;
+	//the box's cells in each grid row are a contiguous run of bits:
+	for (uint32_t y = min_y; y <= max_y; ++y) {
+		uint32_t begin = (y - row.min_y) * stride + (min_x - row.min_x);
+		uint32_t end = begin + (max_x - min_x) + 1;
+		for (uint32_t w = begin / 32; w <= (end - 1) / 32; ++w) {
+			uint32_t mask = ~0U;
+			if (w == begin / 32) mask &= ~0U << (begin % 32);
+			if (w == (end - 1) / 32 && end % 32 != 0) mask &= ~(~0U << (end % 32));
+			if (row_bits[w] & mask) return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+//"PVS" (potentially visible set) records, for a grid of cells laid over a level's walkmesh, which cells can possibly be seen from each cell.
+// Built offline by build_pvs (see meshes/Makefile) and stored next to the level as a '.pvs' file.
+//Scene::draw uses it to skip objects that lie entirely in cells hidden from the viewer's cell.
+
+struct PVS {
+	//grid: cell (x,y) covers [origin + (x,y) * cell_size, origin + (x+1,y+1) * cell_size) in the xy-plane; cells are numbered y * width + x.
+	glm::vec2 origin = glm::vec2(0.0f);
+	float cell_size = 1.0f;
+	uint32_t width = 0;
+	uint32_t height = 0;
+
+	//visibility: cell c sees the cells set in row cell_rows[c].
+	// (cells that share a visible set share a row; cells with no walkmesh in them have row -1U and see nothing)
+	//Visible sets are small compared to the level, so each row only stores bits for the rectangle of cells around its set:
+	// cell (x,y) in the rectangle is bit (y - min_y) * (max_x - min_x + 1) + (x - min_x), counting from bits[first].
+	struct Row {
+		uint32_t min_x = 0, min_y = 0;
+		uint32_t max_x = 0, max_y = 0; //(inclusive)
+		uint32_t first = 0;
+	};
+	static_assert(sizeof(Row) == 20, "Row is packed.");
+	std::vector< uint32_t > cell_rows;
+	std::vector< Row > rows;
+	std::vector< uint32_t > bits;
+
+	PVS() = default;
+
+	//load from a '.pvs' file:
+	//note: will throw if file fails to read.
+	PVS(std::string const &filename);
+
+	//write in the format the constructor reads:
+	void save(std::string const &filename) const;
+
+	//cell containing a point, or -1U if the point is off the grid or its cell has no visible set:
+	uint32_t cell_at(glm::vec3 const &point) const;
+
+	//can anything inside the (world-space) box be visible from cell 'from'?
+	// (boxes that leave the grid are assumed visible, as is everything if 'from' is -1U)
+	bool box_visible(uint32_t from, glm::vec3 const &min, glm::vec3 const &max) const;
+};
@@ -0,0 +1,287 @@
+#include "PathFinder.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace {
+	//z component of cross(u, v); positive if v is counterclockwise (to the left) of u when viewed from above:
+	inline float cross_z(glm::vec3 const &u, glm::vec3 const &v) {
+		return u.x * v.y - u.y * v.x;
+	}
+
+	//point on a link's portal where the straight line from 'from' to 'to' crosses it (or the end making the shorter detour, if it doesn't):
+	inline glm::vec3 portal_point(PathFinder::Link const &link, glm::vec3 const &from, glm::vec3 const &to) {
+		glm::vec3 along = link.left - link.right;
+		glm::vec3 travel = to - from;
+		//the line crosses the portal's line if 'from' and 'to' are on opposite sides of it:
+		if ((cross_z(along, from - link.right) < 0.0f) != (cross_z(along, to - link.right) < 0.0f)) {
+			float t = cross_z(from - link.right, travel) / cross_z(along, travel);
+			if (t > 0.0f && t < 1.0f) return link.right + t * along;
+		}
+		float via_right = glm::distance(from, link.right) + glm::distance(link.right, to);
+		float via_left = glm::distance(from, link.left) + glm::distance(link.left, to);
+		return (via_right <= via_left ? link.right : link.left);
+	}
+
+	inline bool same_xy(glm::vec3 const &a, glm::vec3 const &b) {
+		glm::vec2 d = glm::vec2(b.x - a.x, b.y - a.y);
+		return glm::dot(d, d) < 1e-12f;
+	}
+
+	//is 'p' (nearly) on the line through 'a' and 'b', when viewed from above?
+	inline bool on_line(glm::vec3 const &p, glm::vec3 const &a, glm::vec3 const &b) {
+		glm::vec3 ab = b - a;
+		return std::abs(cross_z(ab, p - a)) <= 1e-4f * glm::length(glm::vec2(ab.x, ab.y));
+	}
+}
+
+PathFinder::PathFinder(WalkMesh const &walk_mesh_, uint32_t cache_size_) : walk_mesh(walk_mesh_), cache_size(cache_size_) {
+	search.resize(walk_mesh.polygons.size());
+
+	links.reserve(walk_mesh.polygon_vertices.size());
+	for (auto const &polygon : walk_mesh.polygons) {
+		for (uint32_t i = polygon.begin; i < polygon.end; ++i) {
+			uint32_t next = (i + 1 < polygon.end ? i + 1 : polygon.begin);
+			glm::vec3 const &a = walk_mesh.vertices[walk_mesh.polygon_vertices[i]];
+			glm::vec3 const &b = walk_mesh.vertices[walk_mesh.polygon_vertices[next]];
+			//leaving a CCW polygon across edge [a,b], 'a' is on the right and 'b' on the left:
+			links.emplace_back(Link{walk_mesh.polygon_neighbors[i], a, b});
+		}
+	}
+
+	//label connected components by flood fill, so that unreachable goals fail without a search:
+	component.assign(walk_mesh.polygons.size(), -1U);
+	uint32_t components = 0;
+	std::vector< uint32_t > todo;
+	for (uint32_t seed = 0; seed < walk_mesh.polygons.size(); ++seed) {
+		if (component[seed] != -1U) continue;
+		component[seed] = components;
+		todo.emplace_back(seed);
+		while (!todo.empty()) {
+			uint32_t at = todo.back();
+			todo.pop_back();
+			for (uint32_t i = walk_mesh.polygons[at].begin; i < walk_mesh.polygons[at].end; ++i) {
+				uint32_t next = links[i].neighbor;
+				if (next != -1U && component[next] == -1U) {
+					component[next] = components;
+					todo.emplace_back(next);
+				}
+			}
+		}
+		++components;
+	}
+}
+
+bool PathFinder::find_path(WalkMesh::WalkPoint const &start, WalkMesh::WalkPoint const &goal, std::vector< glm::vec3 > *path_) {
+	assert(path_);
+	auto &path = *path_;
+	path.clear();
+
+	if (!find_corridor(start, goal, &corridor)) return false;
+
+	smooth_path(walk_mesh.world_point(start), walk_mesh.world_point(goal), corridor, &path);
+	return true;
+}
+
+bool PathFinder::find_corridor(WalkMesh::WalkPoint const &start, WalkMesh::WalkPoint const &goal, std::vector< uint32_t > *corridor_) {
+	assert(corridor_);
+	auto &corridor = *corridor_;
+	corridor.clear();
+
+	if (start.triangle_index >= walk_mesh.triangles.size() || goal.triangle_index >= walk_mesh.triangles.size()) return false;
+	uint32_t start_polygon = walk_mesh.triangle_polygons[start.triangle_index];
+	uint32_t goal_polygon = walk_mesh.triangle_polygons[goal.triangle_index];
+	if (component[start_polygon] != component[goal_polygon]) return false;
+
+	if (start_polygon == goal_polygon) {
+		corridor.emplace_back(start_polygon);
+		return true;
+	}
+
+	//any cached corridor through the start polygon to the goal polygon can be re-used from that point on:
+	// (the remainder of a shortest corridor is itself a shortest corridor)
+	for (auto &entry : cache) {
+		if (entry.goal_polygon != goal_polygon) continue;
+		auto f = std::find(entry.corridor.begin(), entry.corridor.end(), start_polygon);
+		if (f == entry.corridor.end()) continue;
+		corridor.assign(f, entry.corridor.end());
+		entry.last_used = ++cache_clock;
+		++cache_hits;
+		return true;
+	}
+	++cache_misses;
+
+	//A* over polygons:
+	// a polygon is entered where the straight line from the current entry point toward the goal crosses the edge to it (or at the edge's nearer end);
+	// cost is distance traveled between entry points and the heuristic is straight-line distance to the goal.
+	//(each search uses two stamps: 'search_stamp' for polygons with a tentative cost, 'search_stamp + 1' once expanded)
+	search_stamp += 2;
+	if (search_stamp < 2) { //stamp wrapped around, so old stamps might look current
+		for (auto &state : search) state.visited = 0;
+		search_stamp = 2;
+	}
+	uint32_t const expanded_stamp = search_stamp + 1;
+
+	glm::vec3 goal_point = walk_mesh.world_point(goal);
+
+	SearchState &first = search[start_polygon];
+	first.visited = search_stamp;
+	first.cost = 0.0f;
+	first.came_from = -1U;
+	first.entry_point = walk_mesh.world_point(start);
+
+	typedef std::pair< float, uint32_t > OpenEntry;
+	auto later = [](OpenEntry const &a, OpenEntry const &b) { return a.first > b.first; }; //heap order that puts the lowest estimate on top
+	open.clear();
+	open.emplace_back(glm::distance(first.entry_point, goal_point), start_polygon);
+
+	bool found = false;
+	while (!open.empty()) {
+		std::pop_heap(open.begin(), open.end(), later);
+		OpenEntry top = open.back();
+		open.pop_back();
+
+		uint32_t at = top.second;
+		if (at == goal_polygon) {
+			found = true;
+			break;
+		}
+		//skip entries that were superseded by a cheaper route to the same polygon:
+		SearchState &current = search[at];
+		if (current.visited == expanded_stamp) continue;
+		current.visited = expanded_stamp;
+
+		WalkMesh::Polygon const &polygon = walk_mesh.polygons[at];
+		for (uint32_t i = polygon.begin; i < polygon.end; ++i) {
+			uint32_t next = links[i].neighbor;
+			if (next == -1U) continue;
+			SearchState &state = search[next];
+			if (state.visited == expanded_stamp) continue;
+
+			glm::vec3 entry = portal_point(links[i], current.entry_point, goal_point);
+			float next_cost = current.cost + glm::distance(current.entry_point, entry);
+			if (state.visited == search_stamp && next_cost >= state.cost) continue;
+
+			state.visited = search_stamp;
+			state.cost = next_cost;
+			state.came_from = at;
+			state.entry_point = entry;
+
+			open.emplace_back(next_cost + glm::distance(entry, goal_point), next);
+			std::push_heap(open.begin(), open.end(), later);
+		}
+	}
+
+	if (!found) return false;
+
+	for (uint32_t at = goal_polygon; at != -1U; at = search[at].came_from) {
+		corridor.emplace_back(at);
+	}
+	std::reverse(corridor.begin(), corridor.end());
+
+	//remember the corridor, replacing the least recently used entry if the cache is full:
+	if (cache_size == 0) return true;
+	CacheEntry *entry = nullptr;
+	if (cache.size() < cache_size) {
+		cache.emplace_back();
+		entry = &cache.back();
+	} else {
+		entry = &*std::min_element(cache.begin(), cache.end(), [](CacheEntry const &a, CacheEntry const &b) {
+			return a.last_used < b.last_used;
+		});
+	}
+	entry->goal_polygon = goal_polygon;
+	entry->corridor = corridor;
+	entry->last_used = ++cache_clock;
+
+	return true;
+}
+
+void PathFinder::smooth_path(glm::vec3 const &start, glm::vec3 const &goal, std::vector< uint32_t > const &corridor, std::vector< glm::vec3 > *path_) const {
+	assert(path_);
+	auto &path = *path_;
+	path.clear();
+
+	//portals are the edges shared by consecutive corridor polygons, bracketed by the (zero-width) start and goal:
+	portal_left.clear();
+	portal_right.clear();
+	portal_left.emplace_back(start);
+	portal_right.emplace_back(start);
+	for (uint32_t i = 0; i + 1 < corridor.size(); ++i) {
+		WalkMesh::Polygon const &polygon = walk_mesh.polygons[corridor[i]];
+		uint32_t k = polygon.begin;
+		while (k < polygon.end && links[k].neighbor != corridor[i+1]) ++k;
+		assert(k < polygon.end && "corridor polygons should be adjacent");
+		float length = glm::distance(links[k].left, links[k].right);
+		float shrink = (length > 0.0f ? std::min(clearance / length, 0.5f) : 0.0f);
+		glm::vec3 right = glm::mix(links[k].right, links[k].left, shrink);
+		glm::vec3 left = glm::mix(links[k].left, links[k].right, shrink);
+
+		//a start (or goal) lying on the line through its first (or last) portal -- e.g., after sliding along a wall in line with it --
+		// would leave the funnel with no width to work with, so narrow such portals to the point nearest the start (or goal):
+		for (glm::vec3 const *end : {(i == 0 ? &start : nullptr), (i + 2 == corridor.size() ? &goal : nullptr)}) {
+			if (!end || !on_line(*end, right, left)) continue;
+			glm::vec2 along = glm::vec2(left.x - right.x, left.y - right.y);
+			float length2 = glm::dot(along, along);
+			float t = (length2 > 0.0f ? glm::dot(glm::vec2(end->x - right.x, end->y - right.y), along) / length2 : 0.0f);
+			right = left = glm::mix(right, left, glm::clamp(t, 0.0f, 1.0f));
+		}
+
+		portal_right.emplace_back(right);
+		portal_left.emplace_back(left);
+	}
+	portal_left.emplace_back(goal);
+	portal_right.emplace_back(goal);
+
+	//"simple stupid funnel algorithm" (Mononen):
+	// the funnel is the wedge from 'apex' between 'left' and 'right'; each portal narrows it,
+	// and when one side would cross the other, that side's point is a corner of the path and becomes the new apex.
+	glm::vec3 apex = start, left = start, right = start;
+	uint32_t apex_index = 0, left_index = 0, right_index = 0;
+
+	auto add_corner = [&path](glm::vec3 const &corner) {
+		if (path.empty() || !same_xy(path.back(), corner)) path.emplace_back(corner);
+	};
+
+	for (uint32_t i = 1; i < portal_left.size(); ++i) {
+		glm::vec3 const &next_left = portal_left[i];
+		glm::vec3 const &next_right = portal_right[i];
+
+		//narrow the right side of the funnel:
+		if (cross_z(right - apex, next_right - apex) >= 0.0f) {
+			if (same_xy(apex, right) || cross_z(next_right - apex, left - apex) > 0.0f) {
+				right = next_right;
+				right_index = i;
+			} else {
+				//right crossed over left, so left is a corner:
+				apex = left;
+				apex_index = left_index;
+				add_corner(apex);
+				right = left = apex;
+				right_index = left_index = apex_index;
+				i = apex_index;
+				continue;
+			}
+		}
+
+		//narrow the left side of the funnel:
+		if (cross_z(next_left - apex, left - apex) >= 0.0f) {
+			if (same_xy(apex, left) || cross_z(right - apex, next_left - apex) > 0.0f) {
+				left = next_left;
+				left_index = i;
+			} else {
+				//left crossed over right, so right is a corner:
+				apex = right;
+				apex_index = right_index;
+				add_corner(apex);
+				left = right = apex;
+				left_index = right_index = apex_index;
+				i = apex_index;
+				continue;
+			}
+		}
+	}
+
+	if (path.empty() || path.back() != goal) path.emplace_back(goal);
+}
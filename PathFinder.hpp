@@ -0,0 +1,78 @@
+#pragma once
+
+#include "WalkMesh.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstdint>
+#include <utility>
+
+//"PathFinder" plans routes across a WalkMesh:
+// - A* over the adjacency graph of the walkmesh's convex polygons finds a corridor (sequence of polygons) from start to goal,
+// - then the funnel algorithm ("string pulling") turns that corridor into a short list of waypoints.
+//Corridors are cached by goal polygon, so agents heading toward the same place (e.g., all chasing the player) share searches.
+
+struct PathFinder {
+	PathFinder(WalkMesh const &walk_mesh, uint32_t cache_size = 32);
+
+	WalkMesh const &walk_mesh;
+
+	//portals are narrowed by this much at each end, so paths keep away from walls:
+	// (paths that touch a boundary vertex exactly tend to get agents stuck on corners when walking)
+	float clearance = 0.15f;
+
+	//find a path from 'start' to 'goal':
+	// on success, 'path' holds the waypoints after 'start', ending with the world position of 'goal'.
+	// returns false (and leaves 'path' empty) if 'goal' is not reachable from 'start'.
+	bool find_path(WalkMesh::WalkPoint const &start, WalkMesh::WalkPoint const &goal, std::vector< glm::vec3 > *path);
+
+	//find a corridor of polygons (see WalkMesh::polygons) from 'start' to 'goal' (inclusive) using the cache or A*:
+	// returns false (and leaves 'corridor' empty) if 'goal' is not reachable from 'start'.
+	bool find_corridor(WalkMesh::WalkPoint const &start, WalkMesh::WalkPoint const &goal, std::vector< uint32_t > *corridor);
+
+	//string-pull a path through 'corridor' from 'start' to 'goal':
+	// (the funnel is computed in the xy plane, since the walkmesh is a floor with z up)
+	void smooth_path(glm::vec3 const &start, glm::vec3 const &goal, std::vector< uint32_t > const &corridor, std::vector< glm::vec3 > *path) const;
+
+	//search graph edges, parallel to walk_mesh.polygon_vertices (so polygon p's links are [polygons[p].begin, polygons[p].end)):
+	struct Link {
+		uint32_t neighbor; //same as walk_mesh.polygon_neighbors
+		glm::vec3 right, left; //ends of the edge to the neighbor, as seen when leaving this polygon
+	};
+	std::vector< Link > links;
+
+	//connected component of each polygon; polygons in different components can't reach each other:
+	std::vector< uint32_t > component;
+
+	//corridors from recent searches; a corridor that passes through a query's start polygon
+	// and ends at its goal polygon answers the query without a search:
+	struct CacheEntry {
+		uint32_t goal_polygon = -1U;
+		std::vector< uint32_t > corridor;
+		uint64_t last_used = 0;
+	};
+	std::vector< CacheEntry > cache;
+	uint32_t cache_size; //maximum number of entries in 'cache'
+	uint64_t cache_clock = 0;
+
+	//counters, for tuning:
+	uint32_t cache_hits = 0;
+	uint32_t cache_misses = 0;
+
+	//per-polygon search state, reused between searches:
+	// (entries are only valid if their 'visited' stamp is from the current search, so nothing needs clearing between searches)
+	struct SearchState {
+		uint32_t visited = 0;
+		float cost = 0.0f; //distance traveled to reach entry_point
+		uint32_t came_from = -1U;
+		glm::vec3 entry_point = glm::vec3(0.0f); //where the search entered the polygon
+	};
+	std::vector< SearchState > search;
+	uint32_t search_stamp = 0;
+	std::vector< std::pair< float, uint32_t > > open; //heap of (estimated total cost, polygon)
+
+	//scratch space for find_path() and smooth_path():
+	std::vector< uint32_t > corridor;
+	mutable std::vector< glm::vec3 > portal_left, portal_right;
+};
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <cstdint>
+#include <cassert>
+
+//"Pool" holds objects of one type in fixed-size chunks:
+// - objects never move, so pointers to them stay valid until they are destroyed,
+// - create() and destroy() are O(1) and reuse freed slots, so (once the pool has grown to its working size) they don't call the general-purpose allocator,
+// - the live objects are listed in a dense array, so iterating over them is a linear scan.
+//Iteration order is creation order until something is destroyed; destroying moves the last-listed object into the gap.
+
+template< typename T, uint32_t ChunkSize = 256 >
+struct Pool {
+	Pool() = default;
+	Pool(Pool const &) = delete;
+	Pool &operator=(Pool const &) = delete;
+	~Pool() {
+		clear();
+	}
+
+	//construct a new object in a free slot:
+	template< typename... Args >
+	T *create(Args&&... args) {
+		if (!free_slots) grow();
+		Slot *slot = free_slots;
+		free_slots = slot->next_free;
+		T *t = new (&slot->storage) T(std::forward< Args >(args)...); //(if this throws, the slot is lost until the pool is freed; harmless)
+		slot->live_index = uint32_t(live.size());
+		live.emplace_back(t);
+		return t;
+	}
+
+	//destroy an object created by this pool and return its slot to the free list:
+	void destroy(T *t) {
+		assert(t && "It is invalid to destroy a null pointer [yes this is different than 'delete']");
+		Slot *slot = reinterpret_cast< Slot * >(t); //(storage is the first member of Slot)
+		assert(slot->live_index < live.size() && live[slot->live_index] == t && "object should belong to this pool");
+
+		//fill the gap in the live list with the last entry:
+		T *last = live.back();
+		live[slot->live_index] = last;
+		reinterpret_cast< Slot * >(last)->live_index = slot->live_index;
+		live.pop_back();
+
+		t->~T();
+		slot->live_index = -1U;
+		slot->next_free = free_slots;
+		free_slots = slot;
+	}
+
+	//destroy all objects (most recently listed first), but keep the chunks for reuse:
+	void clear() {
+		while (!live.empty()) destroy(live.back());
+	}
+
+	//iteration over live objects:
+	typedef typename std::vector< T * >::const_iterator const_iterator;
+	const_iterator begin() const { return live.begin(); }
+	const_iterator end() const { return live.end(); }
+	size_t size() const { return live.size(); }
+	bool empty() const { return live.empty(); }
+	T *operator[](size_t i) const { return live[i]; }
+
+	//internals:
+	struct Slot {
+		typename std::aligned_storage< sizeof(T), alignof(T) >::type storage;
+		uint32_t live_index = -1U; //index into 'live' while in use
+		Slot *next_free = nullptr; //next entry in the free list while not in use
+	};
+	static_assert(ChunkSize > 0, "chunks must hold at least one slot");
+
+	std::vector< std::unique_ptr< Slot[] > > chunks;
+	Slot *free_slots = nullptr;
+	std::vector< T * > live;
+
+	void grow() {
+		chunks.emplace_back(new Slot[ChunkSize]);
+		Slot *chunk = chunks.back().get();
+		//thread the new slots onto the free list in address order, so consecutive creates are adjacent in memory:
+		for (uint32_t i = ChunkSize; i > 0; --i) {
+			chunk[i-1].next_free = free_slots;
+			free_slots = &chunk[i-1];
+		}
+	}
+};
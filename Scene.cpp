@@ -1,11 +1,22 @@
 #include "Scene.hpp"
 #include "read_chunk.hpp"
+#include "WorkerPool.hpp"
+#include "PVS.hpp"
+#include "OcclusionBuffer.hpp"
 
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
 #include <iostream>
 #include <fstream>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SCENE_USE_SSE 1
+#include <emmintrin.h>
+#endif
 
 glm::mat4 Scene::Transform::make_local_to_parent() const {
 	return glm::mat4( //translate
@@ -98,6 +109,7 @@ void Scene::Transform::set_parent(Transform *new_parent, Transform *before) {
 		}
 		if (prev_sibling) prev_sibling->next_sibling = this;
 	}
+	dirty = true;
 	DEBUG_assert_valid_pointers();
 }
 
@@ -115,155 +127,919 @@ glm::mat4 Scene::Camera::make_projection() const {
 
 //---------------------------
 
-//templated helper functions to avoid having to write the same new/delete code three times:
-template< typename T, typename... Args >
-T *list_new(T * &first, Args&&... args) {
-	T *t = new T(std::forward< Args >(args)...); //"perfect forwarding"
-	if (first) {
-		t->alloc_next = first;
-		first->alloc_prev_next = &t->alloc_next;
-	}
-	t->alloc_prev_next = &first;
-	first = t;
-	return t;
+Scene::Transform *Scene::new_transform() {
+	name_index.dirty = true;
+	return transforms.create();
 }
 
-template< typename T >
-void list_delete(T * t) {
-	assert(t && "It is invalid to delete a null scene object [yes this is different than 'delete']");
-	assert(t->alloc_prev_next);
-	if (t->alloc_next) {
-		t->alloc_next->alloc_prev_next = t->alloc_prev_next;
-	}
-	*t->alloc_prev_next = t->alloc_next;
-	//PARANOIA:
-	t->alloc_next = nullptr;
-	t->alloc_prev_next = nullptr;
+void Scene::delete_transform(Scene::Transform *transform) {
+	name_index.dirty = true;
+	transforms.destroy(transform);
 }
 
-Scene::Transform *Scene::new_transform() {
-	return list_new< Scene::Transform >(first_transform);
+//world-space box (center +/- extent) containing an object's bounds as transformed by 'local_to_world':
+static void world_box(Scene::Object const &object, glm::mat4 const &local_to_world, glm::vec3 *center_, glm::vec3 *extent_) {
+	glm::vec3 local_center = 0.5f * (object.bounds_max + object.bounds_min);
+	glm::vec3 local_extent = 0.5f * (object.bounds_max - object.bounds_min);
+	*center_ = glm::vec3(local_to_world * glm::vec4(local_center, 1.0f));
+	*extent_ = glm::abs(glm::vec3(local_to_world[0])) * local_extent.x
+	         + glm::abs(glm::vec3(local_to_world[1])) * local_extent.y
+	         + glm::abs(glm::vec3(local_to_world[2])) * local_extent.z;
 }
 
-void Scene::delete_transform(Scene::Transform *transform) {
-	list_delete< Scene::Transform >(transform);
+void Scene::update_transforms() const {
+	for (Transform *root : transforms) {
+		if (root->parent) continue;
+
+		//depth-first over the subtree at 'root', following the hierarchy pointers so parents are always visited before their children:
+		Transform *t = root;
+		while (t) {
+			bool changed = t->dirty
+				|| (t->parent && t->parent->world_changed)
+				|| t->position != t->cached_position
+				|| t->rotation != t->cached_rotation
+				|| t->scale != t->cached_scale;
+			if (changed) {
+				t->cached_position = t->position;
+				t->cached_rotation = t->rotation;
+				t->cached_scale = t->scale;
+				if (t->parent) {
+					t->local_to_world = t->parent->local_to_world * t->make_local_to_parent();
+					t->world_to_local = t->make_parent_to_local() * t->parent->world_to_local;
+				} else {
+					t->local_to_world = t->make_local_to_parent();
+					t->world_to_local = t->make_parent_to_local();
+				}
+				t->unscaled = (t->scale == glm::vec3(1.0f)) && (!t->parent || t->parent->unscaled);
+				t->dirty = false;
+			}
+			t->world_changed = changed;
+
+			//advance to the next transform in the subtree:
+			if (t->last_child) {
+				t = t->last_child;
+			} else {
+				while (t != root && t->prev_sibling == nullptr) t = t->parent;
+				t = (t == root ? nullptr : t->prev_sibling);
+			}
+		}
+	}
+
+	//bring the object tree up to date with objects that were added, moved, or lost their bounds:
+	for (Object const *object : objects) {
+		if (!object->has_bounds) {
+			if (object->tree_leaf != -1U) {
+				object_tree.remove(object->tree_leaf);
+				object->tree_leaf = -1U;
+			}
+			continue;
+		}
+		if (object->tree_leaf != -1U && !object->transform->world_changed) continue;
+		AABBTree< Object const * >::Box box;
+		glm::vec3 center, extent;
+		world_box(*object, object->transform->local_to_world, &center, &extent);
+		box.min = center - extent;
+		box.max = center + extent;
+		if (object->tree_leaf == -1U) {
+			object->tree_leaf = object_tree.insert(box, object);
+		} else {
+			object_tree.move(object->tree_leaf, box);
+		}
+	}
+}
+
+std::vector< Scene::StaticBatch > Scene::batch_static_objects() {
+	update_transforms();
+
+	//mesh range an object draws in every slot, or false if the object can't be batched:
+	auto batch_range = [](Object const *object, GLuint *start, GLuint *count) {
+		bool found = false;
+		for (uint32_t p = 0; p < Object::ProgramTypes; ++p) {
+			Object::ProgramInfo const &info = object->programs[p];
+			if (info.program == 0) continue;
+			if (info.set_uniforms) return false;
+			if (info.lods[0].count) return false; //(baking would lose the levels of detail)
+			if (!found) {
+				*start = info.start;
+				*count = info.count;
+				found = true;
+			} else if (info.start != *start || info.count != *count) {
+				return false;
+			}
+		}
+		return found;
+	};
+	//do two objects draw the same way, apart from which mesh?
+	auto same_material = [](Object const *a, Object const *b) {
+		for (uint32_t p = 0; p < Object::ProgramTypes; ++p) {
+			Object::ProgramInfo const &x = a->programs[p];
+			Object::ProgramInfo const &y = b->programs[p];
+			if (x.program != y.program || x.vao != y.vao) return false;
+			if (x.mvp_mat4 != y.mvp_mat4 || x.mv_mat4x3 != y.mv_mat4x3 || x.itmv_mat3 != y.itmv_mat3) return false;
+			if (x.object_constants_block != y.object_constants_block) return false;
+			if (x.instanced_bool != y.instanced_bool || x.instance_base_int != y.instance_base_int || x.world_to_clip_mat4 != y.world_to_clip_mat4) return false;
+			for (uint32_t i = 0; i < Object::ProgramInfo::TextureCount; ++i) {
+				if (x.textures[i] != y.textures[i]) return false;
+			}
+		}
+		return true;
+	};
+
+	//group batchable objects by material (in creation order, so batches are baked in a predictable order):
+	std::vector< std::vector< Object * > > groups;
+	for (Object *object : objects) {
+		GLuint start, count;
+		if (!object->is_static || !batch_range(object, &start, &count)) continue;
+		auto group = std::find_if(groups.begin(), groups.end(), [&](std::vector< Object * > const &g) {
+			return same_material(g[0], object);
+		});
+		if (group == groups.end()) {
+			groups.emplace_back(1, object);
+		} else {
+			group->emplace_back(object);
+		}
+	}
+
+	std::vector< StaticBatch > batches;
+	for (auto const &group : groups) {
+		if (group.size() < 2) continue;
+
+		Transform *transform = new_transform();
+		set_name(transform, "static batch");
+		Object *batch_object = new_object(transform);
+		for (uint32_t p = 0; p < Object::ProgramTypes; ++p) {
+			batch_object->programs[p] = group[0]->programs[p];
+		}
+		batch_object->is_static = true;
+		batch_object->has_bounds = true;
+
+		batches.emplace_back();
+		StaticBatch &batch = batches.back();
+		batch.object = batch_object;
+		bool first_bounds = true;
+		for (Object *object : group) {
+			StaticBatch::Part part;
+			batch_range(object, &part.start, &part.count);
+			part.local_to_world = object->transform->local_to_world;
+			batch.parts.emplace_back(part);
+
+			//batch bounds cover the world-space boxes of the group's bounds:
+			if (!object->has_bounds) {
+				batch_object->has_bounds = false;
+			} else if (batch_object->has_bounds) {
+				glm::vec3 center, extent;
+				world_box(*object, part.local_to_world, &center, &extent);
+				if (first_bounds) {
+					batch_object->bounds_min = center - extent;
+					batch_object->bounds_max = center + extent;
+					first_bounds = false;
+				} else {
+					batch_object->bounds_min = glm::min(batch_object->bounds_min, center - extent);
+					batch_object->bounds_max = glm::max(batch_object->bounds_max, center + extent);
+				}
+			}
+
+			delete_object(object);
+		}
+	}
+
+	update_transforms();
+	return batches;
 }
 
 Scene::Object *Scene::new_object(Scene::Transform *transform) {
 	assert(transform && "Scene::Object must be attached to a transform.");
-	return list_new< Scene::Object >(first_object, transform);
+	name_index.dirty = true;
+	return objects.create(transform);
 }
 
 void Scene::delete_object(Scene::Object *object) {
-	list_delete< Scene::Object >(object);
+	if (object->tree_leaf != -1U) object_tree.remove(object->tree_leaf);
+	name_index.dirty = true;
+	objects.destroy(object);
 }
 
 Scene::Lamp *Scene::new_lamp(Scene::Transform *transform) {
 	assert(transform && "Scene::Lamp must be attached to a transform.");
-	return list_new< Scene::Lamp >(first_lamp, transform);
+	name_index.dirty = true;
+	return lamps.create(transform);
 }
 
-void Scene::delete_lamp(Scene::Lamp *object) {
-	list_delete< Scene::Lamp >(object);
+void Scene::delete_lamp(Scene::Lamp *lamp) {
+	name_index.dirty = true;
+	lamps.destroy(lamp);
 }
 
 Scene::Camera *Scene::new_camera(Scene::Transform *transform) {
 	assert(transform && "Scene::Camera must be attached to a transform.");
-	return list_new< Scene::Camera >(first_camera, transform);
+	name_index.dirty = true;
+	return cameras.create(transform);
+}
+
+void Scene::delete_camera(Scene::Camera *camera) {
+	name_index.dirty = true;
+	cameras.destroy(camera);
+}
+
+//---------------------------
+
+uint32_t Scene::intern(std::string const &name_) {
+	if (name_.empty()) return 0;
+	auto f = name_ids.find(name_);
+	if (f != name_ids.end()) return f->second;
+	uint32_t id = uint32_t(name_table.size());
+	name_table.emplace_back(name_);
+	name_ids.insert(std::make_pair(name_, id));
+	name_index.dirty = true;
+	return id;
 }
 
-void Scene::delete_camera(Scene::Camera *object) {
-	list_delete< Scene::Camera >(object);
+uint32_t Scene::find_name(std::string const &name_) const {
+	if (name_.empty()) return 0;
+	auto f = name_ids.find(name_);
+	return (f == name_ids.end() ? -1U : f->second);
 }
 
-void Scene::draw(Scene::Camera const *camera, Object::ProgramType program_type) const {
+void Scene::set_name(Transform *transform, std::string const &name_) {
+	transform->name = intern(name_);
+	name_index.dirty = true;
+}
+
+//name id a thing is indexed under:
+static uint32_t name_id(Scene::Transform const *transform) { return transform->name; }
+template< typename T >
+static uint32_t name_id(T const *t) { return t->transform->name; }
+
+//list the things in 'pool' sorted by name rank (with a counting sort, which keeps pool order within each name):
+template< typename T >
+static void index_by_name(Pool< T > const &pool, std::vector< uint32_t > const &rank, std::vector< T * > *sorted_, std::vector< uint32_t > *first_) {
+	assert(sorted_);
+	auto &sorted = *sorted_;
+	assert(first_);
+	auto &first = *first_;
+
+	first.assign(rank.size() + 1, 0);
+	for (T *t : pool) {
+		++first[rank[name_id(t)] + 1];
+	}
+	for (size_t r = 1; r < first.size(); ++r) {
+		first[r] += first[r-1];
+	}
+	std::vector< uint32_t > next(first.begin(), first.end() - 1);
+	sorted.resize(pool.size());
+	for (T *t : pool) {
+		sorted[next[rank[name_id(t)]]++] = t;
+	}
+}
+
+void Scene::update_name_index() const {
+	NameIndex &index = name_index;
+	if (!index.dirty) return;
+
+	index.sorted.resize(name_table.size());
+	for (uint32_t i = 0; i < index.sorted.size(); ++i) {
+		index.sorted[i] = i;
+	}
+	std::sort(index.sorted.begin(), index.sorted.end(), [this](uint32_t a, uint32_t b) {
+		return name_table[a] < name_table[b];
+	});
+	index.rank.resize(index.sorted.size());
+	for (uint32_t r = 0; r < index.sorted.size(); ++r) {
+		index.rank[index.sorted[r]] = r;
+	}
+
+	index_by_name(transforms, index.rank, &index.transforms, &index.first_transform);
+	index_by_name(objects, index.rank, &index.objects, &index.first_object);
+	index_by_name(lamps, index.rank, &index.lamps, &index.first_lamp);
+	index_by_name(cameras, index.rank, &index.cameras, &index.first_camera);
+
+	index.dirty = false;
+}
+
+void Scene::name_ranks(std::string const &name_, uint32_t *begin, uint32_t *end) const {
+	update_name_index();
+	uint32_t id = find_name(name_);
+	if (id == -1U) {
+		*begin = *end = 0;
+	} else {
+		*begin = name_index.rank[id];
+		*end = *begin + 1;
+	}
+}
+
+void Scene::prefix_ranks(std::string const &prefix, uint32_t *begin, uint32_t *end) const {
+	update_name_index();
+	//names are sorted, so those starting with 'prefix' are a run between those that sort before it and those that sort after:
+	std::vector< uint32_t > const &sorted = name_index.sorted;
+	auto b = std::partition_point(sorted.begin(), sorted.end(), [this, &prefix](uint32_t id) {
+		return name_table[id].compare(0, prefix.size(), prefix) < 0;
+	});
+	auto e = std::partition_point(b, sorted.end(), [this, &prefix](uint32_t id) {
+		return name_table[id].compare(0, prefix.size(), prefix) == 0;
+	});
+	*begin = uint32_t(b - sorted.begin());
+	*end = uint32_t(e - sorted.begin());
+}
+
+template< typename T >
+static Scene::Named< T > named_range(std::vector< T * > const &sorted, std::vector< uint32_t > const &first, uint32_t begin, uint32_t end) {
+	Scene::Named< T > ret;
+	ret.begin_ = sorted.data() + first[begin];
+	ret.end_ = sorted.data() + first[end];
+	return ret;
+}
+
+Scene::Named< Scene::Transform > Scene::transforms_named(std::string const &name_) const {
+	uint32_t begin, end;
+	name_ranks(name_, &begin, &end);
+	return named_range(name_index.transforms, name_index.first_transform, begin, end);
+}
+
+Scene::Named< Scene::Transform > Scene::transforms_with_prefix(std::string const &prefix) const {
+	uint32_t begin, end;
+	prefix_ranks(prefix, &begin, &end);
+	return named_range(name_index.transforms, name_index.first_transform, begin, end);
+}
+
+Scene::Named< Scene::Object > Scene::objects_named(std::string const &name_) const {
+	uint32_t begin, end;
+	name_ranks(name_, &begin, &end);
+	return named_range(name_index.objects, name_index.first_object, begin, end);
+}
+
+Scene::Named< Scene::Object > Scene::objects_with_prefix(std::string const &prefix) const {
+	uint32_t begin, end;
+	prefix_ranks(prefix, &begin, &end);
+	return named_range(name_index.objects, name_index.first_object, begin, end);
+}
+
+Scene::Named< Scene::Lamp > Scene::lamps_named(std::string const &name_) const {
+	uint32_t begin, end;
+	name_ranks(name_, &begin, &end);
+	return named_range(name_index.lamps, name_index.first_lamp, begin, end);
+}
+
+Scene::Named< Scene::Lamp > Scene::lamps_with_prefix(std::string const &prefix) const {
+	uint32_t begin, end;
+	prefix_ranks(prefix, &begin, &end);
+	return named_range(name_index.lamps, name_index.first_lamp, begin, end);
+}
+
+Scene::Named< Scene::Camera > Scene::cameras_named(std::string const &name_) const {
+	uint32_t begin, end;
+	name_ranks(name_, &begin, &end);
+	return named_range(name_index.cameras, name_index.first_camera, begin, end);
+}
+
+Scene::Named< Scene::Camera > Scene::cameras_with_prefix(std::string const &prefix) const {
+	uint32_t begin, end;
+	prefix_ranks(prefix, &begin, &end);
+	return named_range(name_index.cameras, name_index.first_camera, begin, end);
+}
+
+void Scene::draw(Scene::Camera const *camera, Object::ProgramType program_type, DrawStats *stats, PVS const *pvs, OcclusionBuffer const *occlusion) const {
 	assert(camera && "Must have a camera to draw scene from.");
 	assert(program_type < Object::ProgramTypes);
 
-	glm::mat4 world_to_camera = camera->transform->make_world_to_local();
+	glm::mat4 world_to_camera = camera->transform->world_to_local;
 	glm::mat4 world_to_clip = camera->make_projection() * world_to_camera;
 
-	draw(world_to_clip, program_type);
+	uint32_t pvs_cell = (pvs ? pvs->cell_at(glm::vec3(camera->transform->local_to_world[3])) : -1U);
+	draw(world_to_clip, program_type, stats, pvs, pvs_cell, occlusion);
 }
 
-void Scene::draw(Scene::Lamp const *lamp, Object::ProgramType program_type) const {
+void Scene::draw(Scene::Lamp const *lamp, Object::ProgramType program_type, DrawStats *stats, PVS const *pvs) const {
 	assert(lamp && "Must have a lamp to draw scene from.");
 	assert(program_type < Object::ProgramTypes);
 
-	glm::mat4 world_to_lamp = lamp->transform->make_world_to_local();
+	glm::mat4 world_to_lamp = lamp->transform->world_to_local;
 	glm::mat4 world_to_clip = lamp->make_projection() * world_to_lamp;
 
-	draw(world_to_clip, program_type);
+	uint32_t pvs_cell = (pvs ? pvs->cell_at(glm::vec3(lamp->transform->local_to_world[3])) : -1U);
+	draw(world_to_clip, program_type, stats, pvs, pvs_cell);
 }
 
 
-void Scene::draw(glm::mat4 const &world_to_clip, Object::ProgramType program_type) const {
+//passes with at least this many queued objects compute their matrices on the worker pool, in ranges of this many objects:
+static constexpr uint32_t ParallelMatricesMinimum = 8192;
+static constexpr uint32_t ParallelMatricesGrain = 2048;
+
+//likewise for occlusion tests (each of which is a few tile lookups, so it pays off sooner):
+static constexpr uint32_t ParallelOcclusionMinimum = 1024;
+static constexpr uint32_t ParallelOcclusionGrain = 256;
+
+#ifdef SCENE_USE_SSE
+static inline __m128 cross_sse(__m128 a, __m128 b) {
+	//(a.yzx * b.zxy - a.zxy * b.yzx, computed as (a * b.yzx - a.yzx * b).yzx; w ends up zero)
+	__m128 a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+	__m128 b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+	__m128 c = _mm_sub_ps(_mm_mul_ps(a, b_yzx), _mm_mul_ps(a_yzx, b));
+	return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+}
+#endif //SCENE_USE_SSE
+
+//fill draw list matrices for queue entries [begin, end):
+// object_to_clip = world_to_clip * local_to_world,
+// normal_to_light = inverse(transpose(mat3(local_to_world))), which is just mat3(local_to_world) for unscaled transforms,
+//  and otherwise the cofactor matrix (columns b x c, c x a, a x b for columns a, b, c) over the determinant.
+static void compute_object_matrices(glm::mat4 const &world_to_clip, Scene::DrawList &list, uint32_t begin, uint32_t end) {
+#ifdef SCENE_USE_SSE
+	__m128 clip[4];
+	for (uint32_t c = 0; c < 4; ++c) {
+		clip[c] = _mm_loadu_ps(&world_to_clip[c][0]);
+	}
+#endif //SCENE_USE_SSE
+	for (uint32_t q = begin; q < end; ++q) {
+		Scene::Transform const *transform = list.objects[list.queue[q].index]->transform;
+		glm::mat4 const &local_to_world = transform->local_to_world;
+		glm::vec4 *normal = &list.normal_to_light[3 * q];
+#ifdef SCENE_USE_SSE
+		__m128 col[4];
+		for (uint32_t c = 0; c < 4; ++c) {
+			col[c] = _mm_loadu_ps(&local_to_world[c][0]);
+			__m128 x = _mm_mul_ps(clip[0], _mm_shuffle_ps(col[c], col[c], _MM_SHUFFLE(0, 0, 0, 0)));
+			__m128 y = _mm_mul_ps(clip[1], _mm_shuffle_ps(col[c], col[c], _MM_SHUFFLE(1, 1, 1, 1)));
+			__m128 z = _mm_mul_ps(clip[2], _mm_shuffle_ps(col[c], col[c], _MM_SHUFFLE(2, 2, 2, 2)));
+			__m128 w = _mm_mul_ps(clip[3], _mm_shuffle_ps(col[c], col[c], _MM_SHUFFLE(3, 3, 3, 3)));
+			_mm_storeu_ps(&list.object_to_clip[q][c][0], _mm_add_ps(_mm_add_ps(x, y), _mm_add_ps(z, w)));
+		}
+		if (transform->unscaled) {
+			for (uint32_t c = 0; c < 3; ++c) {
+				_mm_storeu_ps(&normal[c][0], col[c]);
+			}
+		} else {
+			__m128 bc = cross_sse(col[1], col[2]);
+			__m128 ca = cross_sse(col[2], col[0]);
+			__m128 ab = cross_sse(col[0], col[1]);
+			float det;
+			__m128 d = _mm_mul_ps(col[0], bc); //(w is zero, since bc.w is)
+			d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(1, 0, 3, 2)));
+			d = _mm_add_ss(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(2, 3, 0, 1)));
+			_mm_store_ss(&det, d);
+			__m128 inv_det = _mm_set1_ps(det == 0.0f ? 0.0f : 1.0f / det);
+			_mm_storeu_ps(&normal[0][0], _mm_mul_ps(bc, inv_det));
+			_mm_storeu_ps(&normal[1][0], _mm_mul_ps(ca, inv_det));
+			_mm_storeu_ps(&normal[2][0], _mm_mul_ps(ab, inv_det));
+		}
+#else //SCENE_USE_SSE
+		list.object_to_clip[q] = world_to_clip * local_to_world;
+		if (transform->unscaled) {
+			for (uint32_t c = 0; c < 3; ++c) {
+				normal[c] = local_to_world[c];
+			}
+		} else {
+			glm::vec3 a = glm::vec3(local_to_world[0]);
+			glm::vec3 b = glm::vec3(local_to_world[1]);
+			glm::vec3 c = glm::vec3(local_to_world[2]);
+			glm::vec3 bc = glm::cross(b, c);
+			float det = glm::dot(a, bc);
+			float inv_det = (det == 0.0f ? 0.0f : 1.0f / det);
+			normal[0] = glm::vec4(bc * inv_det, 0.0f);
+			normal[1] = glm::vec4(glm::cross(c, a) * inv_det, 0.0f);
+			normal[2] = glm::vec4(glm::cross(a, b) * inv_det, 0.0f);
+		}
+#endif //SCENE_USE_SSE
+	}
+}
+
+void Scene::DrawList::compute_matrices(glm::mat4 const &world_to_clip) {
+	//(big passes are spread over the worker pool; each range only writes its own entries)
+	uint32_t queued = uint32_t(queue.size());
+	object_to_clip.resize(queued);
+	normal_to_light.resize(3 * queued);
+	if (queued >= ParallelMatricesMinimum) {
+		WorkerPool::shared().parallel_for(queued, ParallelMatricesGrain, [&](uint32_t begin, uint32_t end) {
+			compute_object_matrices(world_to_clip, *this, begin, end);
+		});
+	} else {
+		compute_object_matrices(world_to_clip, *this, 0, queued);
+	}
+}
+
+//level of detail for an object of projected size 'size' that was last drawn at level 'current':
+// switching to a coarser level waits until size is (1 - hysteresis) of the threshold, and back until it is (1 + hysteresis) of it.
+static uint32_t pick_lod(Scene::Object::ProgramInfo const &info, float size, uint32_t current, float hysteresis) {
+	uint32_t coarsest_to_keep = 0; //levels beyond this are too coarse to stay at
+	uint32_t finest_to_keep = 0; //levels before this are too fine to stay at
+	for (uint32_t l = 0; l < Scene::Object::ProgramInfo::LodCount && info.lods[l].count; ++l) {
+		if (size < info.lods[l].max_size * (1.0f + hysteresis)) coarsest_to_keep = l + 1;
+		if (size < info.lods[l].max_size * (1.0f - hysteresis)) finest_to_keep = l + 1;
+	}
+	return std::min(std::max(current, finest_to_keep), coarsest_to_keep);
+}
+
+void Scene::draw(glm::mat4 const &world_to_clip, Object::ProgramType program_type, DrawStats *stats, PVS const *pvs, uint32_t pvs_cell, OcclusionBuffer const *occlusion) const {
 	assert(program_type < Object::ProgramTypes);
 
-	for (Scene::Object *object = first_object; object != nullptr; object = object->alloc_next) {
+	if (stats) *stats = DrawStats();
+	if (!pvs) pvs_cell = -1U;
 
-		//don't draw if no program of this type attached to object:
+	//gather objects with a program of this type, along with world-space bounding boxes:
+	DrawList &list = draw_list;
+	list.objects.clear();
+	list.center_x.clear(); list.center_y.clear(); list.center_z.clear();
+	list.extent_x.clear(); list.extent_y.clear(); list.extent_z.clear();
+	for (Scene::Object const *object : objects) {
 		if (object->programs[program_type].program == 0) continue;
+		glm::vec3 center = glm::vec3(0.0f);
+		glm::vec3 extent = glm::vec3(0.0f);
+		if (object->has_bounds) {
+			world_box(*object, object->transform->local_to_world, &center, &extent);
+
+			//don't bother with objects in cells that can't be seen from the viewer's cell:
+			if (pvs_cell != -1U && !pvs->box_visible(pvs_cell, center - extent, center + extent)) {
+				if (stats) ++stats->pvs_culled;
+				continue;
+			}
+		}
+		list.objects.emplace_back(object);
+		list.center_x.emplace_back(center.x);
+		list.center_y.emplace_back(center.y);
+		list.center_z.emplace_back(center.z);
+		list.extent_x.emplace_back(extent.x);
+		list.extent_y.emplace_back(extent.y);
+		list.extent_z.emplace_back(extent.z);
+	}
+	size_t const count = list.objects.size();
+	list.visible.assign(count, 1);
+
+	//the view volume is where -w <= x,y,z <= w in clip space, so its planes are (row 3) +/- (rows 0, 1, 2) of world_to_clip:
+	// (with an infinite projection the far plane has no xyz part and never culls anything)
+	glm::vec4 planes[6];
+	glm::vec4 w = glm::vec4(world_to_clip[0][3], world_to_clip[1][3], world_to_clip[2][3], world_to_clip[3][3]);
+	for (uint32_t r = 0; r < 3; ++r) {
+		glm::vec4 row = glm::vec4(world_to_clip[0][r], world_to_clip[1][r], world_to_clip[2][r], world_to_clip[3][r]);
+		planes[2*r+0] = w + row;
+		planes[2*r+1] = w - row;
+	}
 
-		glm::mat4 local_to_world = object->transform->make_local_to_world();
+	//a box is outside if, for some plane, even its corner furthest along the plane's normal is behind it:
+	size_t i = 0;
+
+#ifdef SCENE_USE_SSE
+	//four boxes at a time:
+	for (; i + 4 <= count; i += 4) {
+		__m128 Cx = _mm_loadu_ps(list.center_x.data() + i);
+		__m128 Cy = _mm_loadu_ps(list.center_y.data() + i);
+		__m128 Cz = _mm_loadu_ps(list.center_z.data() + i);
+		__m128 Ex = _mm_loadu_ps(list.extent_x.data() + i);
+		__m128 Ey = _mm_loadu_ps(list.extent_y.data() + i);
+		__m128 Ez = _mm_loadu_ps(list.extent_z.data() + i);
+		__m128 outside = _mm_setzero_ps();
+		for (auto const &plane : planes) {
+			__m128 d = _mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(_mm_set1_ps(plane.x), Cx),
+				_mm_mul_ps(_mm_set1_ps(plane.y), Cy)), _mm_add_ps(
+				_mm_mul_ps(_mm_set1_ps(plane.z), Cz),
+				_mm_set1_ps(plane.w)));
+			__m128 r = _mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(_mm_set1_ps(std::abs(plane.x)), Ex),
+				_mm_mul_ps(_mm_set1_ps(std::abs(plane.y)), Ey)),
+				_mm_mul_ps(_mm_set1_ps(std::abs(plane.z)), Ez));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(d, r), _mm_setzero_ps()));
+		}
+		int outside_mask = _mm_movemask_ps(outside);
+		for (uint32_t l = 0; l < 4; ++l) {
+			if (outside_mask & (1 << l)) list.visible[i + l] = 0;
+		}
+	}
+#endif //SCENE_USE_SSE
+
+	//scalar version of the above, for leftover boxes (or all boxes, without SSE):
+	for (; i < count; ++i) {
+		for (auto const &plane : planes) {
+			float d = plane.x * list.center_x[i] + plane.y * list.center_y[i] + plane.z * list.center_z[i] + plane.w;
+			float r = std::abs(plane.x) * list.extent_x[i] + std::abs(plane.y) * list.extent_y[i] + std::abs(plane.z) * list.extent_z[i];
+			if (d + r < 0.0f) {
+				list.visible[i] = 0;
+				break;
+			}
+		}
+	}
+
+	//of the boxes in view, check which are hidden behind occluders:
+	if (occlusion) {
+		auto test_boxes = [&list, occlusion](uint32_t begin, uint32_t end) {
+			for (uint32_t o = begin; o < end; ++o) {
+				if (list.visible[o] != 1 || !list.objects[o]->has_bounds) continue;
+				glm::vec3 center = glm::vec3(list.center_x[o], list.center_y[o], list.center_z[o]);
+				glm::vec3 extent = glm::vec3(list.extent_x[o], list.extent_y[o], list.extent_z[o]);
+				if (!occlusion->box_visible(center, extent)) list.visible[o] = 2;
+			}
+		};
+		if (count >= ParallelOcclusionMinimum) {
+			WorkerPool::shared().parallel_for(uint32_t(count), ParallelOcclusionGrain, test_boxes);
+		} else {
+			test_boxes(0, uint32_t(count));
+		}
+	}
 
-		//compute modelview+projection (object space to clip space) matrix for this object:
-		glm::mat4 mvp = world_to_clip * local_to_world;
+	//an object of radius r at clip-space w covers r * view_scale / w of the view's height, where view_scale is the projection's y scale:
+	// (the length of the xyz part of world_to_clip's second row, since the rest of world_to_clip is a rigid transform)
+	float view_scale = glm::length(glm::vec3(world_to_clip[0][1], world_to_clip[1][1], world_to_clip[2][1]));
 
-		//compute modelview (object space to camera local space) matrix for this object:
-		glm::mat4x3 mv = glm::mat4x3(local_to_world);
+	//queue the visible objects, sorted by state and then front-to-back:
+	list.queue.clear();
+	for (size_t o = 0; o < count; ++o) {
+		Scene::Object const *object = list.objects[o];
 
-		//NOTE: inverse cancels out transpose unless there is scale involved
-		glm::mat3 itmv = glm::inverse(glm::transpose(glm::mat3(mv)));
+		//don't draw if out of view or hidden (objects without bounds can't be culled):
+		if (list.visible[o] != 1 && object->has_bounds) {
+			if (stats) {
+				if (list.visible[o] == 2) ++stats->occlusion_culled;
+				else ++stats->culled;
+			}
+			continue;
+		}
 
-		//set up program uniforms:
 		Object::ProgramInfo const &info = object->programs[program_type];
-		glUseProgram(info.program);
-		if (info.mvp_mat4 != -1U) {
-			glUniformMatrix4fv(info.mvp_mat4, 1, GL_FALSE, glm::value_ptr(mvp));
+		DrawList::QueueItem item;
+		item.program = info.program;
+		item.vao = info.vao;
+		for (uint32_t i = 0; i < Object::ProgramInfo::TextureCount; ++i) {
+			item.textures[i] = info.textures[i];
+		}
+		item.start = info.start;
+		item.count = info.count;
+		item.depth = w.x * list.center_x[o] + w.y * list.center_y[o] + w.z * list.center_z[o] + w.w;
+		if (info.lods[0].count) {
+			uint32_t level = 0;
+			if (object->has_bounds && item.depth > 0.0f) {
+				float radius = glm::length(glm::vec3(list.extent_x[o], list.extent_y[o], list.extent_z[o]));
+				level = pick_lod(info, radius * view_scale / item.depth, info.lod, lod_hysteresis);
+			}
+			info.lod = level;
+			if (level) {
+				item.start = info.lods[level - 1].start;
+				item.count = info.lods[level - 1].count;
+				if (stats) ++stats->lod_objects;
+			}
+		}
+		item.index = uint32_t(o);
+		list.queue.emplace_back(item);
+	}
+	std::sort(list.queue.begin(), list.queue.end(), [](DrawList::QueueItem const &a, DrawList::QueueItem const &b) {
+		if (a.program != b.program) return a.program < b.program;
+		if (a.vao != b.vao) return a.vao < b.vao;
+		for (uint32_t i = 0; i < Object::ProgramInfo::TextureCount; ++i) {
+			if (a.textures[i] != b.textures[i]) return a.textures[i] < b.textures[i];
+		}
+		if (a.start != b.start) return a.start < b.start;
+		if (a.count != b.count) return a.count < b.count;
+		if (a.depth != b.depth) return a.depth < b.depth;
+		return a.index < b.index;
+	});
+
+	//compute every queued object's matrices up front, so the submission loop below only talks to OpenGL:
+	list.compute_matrices(world_to_clip);
+
+	//split the queue into draws, gathering runs of objects that can share an instanced draw:
+	auto same_batch = [](DrawList::QueueItem const &a, DrawList::QueueItem const &b) {
+		if (a.program != b.program || a.vao != b.vao || a.start != b.start || a.count != b.count) return false;
+		for (uint32_t i = 0; i < Object::ProgramInfo::TextureCount; ++i) {
+			if (a.textures[i] != b.textures[i]) return false;
+		}
+		return true;
+	};
+	auto can_instance = [&](DrawList::QueueItem const &item) {
+		Object::ProgramInfo const &info = list.objects[item.index]->programs[program_type];
+		return info.instanced_bool != -1U && !info.set_uniforms;
+	};
+	list.draws.clear();
+	list.instances.clear();
+	list.constants.clear();
+	for (uint32_t begin = 0; begin < list.queue.size(); ) {
+		uint32_t end = begin + 1;
+		if (can_instance(list.queue[begin])) {
+			while (end < list.queue.size() && same_batch(list.queue[begin], list.queue[end]) && can_instance(list.queue[end])) ++end;
+		}
+		DrawList::Draw draw;
+		draw.begin = begin;
+		draw.end = end;
+		draw.instance_base = uint32_t(list.instances.size() / 6);
+		draw.constants = -1U;
+		if (end - begin == 1 && list.objects[list.queue[begin].index]->programs[program_type].object_constants_block != -1U) {
+			if (object_constants_stride == 0) {
+				GLint alignment = 0;
+				glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+				if (alignment < 1) alignment = 1;
+				object_constants_stride = (uint32_t(sizeof(ObjectConstants)) + uint32_t(alignment) - 1) / uint32_t(alignment) * uint32_t(alignment);
+			}
+			draw.constants = uint32_t(list.constants.size() / object_constants_stride);
+			list.constants.resize(list.constants.size() + object_constants_stride);
+			ObjectConstants &constants = *reinterpret_cast< ObjectConstants * >(&list.constants[draw.constants * object_constants_stride]);
+
+			glm::mat4 const &local_to_world = list.objects[list.queue[begin].index]->transform->local_to_world;
+			constants.object_to_clip = list.object_to_clip[begin];
+			for (uint32_t c = 0; c < 4; ++c) {
+				constants.object_to_light[c] = local_to_world[c];
+			}
+			for (uint32_t c = 0; c < 3; ++c) {
+				constants.normal_to_light[c] = list.normal_to_light[3 * begin + c];
+			}
+		} else if (end - begin > 1) {
+			for (uint32_t q = begin; q < end; ++q) {
+				glm::mat4 const &local_to_world = list.objects[list.queue[q].index]->transform->local_to_world;
+				glm::vec4 const *itmv = &list.normal_to_light[3 * q];
+				for (uint32_t r = 0; r < 3; ++r) {
+					list.instances.emplace_back(local_to_world[0][r], local_to_world[1][r], local_to_world[2][r], local_to_world[3][r]);
+				}
+				for (uint32_t r = 0; r < 3; ++r) {
+					list.instances.emplace_back(itmv[0][r], itmv[1][r], itmv[2][r], 0.0f);
+				}
+			}
+		}
+		list.draws.emplace_back(draw);
+		begin = end;
+	}
+
+	//bindings made by this pass, so unchanged ones can be skipped:
+	// (what was bound before the pass is unknown, so the first use of each binding always goes through)
+	bool program_known = false, vao_known = false;
+	GLuint bound_program = 0, bound_vao = 0;
+	bool texture_known[Object::ProgramInfo::TextureCount] = {false, false, false, false};
+	GLuint bound_textures[Object::ProgramInfo::TextureCount] = {0, 0, 0, 0};
+	uint32_t active_texture = 0;
+	bool active_texture_known = false;
+	auto set_active_texture = [&](uint32_t i) {
+		if (active_texture_known && active_texture == i) return;
+		glActiveTexture(GL_TEXTURE0 + i);
+		active_texture = i;
+		active_texture_known = true;
+		if (stats) ++stats->active_texture_changes;
+	};
+	//uniforms of the bound program that only change between draws (reset when the program changes):
+	bool instanced_known = false, instanced = false;
+	bool world_to_clip_set = false;
+
+	//stream instance transforms for this pass:
+	if (!list.instances.empty()) {
+		if (instance_buffer == 0) {
+			glGenBuffers(1, &instance_buffer);
+			glGenTextures(1, &instance_tex);
+			glBindTexture(GL_TEXTURE_BUFFER, instance_tex);
+			glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, instance_buffer);
+			glBindTexture(GL_TEXTURE_BUFFER, 0);
+		}
+		glBindBuffer(GL_TEXTURE_BUFFER, instance_buffer);
+		glBufferData(GL_TEXTURE_BUFFER, list.instances.size() * sizeof(glm::vec4), list.instances.data(), GL_STREAM_DRAW);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+		set_active_texture(Object::ProgramInfo::InstanceTextureUnit);
+		glBindTexture(GL_TEXTURE_BUFFER, instance_tex);
+		if (stats) ++stats->texture_binds;
+	}
+
+	//stream per-object constants for this pass into the ring buffer with one mapped write:
+	uint32_t constants_base = 0; //offset of this pass's constants in object_constants_buffer
+	if (!list.constants.empty()) {
+		uint32_t bytes = uint32_t(list.constants.size());
+		if (object_constants_buffer == 0) {
+			glGenBuffers(1, &object_constants_buffer);
+		}
+		glBindBuffer(GL_UNIFORM_BUFFER, object_constants_buffer);
+		GLbitfield access = GL_MAP_WRITE_BIT;
+		if (bytes > object_constants_size) {
+			//(re-)allocate with room for a few passes of this size:
+			object_constants_size = std::max(4 * bytes, 64U * 1024U);
+			glBufferData(GL_UNIFORM_BUFFER, object_constants_size, nullptr, GL_STREAM_DRAW);
+			object_constants_head = 0;
+			access |= GL_MAP_INVALIDATE_BUFFER_BIT;
+		} else if (object_constants_head + bytes > object_constants_size) {
+			//wrap around, orphaning the old storage (which earlier passes may still be reading):
+			object_constants_head = 0;
+			access |= GL_MAP_INVALIDATE_BUFFER_BIT;
+		} else {
+			//nothing queued so far reads this range, so there is no need to wait for the GPU:
+			access |= GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
 		}
-		if (info.mv_mat4x3 != -1U) {
-			glUniformMatrix4x3fv(info.mv_mat4x3, 1, GL_FALSE, glm::value_ptr(mv));
+		constants_base = object_constants_head;
+		void *mapped = glMapBufferRange(GL_UNIFORM_BUFFER, constants_base, bytes, access);
+		if (mapped) {
+			std::memcpy(mapped, list.constants.data(), bytes);
+			glUnmapBuffer(GL_UNIFORM_BUFFER);
+		} else {
+			glBufferSubData(GL_UNIFORM_BUFFER, constants_base, bytes, list.constants.data());
 		}
-		if (info.itmv_mat3 != -1U) {
-			glUniformMatrix3fv(info.itmv_mat3, 1, GL_FALSE, glm::value_ptr(itmv));
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		//(bytes is a whole number of strides, so the head stays aligned for the next pass)
+		object_constants_head += bytes;
+	}
+
+	for (auto const &draw : list.draws) {
+		DrawList::QueueItem const &item = list.queue[draw.begin];
+		Scene::Object const *object = list.objects[item.index];
+		Object::ProgramInfo const &info = object->programs[program_type];
+		uint32_t instances = draw.end - draw.begin;
+		if (stats) stats->submitted += instances;
+		if (stats) stats->triangles += instances * (item.count / 3);
+
+		if (!program_known || bound_program != info.program) {
+			glUseProgram(info.program);
+			bound_program = info.program;
+			program_known = true;
+			instanced_known = false;
+			world_to_clip_set = false;
+			if (stats) ++stats->program_binds;
 		}
 
-		if (info.set_uniforms) info.set_uniforms();
+		//set up program uniforms:
+		if (info.instanced_bool != -1U && (!instanced_known || instanced != (instances > 1))) {
+			instanced = (instances > 1);
+			instanced_known = true;
+			glUniform1i(info.instanced_bool, instanced ? 1 : 0);
+			if (stats) ++stats->uniform_calls;
+		}
+		if (instances > 1) {
+			if (!world_to_clip_set) {
+				glUniformMatrix4fv(info.world_to_clip_mat4, 1, GL_FALSE, glm::value_ptr(world_to_clip));
+				world_to_clip_set = true;
+				if (stats) ++stats->uniform_calls;
+			}
+			glUniform1i(info.instance_base_int, GLint(draw.instance_base));
+			if (stats) ++stats->uniform_calls;
+			if (stats) stats->instanced_objects += instances;
+		} else if (draw.constants != -1U) {
+			glBindBufferRange(GL_UNIFORM_BUFFER, ObjectConstantsBinding, object_constants_buffer,
+				constants_base + draw.constants * object_constants_stride, sizeof(ObjectConstants));
+			if (stats) ++stats->constants_binds;
+
+			if (info.set_uniforms) info.set_uniforms();
+		} else {
+			//modelview+projection (object space to clip space), modelview (object space to lighting space), and normal matrices for this object:
+			glm::mat4 const &mvp = list.object_to_clip[draw.begin];
+			glm::mat4x3 mv = glm::mat4x3(object->transform->local_to_world);
+			glm::vec4 const *normal = &list.normal_to_light[3 * draw.begin];
+			glm::mat3 itmv = glm::mat3(glm::vec3(normal[0]), glm::vec3(normal[1]), glm::vec3(normal[2]));
+
+			if (info.mvp_mat4 != -1U) {
+				glUniformMatrix4fv(info.mvp_mat4, 1, GL_FALSE, glm::value_ptr(mvp));
+				if (stats) ++stats->uniform_calls;
+			}
+			if (info.mv_mat4x3 != -1U) {
+				glUniformMatrix4x3fv(info.mv_mat4x3, 1, GL_FALSE, glm::value_ptr(mv));
+				if (stats) ++stats->uniform_calls;
+			}
+			if (info.itmv_mat3 != -1U) {
+				glUniformMatrix3fv(info.itmv_mat3, 1, GL_FALSE, glm::value_ptr(itmv));
+				if (stats) ++stats->uniform_calls;
+			}
+
+			if (info.set_uniforms) info.set_uniforms();
+		}
 
 		//set up program textures:
+		// (a zero texture leaves whatever is bound to that unit alone, e.g., a shadow map bound by the caller)
 		for (uint32_t i = 0; i < Object::ProgramInfo::TextureCount; ++i) {
-			if (info.textures[i] != 0) {
-				glActiveTexture(GL_TEXTURE0 + i);
+			if (info.textures[i] != 0 && (!texture_known[i] || bound_textures[i] != info.textures[i])) {
+				set_active_texture(i);
 				glBindTexture(GL_TEXTURE_2D, info.textures[i]);
+				bound_textures[i] = info.textures[i];
+				texture_known[i] = true;
+				if (stats) ++stats->texture_binds;
 			}
 		}
 
-		glBindVertexArray(info.vao);
+		if (!vao_known || bound_vao != info.vao) {
+			glBindVertexArray(info.vao);
+			bound_vao = info.vao;
+			vao_known = true;
+			if (stats) ++stats->vao_binds;
+		}
 
-		//draw the object:
-		glDrawArrays(GL_TRIANGLES, info.start, info.count);
+		//draw the object(s):
+		//(the mesh range comes from the queue, which holds each object's chosen level of detail)
+		if (instances > 1) {
+			glDrawArraysInstanced(GL_TRIANGLES, item.start, item.count, GLsizei(instances));
+		} else {
+			glDrawArrays(GL_TRIANGLES, item.start, item.count);
+		}
+		if (stats) ++stats->draw_calls;
 	}
 
-	//unbind any still bound textures and go back to active texture unit zero:
+	//unbind any textures bound by this pass and go back to active texture unit zero:
 	for (uint32_t i = 0; i < Object::ProgramInfo::TextureCount; ++i) {
-		glActiveTexture(GL_TEXTURE0 + i);
-		glBindTexture(GL_TEXTURE_2D, 0);
+		if (texture_known[i] && bound_textures[i] != 0) {
+			set_active_texture(i);
+			glBindTexture(GL_TEXTURE_2D, 0);
+			if (stats) ++stats->texture_binds;
+		}
+	}
+	if (!list.instances.empty()) {
+		set_active_texture(Object::ProgramInfo::InstanceTextureUnit);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+		if (stats) ++stats->texture_binds;
 	}
-	glActiveTexture(GL_TEXTURE0);
+	if (active_texture_known) set_active_texture(0);
 }
 
 
 Scene::~Scene() {
-	while (first_camera) {
-		delete_camera(first_camera);
-	}
-	while (first_object) {
-		delete_object(first_object);
-	}
-	while (first_transform) {
-		delete_transform(first_transform);
-	}
+	//(things attached to transforms go first, so no transform is freed out from under them)
+	cameras.clear();
+	lamps.clear();
+	objects.clear();
+	transforms.clear();
 }
 
 void Scene::load(std::string const &filename,
@@ -337,7 +1113,7 @@ void Scene::load(std::string const &filename,
 		}
 
 		if (h.name_begin <= h.name_end && h.name_end <= names.size()) {
-			t->name = std::string(names.begin() + h.name_begin, names.begin() + h.name_end);
+			t->name = intern(std::string(names.begin() + h.name_begin, names.begin() + h.name_end));
 		} else {
 				throw std::runtime_error("scene file '" + filename + "' contains hierarchy entry with invalid name indices");
 		}
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "GL.hpp"
+#include "Pool.hpp"
+#include "AABBTree.hpp"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
@@ -9,13 +11,17 @@
 #include <list>
 #include <functional>
 #include <string>
+#include <unordered_map>
+
+struct PVS;
+struct OcclusionBuffer;
 
 //"Scene" manages a hierarchy of transformations with, potentially, attached information.
 struct Scene {
 
 	struct Transform {
-		//useful to know sometimes:
-		std::string name;
+		//useful to know sometimes: id of this transform's name in the scene's name table (see Scene::name() / Scene::set_name())
+		uint32_t name = 0;
 
 		//simple specification:
 		glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f);
@@ -38,9 +44,24 @@ struct Scene {
 		//computed from the above:
 		glm::mat4 make_local_to_parent() const;
 		glm::mat4 make_parent_to_local() const;
+		//(these walk the whole parent chain; prefer the cached matrices below once per-frame updates are done)
 		glm::mat4 make_local_to_world() const;
 		glm::mat4 make_world_to_local() const;
 
+		//cached versions of make_local_to_world() / make_world_to_local(), refreshed by Scene::update_transforms():
+		glm::mat4 local_to_world = glm::mat4(1.0f);
+		glm::mat4 world_to_local = glm::mat4(1.0f);
+
+		//bookkeeping for the cache:
+		// a transform is recomputed if it is 'dirty' (set by set_parent), if position, rotation, or scale differ from the values
+		// the cache was computed from, or if its parent was recomputed during the same update.
+		bool dirty = true;
+		bool world_changed = false; //was this transform recomputed during the most recent update?
+		bool unscaled = true; //are this transform's and all its ancestors' scales exactly one? (then local_to_world's upper 3x3 is a rotation)
+		glm::vec3 cached_position = glm::vec3(0.0f);
+		glm::quat cached_rotation = glm::quat(0.0f, 0.0f, 0.0f, 1.0f);
+		glm::vec3 cached_scale = glm::vec3(1.0f);
+
 		//constructor/destructor:
 		Transform() = default;
 		Transform(Transform &) = delete;
@@ -52,10 +73,6 @@ struct Scene {
 				set_parent(nullptr);
 			}
 		}
-
-		//used by Scene to manage allocation:
-		Transform **alloc_prev_next = nullptr;
-		Transform *alloc_next = nullptr;
 	};
 
 	//"Object"s contain information needed to render meshes:
@@ -65,6 +82,18 @@ struct Scene {
 			assert(transform);
 		}
 
+		//objects that never move can be marked static and merged into world-space batches by batch_static_objects():
+		bool is_static = false;
+
+		//(optional) object-space bounding box, used by draw() to skip objects outside the view:
+		// (objects without bounds are always drawn)
+		bool has_bounds = false;
+		glm::vec3 bounds_min = glm::vec3(0.0f);
+		glm::vec3 bounds_max = glm::vec3(0.0f);
+
+		//leaf in the scene's object_tree (-1U if not in it), maintained by update_transforms() and delete_object():
+		mutable uint32_t tree_leaf = -1U;
+
 		//program info:
 		enum ProgramType : uint32_t {
 			ProgramTypeDefault = 0,
@@ -85,14 +114,36 @@ struct Scene {
 			GLuint itmv_mat3 = -1U; //uniform index for normal-to-lighting-space matrix (mat3)
 			std::function< void() > set_uniforms; //(optional) function to set additional uniforms
 
+			//(optional) per-object constants: programs that read the three matrices above from a std140 "ObjectConstants" block
+			// (laid out as Scene::ObjectConstants, bound to binding point Scene::ObjectConstantsBinding) set this,
+			// and draw() then streams every visible object's matrices into one buffer and binds each object's slice instead of setting uniforms.
+			GLuint object_constants_block = -1U; //uniform block index of the "ObjectConstants" block
+
+			//(optional) instancing: programs that can read per-instance transforms from the scene's instance buffer set these,
+			// and draw() then draws objects sharing program, vao, textures, and mesh range (and without set_uniforms) with one call.
+			//Instance i's transforms are texels [6*(instance_base + gl_InstanceID), +6) of the RGBA32F buffer texture on unit InstanceTextureUnit:
+			// three rows of object-to-lighting-space (mat4x3), then three rows (xyz) of normal-to-lighting-space (mat3).
+			GLuint instanced_bool = -1U; //uniform index for whether to read transforms from the instance buffer (bool)
+			GLuint instance_base_int = -1U; //uniform index for the first instance of the current draw (int)
+			GLuint world_to_clip_mat4 = -1U; //uniform index for world-to-clip matrix (mat4)
+
+			//(optional) levels of detail: coarser versions of start/count, which draw() uses when the object looks small:
+			// lods[l] (if its count is nonzero) can be drawn once the object's projected size -- the diagonal of its world-space box
+			// over the height of the view at its center -- is below lods[l].max_size; max_sizes should shrink from one level to the next.
+			// (switches between levels are delayed by Scene::lod_hysteresis, so objects near a threshold don't flicker between them)
+			enum : uint32_t { LodCount = 3 };
+			struct Lod {
+				GLuint start = 0;
+				GLuint count = 0;
+				float max_size = 0.0f;
+			} lods[LodCount];
+			mutable uint32_t lod = 0; //level drawn by the last pass with this program type (0 is start/count; l + 1 is lods[l])
+
 			//textures:
 			enum : uint32_t { TextureCount = 4 };
 			GLuint textures[TextureCount] = {0,0,0,0}; //textures to bind
+			enum : uint32_t { InstanceTextureUnit = TextureCount }; //(the instance buffer texture goes just after the object's textures)
 		} programs[ProgramTypes];
-
-		//used by Scene to manage allocation:
-		Object **alloc_prev_next = nullptr;
-		Object *alloc_next = nullptr;
 	};
 
 	//"Lamp"s contain information about lights:
@@ -122,10 +173,6 @@ struct Scene {
 
 		//computed from the above:
 		glm::mat4 make_spot_projection() const;
-
-		//used by Scene to manage allocation:
-		Lamp **alloc_prev_next = nullptr;
-		Lamp *alloc_next = nullptr;
 	};
 
 	//"Camera"s contain information needed to view a scene:
@@ -142,10 +189,6 @@ struct Scene {
 		float near = 0.01f; //near plane
 		//computed from the above:
 		glm::mat4 make_projection() const;
-
-		//used by Scene to manage allocation:
-		Camera **alloc_prev_next = nullptr;
-		Camera *alloc_next = nullptr;
 	};
 
 	//------ functions to create / destroy scene things -----
@@ -171,29 +214,208 @@ struct Scene {
 	//Delete a camera:
 	void delete_camera(Camera *);
 
-	//used to manage allocated objects:
-	Transform *first_transform = nullptr;
-	Object *first_object = nullptr;
-	Lamp *first_lamp = nullptr;
-	Camera *first_camera = nullptr;
-	//(you shouldn't be manipulating these pointers directly
+	//allocated scene things, in pooled storage (iterate with, e.g., 'for (Scene::Object *object : scene.objects)'):
+	Pool< Transform > transforms;
+	Pool< Object > objects;
+	Pool< Lamp > lamps;
+	Pool< Camera > cameras;
+	//(you shouldn't be creating or destroying through these directly; use the functions above)
+
+	//Merge static objects into batches, so each batch draws with one call and needs no per-object matrices:
+	// objects marked 'is_static' that use the same programs, vaos, textures, and uniforms in every slot (and the same mesh range
+	// in every slot they have a program for) are replaced by a single new object on an identity transform.
+	// (groups of one are left alone; objects with set_uniforms callbacks are never merged; the merged objects' transforms are kept)
+	//The new objects copy their programs from the group, with bounds covering it, but still point at the first object's mesh:
+	// the caller should bake each batch's parts into a world-space mesh and set the new object's vao, start, and count to draw it.
+	struct StaticBatch {
+		Object *object = nullptr;
+		struct Part {
+			GLuint start = 0, count = 0; //mesh range of a merged object
+			glm::mat4 local_to_world = glm::mat4(1.0f); //where that object was
+		};
+		std::vector< Part > parts;
+	};
+	std::vector< StaticBatch > batch_static_objects();
+
+	//------ names ------
+
+	//Transform names are interned in a scene-wide table, so each distinct name is stored once and transforms hold a small id:
+	// (id 0 is the empty name, which new transforms start with)
+	uint32_t intern(std::string const &name); //id for 'name', adding it to the table if needed
+	uint32_t find_name(std::string const &name) const; //id for 'name', or -1U if it was never interned
+	std::string const &name(uint32_t id) const { return name_table[id]; }
+	std::string const &name(Transform const *transform) const { return name_table[transform->name]; }
+	//Rename a transform (use this rather than setting Transform::name, so the lookups below see the change):
+	void set_name(Transform *transform, std::string const &name);
+
+	//Transforms and the things attached to them, looked up by the transform's name, either exactly or by prefix:
+	// e.g., 'for (Scene::Lamp *lamp : scene.lamps_with_prefix("SpotLight"))'.
+	//Lookups go through an index that is rebuilt by the first lookup after anything is created, deleted, or renamed;
+	// after that they take a hash lookup (exact names) or a binary search (prefixes), and don't scan or allocate.
+	//Results are in name order, and are invalidated by the next create, delete, or rename.
+	template< typename T >
+	struct Named {
+		T * const *begin_ = nullptr;
+		T * const *end_ = nullptr;
+		T * const *begin() const { return begin_; }
+		T * const *end() const { return end_; }
+		size_t size() const { return end_ - begin_; }
+		bool empty() const { return begin_ == end_; }
+	};
+	Named< Transform > transforms_named(std::string const &name) const;
+	Named< Transform > transforms_with_prefix(std::string const &prefix) const;
+	Named< Object > objects_named(std::string const &name) const;
+	Named< Object > objects_with_prefix(std::string const &prefix) const;
+	Named< Lamp > lamps_named(std::string const &name) const;
+	Named< Lamp > lamps_with_prefix(std::string const &prefix) const;
+	Named< Camera > cameras_named(std::string const &name) const;
+	Named< Camera > cameras_with_prefix(std::string const &prefix) const;
+
+	//name table storage:
+	std::vector< std::string > name_table = std::vector< std::string >(1); //by id
+	std::unordered_map< std::string, uint32_t > name_ids; //id by name (for names other than the empty name)
+
+	//name index, rebuilt on demand by update_name_index():
+	struct NameIndex {
+		bool dirty = true;
+		std::vector< uint32_t > sorted; //name ids, sorted by name (so names with a given prefix are contiguous)
+		std::vector< uint32_t > rank; //position in 'sorted' of each name id
+		//each kind of thing, sorted by its transform's name's rank, where [first[r], first[r+1]) have the name 'sorted[r]':
+		std::vector< Transform * > transforms;
+		std::vector< uint32_t > first_transform;
+		std::vector< Object * > objects;
+		std::vector< uint32_t > first_object;
+		std::vector< Lamp * > lamps;
+		std::vector< uint32_t > first_lamp;
+		std::vector< Camera * > cameras;
+		std::vector< uint32_t > first_camera;
+	};
+	mutable NameIndex name_index;
+	void update_name_index() const;
+	//ranks [begin,end) of the names equal to 'name' or starting with 'prefix' (after updating the index):
+	void name_ranks(std::string const &name, uint32_t *begin, uint32_t *end) const;
+	void prefix_ranks(std::string const &prefix, uint32_t *begin, uint32_t *end) const;
 
 	//------ functions to traverse the scene ------
 
+	//Refresh the cached local_to_world / world_to_local matrices of every transform in one top-down pass:
+	// only transforms that changed (or whose ancestors changed) since the last call are recomputed.
+	//Call once per frame after updating transforms and before drawing, since draw() uses the cached matrices.
+	//Also brings object_tree up to date: objects with bounds are added, and those whose transforms changed are moved.
+	// (bounds are read when an object is added or its transform changes, so move an object's transform after changing its bounds)
+	//(const like draw(), since it only touches the transforms and the object tree, not the scene's structure)
+	void update_transforms() const;
+
+	//world-space boxes of the objects with bounds, for proximity, ray, and view queries (e.g., object_tree.query_overlap(box, fn));
+	// leaves hold the objects, and are only current as of the last update_transforms():
+	mutable AABBTree< Object const * > object_tree;
+
+	//(optional) counts from a draw() call, for tuning:
+	struct DrawStats {
+		uint32_t submitted = 0; //objects sent to OpenGL
+		uint32_t culled = 0; //objects with a program for the pass that were skipped as out of view
+		uint32_t pvs_culled = 0; //objects with a program for the pass that were skipped as hidden by the PVS
+		uint32_t occlusion_culled = 0; //objects in view that were skipped as hidden behind occluders
+		//state changes actually issued (draw() skips binds that wouldn't change anything):
+		uint32_t program_binds = 0;
+		uint32_t vao_binds = 0;
+		uint32_t texture_binds = 0; //(including unbinds at the end of the pass)
+		uint32_t active_texture_changes = 0;
+		uint32_t draw_calls = 0; //(an instanced draw counts once, no matter how many objects it covers)
+		uint32_t instanced_objects = 0; //objects drawn as part of an instanced draw
+		uint32_t uniform_calls = 0; //glUniform* calls for object matrices and instancing state (not counting set_uniforms)
+		uint32_t constants_binds = 0; //glBindBufferRange calls selecting an object's slice of the constants buffer
+		uint32_t triangles = 0; //triangles sent to OpenGL (after picking levels of detail)
+		uint32_t lod_objects = 0; //objects drawn at a coarser level of detail
+	};
+
+	//how far (as a fraction of a level's max_size) an object's projected size must go past a threshold before draw() switches level of detail:
+	float lod_hysteresis = 0.15f;
+
 	//Draw the scene from a given camera by computing appropriate matrices and sending all objects to OpenGL:
 	//"camera" must be non-null!
-	void draw(Camera const *camera, Object::ProgramType = Object::ProgramTypeDefault ) const;
+	// (if 'pvs' is given, objects hidden from the camera's cell are skipped;
+	//  if 'occlusion' is given -- already rendered from this camera -- objects hidden behind its occluders are skipped)
+	void draw(Camera const *camera, Object::ProgramType = Object::ProgramTypeDefault, DrawStats *stats = nullptr, PVS const *pvs = nullptr,
+		OcclusionBuffer const *occlusion = nullptr) const;
 
 	//Draw the scene from a given lamp by computing appropriate matrices and sending all objects to OpenGL:
 	//"lamp" must be non-null!
-	void draw(Lamp const *lamp, Object::ProgramType = Object::ProgramTypeDefault ) const;
+	// (if 'pvs' is given, objects hidden from the lamp's cell are skipped)
+	void draw(Lamp const *lamp, Object::ProgramType = Object::ProgramTypeDefault, DrawStats *stats = nullptr, PVS const *pvs = nullptr) const;
 
 	//More general draw function. Will render with a specified projection transformation and use programs in the given slot of all objects:
+	// objects with bounds entirely outside the view volume of 'world_to_clip' are skipped,
+	// as are objects with bounds entirely in cells that 'pvs' says can't be seen from 'pvs_cell' (if both are given),
+	// and objects with bounds entirely behind the occluders in 'occlusion' (which should have been rendered with the same world_to_clip).
 	void draw(
 		glm::mat4 const &world_to_clip,
-		Object::ProgramType program_type) const;
+		Object::ProgramType program_type,
+		DrawStats *stats = nullptr,
+		PVS const *pvs = nullptr,
+		uint32_t pvs_cell = -1U,
+		OcclusionBuffer const *occlusion = nullptr) const;
+
+	//scratch space for draw(): the pass's objects and their world-space bounding boxes, packed for culling four at a time,
+	// then a queue of the visible ones, sorted so objects sharing state are drawn together:
+	struct DrawList {
+		std::vector< Object const * > objects;
+		std::vector< float > center_x, center_y, center_z;
+		std::vector< float > extent_x, extent_y, extent_z; //half-sizes
+		std::vector< uint8_t > visible; //1 if in view, 0 if outside the view volume, 2 if in view but behind occluders
+
+		struct QueueItem {
+			//sort key, most significant first:
+			GLuint program;
+			GLuint vao;
+			GLuint textures[Object::ProgramInfo::TextureCount];
+			GLuint start, count; //(so objects drawing the same mesh end up next to each other, for instancing)
+			float depth; //(clip-space w of the bounding box center; near objects first, so later ones can be depth-rejected)
+			uint32_t index; //into 'objects'
+		};
+		std::vector< QueueItem > queue;
+
+		//per-object matrices for each queue entry, computed (possibly on worker threads) before anything is sent to OpenGL:
+		std::vector< glm::mat4 > object_to_clip; //world_to_clip * local_to_world
+		std::vector< glm::vec4 > normal_to_light; //three columns (xyz) per entry: inverse transpose of local_to_world's upper 3x3
+		//(object_to_light is just local_to_world, so it is read straight from the transform)
+		//fill object_to_clip and normal_to_light for every entry of 'queue' (on the worker pool, for long queues):
+		void compute_matrices(glm::mat4 const &world_to_clip);
+
+		//runs of queue items drawn by a single call:
+		struct Draw {
+			uint32_t begin, end; //range in 'queue'
+			uint32_t instance_base; //first instance in 'instances', if instanced
+			uint32_t constants; //slot in 'constants', if not instanced and the program reads the ObjectConstants block (else -1U)
+		};
+		std::vector< Draw > draws;
+		std::vector< glm::vec4 > instances; //per-instance transforms, in the layout described in ProgramInfo
+		std::vector< uint8_t > constants; //per-object constants, one ObjectConstants every 'object_constants_stride' bytes
+	};
+	mutable DrawList draw_list;
+
+	//per-object matrices, as read by programs with an "ObjectConstants" block:
+	// layout(std140) uniform ObjectConstants { mat4 object_to_clip; mat4x3 object_to_light; mat3 normal_to_light; };
+	struct ObjectConstants {
+		glm::mat4 object_to_clip;
+		glm::vec4 object_to_light[4]; //(std140 pads each mat4x3 column to a vec4)
+		glm::vec4 normal_to_light[3]; //(likewise for each mat3 column)
+	};
+	static_assert(sizeof(ObjectConstants) == 64 + 4*16 + 3*16, "ObjectConstants is laid out as in std140.");
+	enum : GLuint { ObjectConstantsBinding = 1 }; //uniform buffer binding point the block reads from
+
+	//ring buffer that per-object constants are streamed through; created by the first draw() that needs it:
+	// each draw() writes its constants just past the previous draw's (without waiting on the GPU), and orphans the buffer when it wraps.
+	mutable GLuint object_constants_buffer = 0;
+	mutable uint32_t object_constants_size = 0; //bytes
+	mutable uint32_t object_constants_head = 0; //first unwritten byte
+	mutable uint32_t object_constants_stride = 0; //sizeof(ObjectConstants), rounded up to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+
+	//buffer (and buffer texture) that per-instance transforms are streamed through; created by the first draw() that needs them:
+	mutable GLuint instance_buffer = 0;
+	mutable GLuint instance_tex = 0;
 
-	~Scene(); //destructor deallocates transforms, objects, cameras
+	~Scene(); //destructor deallocates transforms, objects, lamps, cameras
 
 	//add transforms/objects/cameras from a scene file:
 	// the 'on_object' callback gives you a chance to look up a mesh by name and make an object.
@@ -4,24 +4,61 @@
 
 #include "Spider.h"
 
-void Spider::update(float elapsed) {
-    glm::mat3 directions = glm::mat3_cast(transform->rotation);
-    float amt = 2.0f * elapsed;
+#include <cmath>
 
-    glm::vec3 step = glm::vec3(0.0f);
+void Spider::start(WalkMesh const &walk_mesh) {
+    walk_point = walk_mesh.start(transform->position);
+    height = glm::dot(transform->position - walk_mesh.world_point(walk_point), walk_mesh.world_normal(walk_point));
+}
 
-    step = amt * directions[1];
+void Spider::update(float elapsed, PathFinder &path_finder, WalkMesh::WalkPoint const &target, TriangleBVH const *line_of_sight) {
+    WalkMesh const &walk_mesh = path_finder.walk_mesh;
 
-    transform->position.x += step.x;
-    transform->position.y += step.y;
-    transform->position.z += step.z;
+    //with a clear view of the target, just go straight for it:
+    bool in_view = false;
+    if (line_of_sight) {
+        glm::vec3 eye = walk_mesh.world_point(walk_point) + eye_height * walk_mesh.world_normal(walk_point);
+        glm::vec3 target_point = walk_mesh.world_point(target);
+        glm::vec3 target_eye = target_point + eye_height * walk_mesh.world_normal(target);
+        if (!line_of_sight->occluded(eye, target_eye)) {
+            in_view = true;
+            path.assign(1, target_point);
+            next_waypoint = 0;
+            repath_timer = 0.0f; //re-plan as soon as the target drops out of view
+        }
+    }
 
-    distance += glm::length(step);
+    repath_timer -= elapsed;
+    if (!in_view && (repath_timer <= 0.0f || next_waypoint >= path.size())) {
+        repath_timer = 0.5f;
+        path_finder.find_path(walk_point, target, &path);
+        next_waypoint = 0;
+    }
 
-    if (distance >= max_distance) {
-        distance = 0;
-        forward = !forward;
-        transform->rotation *= glm::angleAxis(glm::radians(180.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    //follow the path:
+    float remaining = speed * elapsed;
+    glm::vec3 heading = glm::vec3(0.0f);
+    while (remaining > 0.0f && next_waypoint < path.size()) {
+        glm::vec3 step = path[next_waypoint] - walk_mesh.world_point(walk_point);
+        float length = glm::length(step);
+        if (length <= remaining) {
+            remaining -= length;
+            ++next_waypoint;
+        } else {
+            step *= remaining / length;
+            remaining = 0.0f;
+        }
+        walk_mesh.walk(walk_point, step);
+        heading += step;
     }
-}
 
+    glm::vec3 up = walk_mesh.world_normal(walk_point);
+    transform->position = walk_mesh.world_point(walk_point) + height * up;
+
+    //turn to face the direction of travel (the spider's local y axis is forward):
+    if (heading != glm::vec3(0.0f)) {
+        glm::vec3 forward = transform->rotation * glm::vec3(0.0f, 1.0f, 0.0f);
+        float angle = std::atan2(glm::dot(glm::cross(forward, heading), up), glm::dot(forward, heading));
+        transform->rotation = glm::normalize(glm::angleAxis(angle, up) * transform->rotation);
+    }
+}
@@ -6,6 +6,11 @@
 #define TERRIERSTEIN_SPIDER_H
 
 #include "Scene.hpp"
+#include "WalkMesh.hpp"
+#include "PathFinder.hpp"
+#include "TriangleBVH.hpp"
+
+#include <vector>
 
 struct Spider {
     Spider(){}
@@ -13,12 +18,22 @@ struct Spider {
         this->transform = t;
     }
 
-    void update(float elapsed);
+    //place the spider on the walkmesh (once the walkmesh is loaded):
+    void start(WalkMesh const &walk_mesh);
+
+    //chase 'target' across the walkmesh:
+    // (if 'line_of_sight' is given and the target is in plain view, the spider heads straight for it instead of planning a path)
+    void update(float elapsed, PathFinder &path_finder, WalkMesh::WalkPoint const &target, TriangleBVH const *line_of_sight = nullptr);
 
     Scene::Transform* transform;
-    bool forward = 0;
-    float distance = 0;
-    float max_distance = 10.0f;
+    WalkMesh::WalkPoint walk_point;
+    float height = 0.0f; //distance of transform above the walkmesh
+
+    std::vector< glm::vec3 > path; //waypoints toward the target
+    size_t next_waypoint = 0;
+    float repath_timer = 0.0f; //the target moves, so paths are re-planned periodically
+    float speed = 2.0f;
+    float eye_height = 0.5f; //height above the walkmesh from which the spider looks for the target
 };
 
 
@@ -0,0 +1,309 @@
+#include "TriangleBVH.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+uint32_t TriangleBVH::add_triangles(glm::vec3 const *positions, uint32_t count, glm::mat4 const &to_world) {
+	assert(count % 3 == 0 && "triangle soups should have three positions per triangle");
+	uint32_t first = uint32_t(triangles.size());
+	triangles.reserve(triangles.size() + count / 3);
+	for (uint32_t i = 0; i + 2 < count; i += 3) {
+		glm::vec3 a = glm::vec3(to_world * glm::vec4(positions[i+0], 1.0f));
+		glm::vec3 b = glm::vec3(to_world * glm::vec4(positions[i+1], 1.0f));
+		glm::vec3 c = glm::vec3(to_world * glm::vec4(positions[i+2], 1.0f));
+		triangles.emplace_back(Triangle{a, b - a, c - a});
+	}
+	return first;
+}
+
+uint32_t TriangleBVH::add_walkmesh(WalkMesh const &walk_mesh) {
+	uint32_t first = uint32_t(triangles.size());
+	triangles.reserve(triangles.size() + walk_mesh.triangles.size());
+	for (auto const &tri : walk_mesh.triangles) {
+		glm::vec3 const &a = walk_mesh.vertices[tri.x];
+		triangles.emplace_back(Triangle{a, walk_mesh.vertices[tri.y] - a, walk_mesh.vertices[tri.z] - a});
+	}
+	return first;
+}
+
+namespace {
+	//leaves are made once splitting stops paying off, but never hold more than this many triangles:
+	constexpr uint32_t MaxLeafSize = 8;
+	//candidate split planes per axis, for the surface area heuristic:
+	constexpr uint32_t SAHBins = 12;
+	//past this depth, splits are made at the median instead, which halves the count and keeps degenerate inputs from making tall trees:
+	constexpr uint32_t MaxSAHDepth = 32;
+	//median splits take at most 29 more levels to get 2^32 triangles down to MaxLeafSize, so no leaf is deeper than:
+	constexpr uint32_t MaxDepth = MaxSAHDepth + 29;
+
+	struct BuildEntry {
+		glm::vec3 min, max;
+		glm::vec3 centroid;
+		uint32_t triangle;
+	};
+
+	struct Bounds {
+		glm::vec3 min = glm::vec3(std::numeric_limits< float >::infinity());
+		glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+		void expand(glm::vec3 const &lo, glm::vec3 const &hi) {
+			min = glm::min(min, lo);
+			max = glm::max(max, hi);
+		}
+		float half_area() const {
+			glm::vec3 e = glm::max(max - min, glm::vec3(0.0f));
+			return e.x * e.y + e.y * e.z + e.z * e.x;
+		}
+	};
+
+	//builds the subtree (rooted at 'depth') over entries [begin,end) and returns the index of its root node:
+	uint32_t build_node(std::vector< TriangleBVH::Node > &nodes, std::vector< BuildEntry > &entries, uint32_t begin, uint32_t end, uint32_t depth) {
+		uint32_t index = uint32_t(nodes.size());
+		nodes.emplace_back();
+
+		Bounds bounds, centroid_bounds;
+		for (uint32_t i = begin; i < end; ++i) {
+			bounds.expand(entries[i].min, entries[i].max);
+			centroid_bounds.expand(entries[i].centroid, entries[i].centroid);
+		}
+		nodes[index].min = bounds.min;
+		nodes[index].max = bounds.max;
+
+		auto make_leaf = [&]() {
+			nodes[index].first = begin;
+			nodes[index].count = end - begin;
+			return index;
+		};
+
+		uint32_t count = end - begin;
+		if (count <= 2) return make_leaf();
+
+		if (depth >= MaxSAHDepth) {
+			if (count <= MaxLeafSize) return make_leaf();
+			//split at the median centroid along the widest axis:
+			glm::vec3 extent = centroid_bounds.max - centroid_bounds.min;
+			int axis = (extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2));
+			uint32_t mid = begin + count / 2;
+			std::nth_element(entries.begin() + begin, entries.begin() + mid, entries.begin() + end, [axis](BuildEntry const &a, BuildEntry const &b) {
+				return a.centroid[axis] < b.centroid[axis];
+			});
+			build_node(nodes, entries, begin, mid, depth + 1);
+			uint32_t second = build_node(nodes, entries, mid, end, depth + 1);
+			nodes[index].first = second;
+			nodes[index].count = 0;
+			return index;
+		}
+
+		//pick the split (among binned candidates on all three axes) with the lowest surface area heuristic cost:
+		glm::vec3 extent = centroid_bounds.max - centroid_bounds.min;
+		float best_cost = std::numeric_limits< float >::infinity();
+		int best_axis = -1;
+		uint32_t best_bin = 0;
+		for (int axis = 0; axis < 3; ++axis) {
+			if (extent[axis] <= 0.0f) continue;
+			float scale = SAHBins / extent[axis];
+
+			Bounds bins[SAHBins];
+			uint32_t counts[SAHBins] = {0};
+			for (uint32_t i = begin; i < end; ++i) {
+				uint32_t b = std::min(SAHBins - 1, uint32_t((entries[i].centroid[axis] - centroid_bounds.min[axis]) * scale));
+				bins[b].expand(entries[i].min, entries[i].max);
+				counts[b] += 1;
+			}
+
+			//sweep from the right to get the cost of everything past each split, then from the left:
+			float right_area[SAHBins];
+			uint32_t right_count[SAHBins];
+			Bounds right;
+			uint32_t right_total = 0;
+			for (uint32_t b = SAHBins - 1; b > 0; --b) {
+				right.expand(bins[b].min, bins[b].max);
+				right_total += counts[b];
+				right_area[b] = right.half_area();
+				right_count[b] = right_total;
+			}
+			Bounds left;
+			uint32_t left_total = 0;
+			for (uint32_t b = 1; b < SAHBins; ++b) { //split between bins b-1 and b
+				left.expand(bins[b-1].min, bins[b-1].max);
+				left_total += counts[b-1];
+				if (left_total == 0 || right_count[b] == 0) continue;
+				float cost = left.half_area() * left_total + right_area[b] * right_count[b];
+				if (cost < best_cost) {
+					best_cost = cost;
+					best_axis = axis;
+					best_bin = b;
+				}
+			}
+		}
+
+		//(cost of a leaf, in the same units -- traversal is assumed to cost about as much as one triangle test)
+		float leaf_cost = bounds.half_area() * count;
+		if (count <= MaxLeafSize && (best_axis == -1 || best_cost + bounds.half_area() >= leaf_cost)) {
+			return make_leaf();
+		}
+
+		uint32_t mid;
+		if (best_axis != -1) {
+			int axis = best_axis;
+			float scale = SAHBins / extent[axis];
+			float min = centroid_bounds.min[axis];
+			mid = uint32_t(std::partition(entries.begin() + begin, entries.begin() + end, [&](BuildEntry const &e) {
+				return std::min(SAHBins - 1, uint32_t((e.centroid[axis] - min) * scale)) < best_bin;
+			}) - entries.begin());
+		} else {
+			//all centroids coincide, so just split the list in half:
+			mid = begin + count / 2;
+		}
+		assert(begin < mid && mid < end);
+
+		build_node(nodes, entries, begin, mid, depth + 1); //first child immediately follows this node
+		uint32_t second = build_node(nodes, entries, mid, end, depth + 1);
+		nodes[index].first = second;
+		nodes[index].count = 0;
+		return index;
+	}
+
+	//distance along the ray to where it enters the box, or infinity if it misses the box (or enters past t_max):
+	inline float enter_box(glm::vec3 const &min, glm::vec3 const &max, glm::vec3 const &origin, glm::vec3 const &inv_direction, float t_max) {
+		glm::vec3 t0 = (min - origin) * inv_direction;
+		glm::vec3 t1 = (max - origin) * inv_direction;
+		glm::vec3 lo = glm::min(t0, t1);
+		glm::vec3 hi = glm::max(t0, t1);
+		float enter = std::max(std::max(lo.x, lo.y), std::max(lo.z, 0.0f));
+		float exit = std::min(std::min(hi.x, hi.y), std::min(hi.z, t_max));
+		return (enter <= exit ? enter : std::numeric_limits< float >::infinity());
+	}
+
+	//Moller-Trumbore ray/triangle intersection; returns distance along the ray, or infinity if not hit:
+	inline float intersect(TriangleBVH::Triangle const &tri, glm::vec3 const &origin, glm::vec3 const &direction) {
+		glm::vec3 p = glm::cross(direction, tri.ac);
+		float det = glm::dot(tri.ab, p);
+		if (det == 0.0f) return std::numeric_limits< float >::infinity(); //ray parallel to triangle
+		float inv_det = 1.0f / det;
+
+		glm::vec3 s = origin - tri.a;
+		float u = glm::dot(s, p) * inv_det;
+		if (u < 0.0f || u > 1.0f) return std::numeric_limits< float >::infinity();
+
+		glm::vec3 q = glm::cross(s, tri.ab);
+		float v = glm::dot(direction, q) * inv_det;
+		if (v < 0.0f || u + v > 1.0f) return std::numeric_limits< float >::infinity();
+
+		float t = glm::dot(tri.ac, q) * inv_det;
+		return (t >= 0.0f ? t : std::numeric_limits< float >::infinity());
+	}
+
+	//shared traversal for raycast() and occluded():
+	// if 'any_hit' is set, returns as soon as any triangle within t_max is found.
+	template< bool any_hit >
+	bool traverse(TriangleBVH const &bvh, glm::vec3 const &origin, glm::vec3 const &direction, float t_max, TriangleBVH::Hit *hit) {
+		if (bvh.nodes.empty()) return false;
+
+		glm::vec3 inv_direction = glm::vec3(1.0f) / direction;
+		float closest = t_max;
+		uint32_t closest_triangle = -1U;
+
+		struct Entry {
+			uint32_t node;
+			float enter;
+		};
+		//(at most one pending sibling per level, plus both children of the deepest interior node)
+		Entry stack[MaxDepth + 1];
+		uint32_t stack_size = 0;
+
+		float enter = enter_box(bvh.nodes[0].min, bvh.nodes[0].max, origin, inv_direction, closest);
+		if (enter == std::numeric_limits< float >::infinity()) return false;
+		stack[stack_size++] = Entry{0, enter};
+
+		while (stack_size > 0) {
+			Entry entry = stack[--stack_size];
+			if (entry.enter > closest) continue; //a closer hit was found since this node was pushed
+
+			TriangleBVH::Node const &node = bvh.nodes[entry.node];
+			if (node.count > 0) {
+				for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+					float t = intersect(bvh.leaf_triangles[i], origin, direction);
+					//(misses come back as infinity, which an unbounded ray's t_max would otherwise accept)
+					if (t <= closest && t != std::numeric_limits< float >::infinity()) {
+						closest = t;
+						closest_triangle = bvh.leaf_indices[i];
+						if (any_hit) break;
+					}
+				}
+				if (any_hit && closest_triangle != -1U) break;
+			} else {
+				uint32_t first_child = entry.node + 1;
+				uint32_t second_child = node.first;
+				float first_enter = enter_box(bvh.nodes[first_child].min, bvh.nodes[first_child].max, origin, inv_direction, closest);
+				float second_enter = enter_box(bvh.nodes[second_child].min, bvh.nodes[second_child].max, origin, inv_direction, closest);
+				//push the farther child first, so the nearer one is visited next:
+				if (second_enter < first_enter) {
+					std::swap(first_child, second_child);
+					std::swap(first_enter, second_enter);
+				}
+				assert(stack_size + 2 <= sizeof(stack) / sizeof(stack[0]));
+				if (second_enter != std::numeric_limits< float >::infinity()) stack[stack_size++] = Entry{second_child, second_enter};
+				if (first_enter != std::numeric_limits< float >::infinity()) stack[stack_size++] = Entry{first_child, first_enter};
+			}
+		}
+
+		if (closest_triangle == -1U) return false;
+		if (hit) {
+			hit->t = closest;
+			hit->triangle = closest_triangle;
+		}
+		return true;
+	}
+}
+
+void TriangleBVH::build() {
+	nodes.clear();
+	leaf_triangles.clear();
+	leaf_indices.clear();
+	if (triangles.empty()) return;
+
+	std::vector< BuildEntry > entries;
+	entries.reserve(triangles.size());
+	for (uint32_t i = 0; i < triangles.size(); ++i) {
+		Triangle const &tri = triangles[i];
+		glm::vec3 b = tri.a + tri.ab;
+		glm::vec3 c = tri.a + tri.ac;
+		BuildEntry entry;
+		entry.min = glm::min(tri.a, glm::min(b, c));
+		entry.max = glm::max(tri.a, glm::max(b, c));
+		entry.centroid = (tri.a + b + c) / 3.0f;
+		entry.triangle = i;
+		entries.emplace_back(entry);
+	}
+
+	nodes.reserve(2 * triangles.size());
+	build_node(nodes, entries, 0, uint32_t(entries.size()), 0);
+
+	leaf_triangles.reserve(entries.size());
+	leaf_indices.reserve(entries.size());
+	for (auto const &entry : entries) {
+		leaf_triangles.emplace_back(triangles[entry.triangle]);
+		leaf_indices.emplace_back(entry.triangle);
+	}
+}
+
+bool TriangleBVH::raycast(Ray const &ray, Hit *hit) const {
+	return traverse< false >(*this, ray.origin, ray.direction, ray.t_max, hit);
+}
+
+bool TriangleBVH::occluded(glm::vec3 const &from, glm::vec3 const &to) const {
+	return traverse< true >(*this, from, to - from, 1.0f, nullptr);
+}
+
+void TriangleBVH::raycast_many(Ray const *rays, size_t count, Hit *hits) const {
+	for (size_t i = 0; i < count; ++i) {
+		hits[i] = Hit();
+		traverse< false >(*this, rays[i].origin, rays[i].direction, rays[i].t_max, &hits[i]);
+	}
+}
+
+void TriangleBVH::occluded_many(glm::vec3 const *from, glm::vec3 const *to, size_t count, bool *results) const {
+	for (size_t i = 0; i < count; ++i) {
+		results[i] = traverse< true >(*this, from[i], to[i] - from[i], 1.0f, nullptr);
+	}
+}
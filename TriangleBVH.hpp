@@ -0,0 +1,63 @@
+#pragma once
+
+#include "WalkMesh.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstdint>
+
+//"TriangleBVH" answers ray and segment queries (raycasts, line-of-sight) against a static set of triangles:
+// add geometry (triangle soups, e.g. from MeshBuffer::positions, and/or walkmeshes), call build(), then query.
+//Triangles are numbered in the order they were added, so callers can tell what was hit from the add_*() return values.
+
+struct TriangleBVH {
+	//add triangles from a soup of positions (every three positions form a triangle), transformed by 'to_world':
+	// returns the index of the first triangle added.
+	uint32_t add_triangles(glm::vec3 const *positions, uint32_t count, glm::mat4 const &to_world = glm::mat4(1.0f));
+
+	//add all the triangles of a walkmesh:
+	// returns the index of the first triangle added.
+	uint32_t add_walkmesh(WalkMesh const &walk_mesh);
+
+	//(re-)build the hierarchy over all triangles added so far:
+	void build();
+
+	struct Ray {
+		glm::vec3 origin = glm::vec3(0.0f);
+		glm::vec3 direction = glm::vec3(0.0f, 0.0f, 1.0f); //need not be normalized; hit distances are in units of its length
+		float t_max = std::numeric_limits< float >::infinity(); //only hits with 0 <= t <= t_max count
+	};
+
+	struct Hit {
+		float t = std::numeric_limits< float >::infinity(); //hit point is origin + t * direction
+		uint32_t triangle = -1U; //-1U if nothing was hit
+	};
+
+	//closest hit along a ray:
+	// returns false if nothing was hit.
+	bool raycast(Ray const &ray, Hit *hit) const;
+
+	//is anything in the way between 'from' and 'to'?
+	// (stops at the first hit found, so is cheaper than raycast)
+	bool occluded(glm::vec3 const &from, glm::vec3 const &to) const;
+
+	//batched versions of the above, for submitting all of (e.g.) an AI tick's queries at once:
+	void raycast_many(Ray const *rays, size_t count, Hit *hits) const;
+	void occluded_many(glm::vec3 const *from, glm::vec3 const *to, size_t count, bool *results) const;
+
+	//triangles, stored as one vertex and two edges, ready for intersection tests:
+	struct Triangle {
+		glm::vec3 a;
+		glm::vec3 ab; //b - a
+		glm::vec3 ac; //c - a
+	};
+	static_assert(sizeof(Triangle) == 9*4, "Triangle is packed.");
+	std::vector< Triangle > triangles; //in the order added
+
+	//hierarchy (same layout as WalkMesh::BVHNode):
+	typedef WalkMesh::BVHNode Node;
+	std::vector< Node > nodes; //depth-first order, root at index zero
+	std::vector< Triangle > leaf_triangles; //copies of 'triangles', arranged so each leaf references a contiguous range
+	std::vector< uint32_t > leaf_indices; //index in 'triangles' of each entry in leaf_triangles
+};
@@ -1,14 +1,113 @@
 #include "WalkMesh.hpp"
 
 #include "read_chunk.hpp"
+#include "MappedFile.hpp"
 
 #include <glm/glm.hpp>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
 #include <fstream>
 #include <iostream>
 #include <string>
 
-WalkMesh::WalkMesh(std::string const &wok_filename) {
-	std::ifstream file(wok_filename, std::ios::binary);
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define WALKMESH_USE_SSE 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+	//WalkMesh::start() searches the bvh with a fixed-size stack, so no node may be deeper than this:
+	// (median splits get 2^32 triangles down to leaves of four in 30 levels, so built trees always fit)
+	constexpr uint32_t BVHMaxDepth = 30;
+
+	//checks that a (loaded) bvh is laid out as build_bvh() would: children after their parents, leaves within 'triangle_count', and no deeper than BVHMaxDepth:
+	bool bvh_is_valid(WalkMesh::View< WalkMesh::BVHNode > const &nodes, size_t triangle_count) {
+		if (nodes.empty()) return true;
+		struct Entry {
+			uint32_t node;
+			uint32_t depth;
+		};
+		std::vector< Entry > todo;
+		todo.emplace_back(Entry{0, 0});
+		while (!todo.empty()) {
+			Entry entry = todo.back();
+			todo.pop_back();
+			if (entry.depth > BVHMaxDepth) return false;
+			WalkMesh::BVHNode const &node = nodes[entry.node];
+			if (node.count > 0) {
+				if (node.first > triangle_count || node.count > triangle_count - node.first) return false;
+			} else {
+				//(children come strictly after their parent, so a malformed file can't make this loop forever)
+				if (node.first <= entry.node + 1 || node.first >= nodes.size()) return false;
+				todo.emplace_back(Entry{node.first, entry.depth + 1});
+				todo.emplace_back(Entry{entry.node + 1, entry.depth + 1});
+			}
+		}
+		return true;
+	}
+
+	//helpers for reading/writing WalkMesh::View's as chunks of a cooked walkmesh:
+	template< typename T >
+	void map_view(char const *&at, char const *end, std::string const &magic, WalkMesh::View< T > *view) {
+		T const *ptr = nullptr;
+		size_t count = 0;
+		map_chunk(at, end, magic, &ptr, &count);
+		view->point_at(ptr, count);
+	}
+
+	template< typename T >
+	void write_view(std::ostream &to, std::string const &magic, WalkMesh::View< T > const &view) {
+		write_chunk(to, magic, std::vector< T >(view.begin(), view.end()));
+	}
+}
+
+WalkMesh::WalkMesh(std::string const &filename) {
+	if (filename.size() >= 3 && filename.substr(filename.size()-3) == ".wc") {
+		mapped = new MappedFile(filename);
+		try {
+			char const *at = mapped->data;
+			char const *end = mapped->data + mapped->size;
+
+			map_view(at, end, "vtx0", &vertices);
+			map_view(at, end, "nrm0", &vertex_normals);
+			map_view(at, end, "tri0", &triangles);
+			map_view(at, end, "bxf0", &barycentric_transforms);
+			map_view(at, end, "pln0", &triangle_planes);
+			map_view(at, end, "adj0", &triangle_neighbors);
+			map_view(at, end, "bvn0", &bvh_nodes);
+			map_view(at, end, "bvt0", &bvh_triangles);
+			map_view(at, end, "pgn0", &polygons);
+			map_view(at, end, "pgv0", &polygon_vertices);
+			map_view(at, end, "pga0", &polygon_neighbors);
+			map_view(at, end, "tpg0", &triangle_polygons);
+
+			if (at != end) {
+				std::cerr << "WARNING: trailing data in walkmesh file '" << filename << "'" << std::endl;
+			}
+			if (vertex_normals.size() != vertices.size()
+			 || barycentric_transforms.size() != triangles.size()
+			 || triangle_planes.size() != triangles.size()
+			 || triangle_neighbors.size() != triangles.size()
+			 || bvh_triangles.size() != triangles.size()
+			 || (bvh_nodes.empty() != triangles.empty())
+			 || polygon_neighbors.size() != polygon_vertices.size()
+			 || triangle_polygons.size() != triangles.size()
+			 || (polygons.empty() != triangles.empty())) {
+				throw std::runtime_error("walkmesh file '" + filename + "' has inconsistent chunk sizes.");
+			}
+			if (!bvh_is_valid(bvh_nodes, bvh_triangles.size())) {
+				throw std::runtime_error("walkmesh file '" + filename + "' has a malformed bvh (or one deeper than " + std::to_string(BVHMaxDepth) + " levels).");
+			}
+		} catch (...) {
+			delete mapped;
+			mapped = nullptr;
+			throw;
+		}
+		return;
+	}
+
+	std::ifstream file(filename, std::ios::binary);
 
 
 	//read vertex data
@@ -24,25 +123,365 @@ WalkMesh::WalkMesh(std::string const &wok_filename) {
 	read_chunk(file, "vex0", &data);
 	std::cerr << "Finished reading vec0" << std::endl;
 
+	storage.vertices.reserve(data.size());
+	storage.vertex_normals.reserve(data.size());
 	for (auto vertex : data) {
-		this->vertices.emplace_back(vertex.position);
-		this->vertex_normals.emplace_back(vertex.normal);
+		storage.vertices.emplace_back(vertex.position);
+		storage.vertex_normals.emplace_back(vertex.normal);
 	}
+	vertices.point_at(storage.vertices);
+	vertex_normals.point_at(storage.vertex_normals);
 
     static_assert(sizeof(glm::uvec3) == 3*4 ,"Triangle is packed");
 
-    read_chunk(file, "tri0", &this->triangles);
+    read_chunk(file, "tri0", &storage.triangles);
+	triangles.point_at(storage.triangles);
 	std::cerr << "Finished reading tri0" << std::endl;
 
-    for (auto triangle : triangles) {
-        auto a = triangle[0];
-		auto b = triangle[1];
-		auto c = triangle[2];
+	build_barycentric_transforms();
+	build_neighbors();
+	build_bvh();
+	build_polygons();
+}
+
+WalkMesh::WalkMesh(std::vector< glm::vec3 > const &vertices_, std::vector< glm::uvec3 > const &triangles_) {
+	storage.vertices = vertices_;
+	storage.triangles = triangles_;
+	vertices.point_at(storage.vertices);
+	triangles.point_at(storage.triangles);
+
+	//no normals given, so use area-weighted face normals:
+	storage.vertex_normals.assign(vertices.size(), glm::vec3(0.0f));
+	for (auto const &tri : triangles) {
+		glm::vec3 n = glm::cross(vertices[tri.y] - vertices[tri.x], vertices[tri.z] - vertices[tri.x]);
+		storage.vertex_normals[tri.x] += n;
+		storage.vertex_normals[tri.y] += n;
+		storage.vertex_normals[tri.z] += n;
+	}
+	for (auto &n : storage.vertex_normals) {
+		float len = glm::length(n);
+		n = (len > 0.0f ? n / len : glm::vec3(0.0f, 0.0f, 1.0f));
+	}
+	vertex_normals.point_at(storage.vertex_normals);
+
+	build_barycentric_transforms();
+	build_neighbors();
+	build_bvh();
+	build_polygons();
+}
+
+WalkMesh::~WalkMesh() {
+	delete mapped;
+}
+
+void WalkMesh::save_cooked(std::string const &filename) const {
+	std::ofstream file(filename, std::ios::binary);
+
+	write_view(file, "vtx0", vertices);
+	write_view(file, "nrm0", vertex_normals);
+	write_view(file, "tri0", triangles);
+	write_view(file, "bxf0", barycentric_transforms);
+	write_view(file, "pln0", triangle_planes);
+	write_view(file, "adj0", triangle_neighbors);
+	write_view(file, "bvn0", bvh_nodes);
+	write_view(file, "bvt0", bvh_triangles);
+	write_view(file, "pgn0", polygons);
+	write_view(file, "pgv0", polygon_vertices);
+	write_view(file, "pga0", polygon_neighbors);
+	write_view(file, "tpg0", triangle_polygons);
+}
+
+void WalkMesh::build_barycentric_transforms() {
+	storage.barycentric_transforms.clear();
+	storage.triangle_planes.clear();
+	storage.barycentric_transforms.reserve(triangles.size());
+	storage.triangle_planes.reserve(triangles.size());
+
+	for (auto const &tri : triangles) {
+		glm::vec3 const &a = vertices[tri.x];
+		glm::vec3 edge0 = vertices[tri.y] - a;
+		glm::vec3 edge1 = vertices[tri.z] - a;
+
+		//barycentric weights (v,w) of b and c are dot(p - a, grad_v) and dot(p - a, grad_w), and u = 1 - v - w:
+		// (see http://realtimecollisiondetection.net/ for the derivation)
+		float d00 = glm::dot(edge0, edge0);
+		float d01 = glm::dot(edge0, edge1);
+		float d11 = glm::dot(edge1, edge1);
+		float denom = d00 * d11 - d01 * d01;
+		float inv_denom = (denom != 0.0f ? 1.0f / denom : 0.0f); //degenerate triangles get all weight on 'a'
+
+		glm::vec3 grad_v = (d11 * edge0 - d01 * edge1) * inv_denom;
+		glm::vec3 grad_w = (d00 * edge1 - d01 * edge0) * inv_denom;
+		glm::vec3 grad_u = -grad_v - grad_w;
+
+		storage.barycentric_transforms.emplace_back(
+			glm::vec3(grad_u.x, grad_v.x, grad_w.x),
+			glm::vec3(grad_u.y, grad_v.y, grad_w.y),
+			glm::vec3(grad_u.z, grad_v.z, grad_w.z),
+			glm::vec3(1.0f - glm::dot(grad_u, a), -glm::dot(grad_v, a), -glm::dot(grad_w, a))
+		);
+
+		glm::vec3 normal = glm::cross(edge0, edge1);
+		float length = glm::length(normal);
+		normal = (length != 0.0f ? normal / length : glm::vec3(0.0f, 0.0f, 1.0f));
+		storage.triangle_planes.emplace_back(normal, -glm::dot(normal, a));
+	}
+
+	barycentric_transforms.point_at(storage.barycentric_transforms);
+	triangle_planes.point_at(storage.triangle_planes);
+}
+
+void WalkMesh::build_neighbors() {
+	//each directed edge [a,b] of each triangle, keyed so that sorting groups edges by start vertex:
+	struct EdgeEntry {
+		uint64_t key; //(a << 32) | b
+		uint32_t triangle;
+	};
+	auto make_key = [](uint32_t a, uint32_t b) {
+		return (uint64_t(a) << 32) | uint64_t(b);
+	};
+
+	std::vector< EdgeEntry > edges;
+	edges.reserve(3 * triangles.size());
+	for (uint32_t t = 0; t < triangles.size(); ++t) {
+		glm::uvec3 const &tri = triangles[t];
+		edges.emplace_back(EdgeEntry{make_key(tri.x, tri.y), t});
+		edges.emplace_back(EdgeEntry{make_key(tri.y, tri.z), t});
+		edges.emplace_back(EdgeEntry{make_key(tri.z, tri.x), t});
+	}
+	std::sort(edges.begin(), edges.end(), [](EdgeEntry const &a, EdgeEntry const &b) {
+		return a.key < b.key;
+	});
+
+	//the triangle across edge [a,b] is the one that contains the reversed edge [b,a]:
+	auto find_across = [&](uint32_t a, uint32_t b) -> uint32_t {
+		uint64_t key = make_key(b, a);
+		auto f = std::lower_bound(edges.begin(), edges.end(), key, [](EdgeEntry const &e, uint64_t k) {
+			return e.key < k;
+		});
+		if (f == edges.end() || f->key != key) return -1U;
+		return f->triangle;
+	};
+
+	storage.triangle_neighbors.clear();
+	storage.triangle_neighbors.reserve(triangles.size());
+	for (auto const &tri : triangles) {
+		storage.triangle_neighbors.emplace_back(
+			find_across(tri.x, tri.y),
+			find_across(tri.y, tri.z),
+			find_across(tri.z, tri.x)
+		);
+	}
+	triangle_neighbors.point_at(storage.triangle_neighbors);
+}
+
+namespace {
+	//triangles per leaf; larger leaves mean a shallower tree but more closest-point tests per visited leaf:
+	constexpr uint32_t BVHLeafSize = 4;
+
+	struct BVHBuildEntry {
+		glm::vec3 min, max;
+		glm::vec3 centroid;
+		uint32_t triangle;
+	};
+
+	//builds the subtree (rooted at 'depth') over entries [begin,end) and returns the index of its root node:
+	uint32_t build_bvh_node(std::vector< WalkMesh::BVHNode > &nodes, std::vector< BVHBuildEntry > &entries, uint32_t begin, uint32_t end, uint32_t depth) {
+		if (depth > BVHMaxDepth) throw std::runtime_error("walkmesh bvh would be deeper than " + std::to_string(BVHMaxDepth) + " levels.");
+		uint32_t index = uint32_t(nodes.size());
+		nodes.emplace_back();
+
+		glm::vec3 min = glm::vec3(std::numeric_limits< float >::infinity());
+		glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+		glm::vec3 centroid_min = min;
+		glm::vec3 centroid_max = max;
+		for (uint32_t i = begin; i < end; ++i) {
+			min = glm::min(min, entries[i].min);
+			max = glm::max(max, entries[i].max);
+			centroid_min = glm::min(centroid_min, entries[i].centroid);
+			centroid_max = glm::max(centroid_max, entries[i].centroid);
+		}
+		nodes[index].min = min;
+		nodes[index].max = max;
+
+		if (end - begin <= BVHLeafSize) {
+			nodes[index].first = begin;
+			nodes[index].count = end - begin;
+			return index;
+		}
+
+		//split at the median centroid along the widest axis:
+		glm::vec3 extent = centroid_max - centroid_min;
+		int axis = 0;
+		if (extent.y > extent[axis]) axis = 1;
+		if (extent.z > extent[axis]) axis = 2;
+
+		uint32_t mid = begin + (end - begin) / 2;
+		std::nth_element(entries.begin() + begin, entries.begin() + mid, entries.begin() + end,
+			[axis](BVHBuildEntry const &a, BVHBuildEntry const &b) {
+				return a.centroid[axis] < b.centroid[axis];
+			});
+
+		build_bvh_node(nodes, entries, begin, mid, depth + 1); //first child immediately follows this node
+		uint32_t second = build_bvh_node(nodes, entries, mid, end, depth + 1);
+		nodes[index].first = second;
+		nodes[index].count = 0;
+		return index;
+	}
+
+	//squared distance from a point to an axis-aligned box (zero if inside):
+	float distance2_to_box(glm::vec3 const &point, glm::vec3 const &min, glm::vec3 const &max) {
+		glm::vec3 delta = glm::max(glm::max(min - point, point - max), glm::vec3(0.0f));
+		return glm::dot(delta, delta);
+	}
+
+	//change in barycentric weights caused by moving by 'step' (only the linear part of the transform matters):
+	inline glm::vec3 barycentric_step(glm::mat4x3 const &xf, glm::vec3 const &step) {
+		return xf[0] * step.x + xf[1] * step.y + xf[2] * step.z;
+	}
+
+	//barycentric weights of (the projection onto the triangle's plane of) 'point':
+	inline glm::vec3 barycentric_weights(glm::mat4x3 const &xf, glm::vec3 const &point) {
+		return barycentric_step(xf, point) + xf[3];
+	}
+}
+
+void WalkMesh::build_bvh() {
+	storage.bvh_nodes.clear();
+	storage.bvh_triangles.clear();
+	bvh_nodes.point_at(storage.bvh_nodes);
+	bvh_triangles.point_at(storage.bvh_triangles);
+	if (triangles.empty()) return;
+
+	std::vector< BVHBuildEntry > entries;
+	entries.reserve(triangles.size());
+	for (uint32_t i = 0; i < triangles.size(); ++i) {
+		glm::vec3 const &a = vertices[triangles[i].x];
+		glm::vec3 const &b = vertices[triangles[i].y];
+		glm::vec3 const &c = vertices[triangles[i].z];
+		BVHBuildEntry entry;
+		entry.min = glm::min(a, glm::min(b, c));
+		entry.max = glm::max(a, glm::max(b, c));
+		entry.centroid = (a + b + c) / 3.0f;
+		entry.triangle = i;
+		entries.emplace_back(entry);
+	}
+
+	storage.bvh_nodes.reserve(2 * (triangles.size() / BVHLeafSize + 1));
+	build_bvh_node(storage.bvh_nodes, entries, 0, uint32_t(entries.size()), 0);
+
+	storage.bvh_triangles.reserve(entries.size());
+	for (auto const &entry : entries) {
+		storage.bvh_triangles.emplace_back(entry.triangle);
+	}
+
+	bvh_nodes.point_at(storage.bvh_nodes);
+	bvh_triangles.point_at(storage.bvh_triangles);
+}
+
+void WalkMesh::build_polygons() {
+	//triangles are merged if their planes agree to within these tolerances:
+	constexpr float NormalTolerance = 1e-4f; //1 - cos(angle between normals)
+	constexpr float HeightTolerance = 1e-3f; //distance of the added vertex from the polygon's plane
+
+	storage.polygons.clear();
+	storage.polygon_vertices.clear();
+	storage.polygon_neighbors.clear();
+	storage.triangle_polygons.assign(triangles.size(), -1U);
+
+	//while growing a polygon, each boundary edge remembers the triangle (and which of its edges) it came from:
+	struct Edge {
+		uint32_t start; //vertex the edge starts at (it ends at the next edge's start)
+		uint32_t triangle;
+		uint32_t k; //edge [tri[k], tri[k+1]] of 'triangle'
+	};
+	std::vector< Edge > edges;
+	std::vector< std::vector< Edge > > polygon_edges;
+
+	//is the corner a -> b -> c convex (or straight) when viewed from above 'normal'?
+	auto convex = [this](uint32_t a, uint32_t b, uint32_t c, glm::vec3 const &normal) {
+		glm::vec3 ab = vertices[b] - vertices[a];
+		glm::vec3 bc = vertices[c] - vertices[b];
+		return glm::dot(glm::cross(ab, bc), normal) >= -1e-6f * glm::length(ab) * glm::length(bc);
+	};
+
+	//grow polygons greedily: starting from each unclaimed triangle, absorb coplanar unclaimed neighbors while the polygon stays convex:
+	for (uint32_t seed = 0; seed < triangles.size(); ++seed) {
+		if (storage.triangle_polygons[seed] != -1U) continue;
+		uint32_t polygon = uint32_t(polygon_edges.size());
+		storage.triangle_polygons[seed] = polygon;
+
+		glm::vec4 const &plane = triangle_planes[seed];
+		glm::vec3 normal = glm::vec3(plane);
+		edges.clear();
+		for (uint32_t k = 0; k < 3; ++k) {
+			edges.emplace_back(Edge{triangles[seed][k], seed, k});
+		}
 
-		next_vertex[glm::uvec2(a, b)] = c;
-		next_vertex[glm::uvec2(b, c)] = a;
-		next_vertex[glm::uvec2(c, a)] = b;
-    }
+		for (uint32_t i = 0; i < edges.size(); /* advanced below */) {
+			Edge const &edge = edges[i];
+			uint32_t across = triangle_neighbors[edge.triangle][edge.k];
+			bool absorbed = false;
+			if (across != -1U && storage.triangle_polygons[across] == -1U
+			 && glm::dot(glm::vec3(triangle_planes[across]), normal) >= 1.0f - NormalTolerance) {
+				//the neighbor holds the reversed edge [end,start] as its edge j, so its remaining vertex is tri[j+2]:
+				glm::uvec3 const &tri = triangles[across];
+				uint32_t j = 0;
+				while (j < 3 && triangle_neighbors[across][j] != edge.triangle) ++j;
+				assert(j < 3 && "triangle adjacency should be symmetric");
+				uint32_t start = edge.start;
+				uint32_t end = edges[(i + 1) % edges.size()].start;
+				uint32_t apex = tri[(j + 2) % 3];
+
+				bool fits = std::abs(glm::dot(normal, vertices[apex]) + plane.w) <= HeightTolerance;
+				for (auto const &e : edges) {
+					if (e.start == apex) fits = false; //would pinch the polygon around a vertex
+				}
+				fits = fits
+					&& convex(edges[(i + edges.size() - 1) % edges.size()].start, start, apex, normal)
+					&& convex(start, apex, end, normal)
+					&& convex(apex, end, edges[(i + 2) % edges.size()].start, normal);
+
+				if (fits) {
+					storage.triangle_polygons[across] = polygon;
+					edges[i] = Edge{start, across, (j + 1) % 3};
+					edges.insert(edges.begin() + i + 1, Edge{apex, across, (j + 2) % 3});
+					absorbed = true;
+				}
+			}
+			if (!absorbed) ++i; //(otherwise, the new edge at 'i' gets a look)
+		}
+		polygon_edges.emplace_back(edges);
+	}
+
+	//record corners and neighbors, dropping corners along straight runs of edges that all border the same polygon:
+	storage.polygons.reserve(polygon_edges.size());
+	for (auto const &edges : polygon_edges) {
+		Polygon polygon;
+		polygon.begin = uint32_t(storage.polygon_vertices.size());
+		auto neighbor = [&](Edge const &e) {
+			uint32_t across = triangle_neighbors[e.triangle][e.k];
+			return (across == -1U ? -1U : storage.triangle_polygons[across]);
+		};
+		for (uint32_t i = 0; i < edges.size(); ++i) {
+			Edge const &prev = edges[(i + edges.size() - 1) % edges.size()];
+			Edge const &next = edges[(i + 1) % edges.size()];
+			glm::vec3 in = vertices[edges[i].start] - vertices[prev.start];
+			glm::vec3 out = vertices[next.start] - vertices[edges[i].start];
+			bool straight = glm::length(glm::cross(in, out)) <= 1e-6f * glm::length(in) * glm::length(out)
+				&& glm::dot(in, out) > 0.0f;
+			if (straight && neighbor(prev) == neighbor(edges[i])) continue;
+			storage.polygon_vertices.emplace_back(edges[i].start);
+			storage.polygon_neighbors.emplace_back(neighbor(edges[i]));
+		}
+		polygon.end = uint32_t(storage.polygon_vertices.size());
+		storage.polygons.emplace_back(polygon);
+	}
+
+	polygons.point_at(storage.polygons);
+	polygon_vertices.point_at(storage.polygon_vertices);
+	polygon_neighbors.point_at(storage.polygon_neighbors);
+	triangle_polygons.point_at(storage.triangle_polygons);
 }
 
 // Referenced from https://www.gamedev.net/forums/topic/552906-closest-point-on-triangle/
@@ -120,143 +559,263 @@ glm::vec3 closestPointOnTriangle(const glm::vec3& vertex_a, const glm::vec3& ver
 }
 
 
-// Referenced from: https://gamedev.stackexchange.com/questions/23743/whats-the-most-efficient-way-to-find-barycentric-coordinates
-// http://realtimecollisiondetection.net/
-glm::vec3 calculate_barycentric_coord(glm::vec3 vertex_a, glm::vec3 vertex_b, glm::vec3 vertex_c, glm::vec3 point) {
-    glm::vec3 edge0 = vertex_b - vertex_a;
-    glm::vec3 edge1 = vertex_c - vertex_a;
-    glm::vec3 v0 = point - vertex_a;
-
-    float d00 = glm::dot(edge0, edge0);
-    float d01 = glm::dot(edge0, edge1);
-    float d11 = glm::dot(edge1, edge1);
-    float d20 = glm::dot(v0, edge0);
-    float d21 = glm::dot(v0, edge1);
-
-    float denom = d00 * d11 - d01 * d01;
-
-    float v = (d11 * d20 - d01 * d21) / denom;
-    float w = (d00 * d21 - d01 * d20) / denom;
-    float u = 1.0f - v - w;
-
-    return glm::vec3(u,v,w);
-}
-
 WalkMesh::WalkPoint WalkMesh::start(glm::vec3 const &world_point) const {
 	WalkPoint closest;
+	if (bvh_nodes.empty()) return closest;
+
+	//branch-and-bound search of the bvh, visiting the nearer child first so that distant subtrees are pruned:
+	// (ties go to the lowest triangle index, as with a linear scan, so that overlapping copies of a surface resolve consistently)
+	float min_distance2 = std::numeric_limits< float >::infinity();
+	glm::vec3 closest_point = glm::vec3(0.0f);
+
+	//(at most one pending sibling per level, plus both children of the deepest interior node; loading and building both enforce BVHMaxDepth)
+	uint32_t stack[BVHMaxDepth + 1];
+	uint32_t stack_size = 0;
+	stack[stack_size++] = 0;
+	while (stack_size > 0) {
+		BVHNode const &node = bvh_nodes[stack[--stack_size]];
+		if (distance2_to_box(world_point, node.min, node.max) > min_distance2) continue;
+
+		if (node.count > 0) {
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				uint32_t index = bvh_triangles[i];
+
+				//no point on the triangle is closer than its plane:
+				glm::vec4 const &plane = triangle_planes[index];
+				float height = glm::dot(glm::vec3(plane), world_point) + plane.w;
+				if (height * height > min_distance2) continue;
+
+				//if the point projects into the triangle, the projection is the closest point:
+				glm::vec3 point;
+				glm::vec3 weights = barycentric_weights(barycentric_transforms[index], world_point);
+				if (weights.x >= 0.0f && weights.y >= 0.0f && weights.z >= 0.0f) {
+					point = world_point - height * glm::vec3(plane);
+				} else {
+					glm::uvec3 const &triangle = this->triangles[index];
+					point = closestPointOnTriangle(vertices[triangle[0]], vertices[triangle[1]], vertices[triangle[2]], world_point);
+				}
 
-	float min_distance = MAXFLOAT;
-	for (auto &triangle : this->triangles) {
-
-		const glm::vec3 &vertex_a = this->vertices[triangle[0]];
-		const glm::vec3 &vertex_b = this->vertices[triangle[1]];
-		const glm::vec3 &vertex_c = this->vertices[triangle[2]];
-
-	    glm::vec3 closest_point = closestPointOnTriangle(vertex_a, vertex_b, vertex_c, world_point);
-
-	    float distance = glm::distance(closest_point, world_point);
+				float distance2 = glm::dot(point - world_point, point - world_point);
 
-	    if (distance < min_distance) {
-	    	min_distance = distance;
-	    	closest.triangle = triangle;
-	    	closest.weights = calculate_barycentric_coord(vertex_a, vertex_b, vertex_c, closest_point);
-	    }
+				if (distance2 < min_distance2 || (distance2 == min_distance2 && index < closest.triangle_index)) {
+					min_distance2 = distance2;
+					closest_point = point;
+					closest.triangle_index = index;
+				}
+			}
+		} else {
+			uint32_t first_child = uint32_t(&node - &bvh_nodes[0]) + 1;
+			uint32_t second_child = node.first;
+			if (distance2_to_box(world_point, bvh_nodes[second_child].min, bvh_nodes[second_child].max)
+			  < distance2_to_box(world_point, bvh_nodes[first_child].min, bvh_nodes[first_child].max)) {
+				std::swap(first_child, second_child);
+			}
+			assert(stack_size + 2 <= sizeof(stack) / sizeof(stack[0]));
+			stack[stack_size++] = second_child;
+			stack[stack_size++] = first_child;
+		}
 	}
 
+	closest.triangle = triangles[closest.triangle_index];
+	closest.weights = glm::max(barycentric_weights(barycentric_transforms[closest.triangle_index], closest_point), glm::vec3(0.0f));
+	closest.weights /= (closest.weights.x + closest.weights.y + closest.weights.z);
+
 	return closest;
 }
 
 
 void WalkMesh::walk(WalkPoint &wp, glm::vec3 const &step) const {
-	glm::vec3 weights_step;
-
-	auto &vertex_a = this->vertices[wp.triangle[0]];
-	auto &vertex_b = this->vertices[wp.triangle[1]];
-	auto &vertex_c = this->vertices[wp.triangle[2]];
+	//Trace the step across as many triangles as it passes through.
+	// Each iteration either finishes inside the current triangle, moves onto the neighbor across the first edge hit,
+	// or (at a boundary edge) slides along that edge, so the cost is proportional to the number of triangles crossed.
+
+	glm::vec3 remaining = step; //world-space part of the step not yet taken
+	uint32_t came_from = -1U; //triangle the point just left (used to detect ping-ponging across an edge)
+	int32_t sliding_along = -1; //boundary edge (by opposite vertex) being slid along in this triangle, or -1
+	uint32_t vertex_hops = 0; //crossings made through a vertex instead of sliding (limited, so a fan of triangles can't be circled forever)
+
+	for (uint32_t iter = 0; iter <= triangles.size(); ++iter) {
+		glm::uvec3 const &tri = triangles[wp.triangle_index];
+		glm::vec3 delta = barycentric_step(barycentric_transforms[wp.triangle_index], remaining);
+		if (sliding_along != -1) delta[sliding_along] = 0.0f; //stay exactly on the edge being slid along
+
+		//find the first barycentric coordinate to reach zero:
+		float t = 1.0f;
+		int32_t exit = -1;
+		for (int32_t k = 0; k < 3; ++k) {
+			if (delta[k] < 0.0f) {
+				float t_k = std::max(0.0f, -wp.weights[k] / delta[k]);
+				if (t_k < t) {
+					t = t_k;
+					exit = k;
+				}
+			}
+		}
 
-	auto old_point= vertex_a * wp.weights.x + vertex_b * wp.weights.y + vertex_c * wp.weights.z;
-	auto new_point = old_point + step;
+		if (exit == -1) { //step ends inside this triangle
+			wp.weights += delta;
+			break;
+		}
 
-	auto barycoord  = calculate_barycentric_coord(vertex_a, vertex_b, vertex_c, new_point);
+		//move to the edge opposite vertex 'exit':
+		wp.weights += t * delta;
+		wp.weights[exit] = 0.0f;
+		wp.weights = glm::max(wp.weights, glm::vec3(0.0f));
+		wp.weights /= (wp.weights.x + wp.weights.y + wp.weights.z);
+		remaining *= (1.0f - t);
+
+		//edge opposite vertex k runs from vertex k+1 to vertex k+2; triangle_neighbors stores [a,b],[b,c],[c,a]:
+		uint32_t edge_start = (exit + 1) % 3;
+		uint32_t edge_end = (exit + 2) % 3;
+		uint32_t neighbor = triangle_neighbors[wp.triangle_index][edge_start];
+
+		//at a vertex, the step may be blocked by one edge but free to carry on across the other -- e.g., when moving along an
+		// interior edge whose far end meets a wall -- so prefer crossing an interior edge through the vertex to sliding:
+		if (neighbor == -1U && vertex_hops < 8) {
+			for (int32_t k = 0; k < 3; ++k) {
+				uint32_t across = triangle_neighbors[wp.triangle_index][(k + 1) % 3];
+				if (k != exit && wp.weights[k] < 1e-4f && across != -1U && across != came_from) {
+					exit = k;
+					edge_start = (exit + 1) % 3;
+					edge_end = (exit + 2) % 3;
+					neighbor = across;
+					++vertex_hops;
+					break;
+				}
+			}
+		}
 
-	weights_step = barycoord - wp.weights;
+		if (neighbor == -1U) {
+			//boundary edge: slide along it (giving up if already sliding along another edge of this triangle -- i.e., in a corner):
+			if (sliding_along != -1) break;
+			glm::vec3 along = vertices[tri[edge_end]] - vertices[tri[edge_start]];
+			remaining = along * (glm::dot(remaining, along) / glm::dot(along, along));
+			sliding_along = exit;
+			continue;
+		}
 
-	float t = 0.0f;
+		if (t == 0.0f && neighbor == came_from) break; //would bounce straight back across the edge just crossed
 
-	glm::vec3 sum_weight = wp.weights;
+		//express the point (which is on the shared edge) in terms of the neighbor's vertices:
+		glm::uvec3 const &next = triangles[neighbor];
+		glm::vec3 weights = glm::vec3(0.0f);
+		for (uint32_t j = 0; j < 3; ++j) {
+			if (next[j] == tri[edge_start]) weights[j] = wp.weights[edge_start];
+			if (next[j] == tri[edge_end]) weights[j] = wp.weights[edge_end];
+		}
 
-	while ((sum_weight.x > -0.0001 && sum_weight.y > -0.0001 && sum_weight.z > -0.0001)  && t < 1.0f) {
-		t += 0.1;
-	    sum_weight = wp.weights + t * weights_step;
+		came_from = wp.triangle_index;
+		sliding_along = -1;
+		wp.triangle_index = neighbor;
+		wp.triangle = next;
+		wp.weights = weights;
 	}
+}
 
-	if (sum_weight.x <= 0 && sum_weight.y <= 0) {
-		sum_weight.x = 0.1;
-	}
-	else if (sum_weight.x <= 0 && sum_weight.z <= 0) {
-		sum_weight.x = 0.1;
-	}
-	else if (sum_weight.y <= 0 && sum_weight.z <= 0) {
-		sum_weight.z = 0.1;
-	}
+void WalkMesh::WalkPoints::push_back(WalkPoint const &wp) {
+	triangle_index.emplace_back(wp.triangle_index);
+	weight_x.emplace_back(wp.weights.x);
+	weight_y.emplace_back(wp.weights.y);
+	weight_z.emplace_back(wp.weights.z);
+}
+
+void WalkMesh::WalkPoints::set(size_t i, WalkPoint const &wp) {
+	triangle_index[i] = wp.triangle_index;
+	weight_x[i] = wp.weights.x;
+	weight_y[i] = wp.weights.y;
+	weight_z[i] = wp.weights.z;
+}
 
-	if (t >= 1.0f) { //if a triangle edge is not crossed
-		wp.weights += weights_step;
-	} else { //if a triangle edge is crossed
+WalkMesh::WalkPoint WalkMesh::get(WalkPoints const &wps, size_t i) const {
+	WalkPoint wp;
+	wp.triangle_index = wps.triangle_index[i];
+	wp.triangle = triangles[wp.triangle_index];
+	wp.weights = glm::vec3(wps.weight_x[i], wps.weight_y[i], wps.weight_z[i]);
+	return wp;
+}
 
-		uint32_t edge_a;
-		uint32_t edge_b;
-		uint32_t oppo_vertex;
+void WalkMesh::walk_many(WalkPoints &wps, float const *step_x, float const *step_y, float const *step_z) const {
+	size_t const count = wps.size();
+	uint32_t const *index = wps.triangle_index.data();
+	float *wx = wps.weight_x.data();
+	float *wy = wps.weight_y.data();
+	float *wz = wps.weight_z.data();
+
+	//crossing an edge is rare per step, so it is handled one point at a time:
+	auto slow_path = [&](size_t i) {
+		WalkPoint wp = get(wps, i);
+		walk(wp, glm::vec3(step_x[i], step_y[i], step_z[i]));
+		wps.set(i, wp);
+	};
 
-		if (sum_weight.x <= 0) {
-			sum_weight.x = 0;
-			edge_a = wp.triangle.z;
-			edge_b = wp.triangle.y;
-			oppo_vertex = wp.triangle.x;
-		}
-		if (sum_weight.y <= 0) {
-			sum_weight.y = 0;
-			edge_a = wp.triangle.x;
-			edge_b = wp.triangle.z;
-			oppo_vertex = wp.triangle.y;
+	size_t i = 0;
+
+#ifdef WALKMESH_USE_SSE
+	//fast path: four points at a time, in barycentric space.
+	// The change in barycentric coordinates is the linear part of the triangle's barycentric transform applied to the step.
+	for (; i + 4 <= count; i += 4) {
+		alignas(16) float m[9][4]; //m[3*c+r][lane] is column c, row r of lane's transform
+		for (uint32_t l = 0; l < 4; ++l) {
+			glm::mat4x3 const &xf = barycentric_transforms[index[i + l]];
+			for (uint32_t c = 0; c < 3; ++c) {
+				m[3*c+0][l] = xf[c].x;
+				m[3*c+1][l] = xf[c].y;
+				m[3*c+2][l] = xf[c].z;
+			}
 		}
-		if (sum_weight.z <= 0) {
-			sum_weight.z = 0;
-			edge_a = wp.triangle.y;
-			edge_b = wp.triangle.x;
-			oppo_vertex = wp.triangle.z;
+		__m128 Sx = _mm_loadu_ps(step_x + i), Sy = _mm_loadu_ps(step_y + i), Sz = _mm_loadu_ps(step_z + i);
+
+		auto row = [&m,&Sx,&Sy,&Sz](uint32_t r) {
+			return _mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(_mm_load_ps(m[0+r]), Sx),
+				_mm_mul_ps(_mm_load_ps(m[3+r]), Sy)),
+				_mm_mul_ps(_mm_load_ps(m[6+r]), Sz));
+		};
+		__m128 du = row(0);
+		__m128 dv = row(1);
+		__m128 dw = row(2);
+
+		__m128 Wx = _mm_add_ps(_mm_loadu_ps(wx + i), du);
+		__m128 Wy = _mm_add_ps(_mm_loadu_ps(wy + i), dv);
+		__m128 Wz = _mm_add_ps(_mm_loadu_ps(wz + i), dw);
+
+		__m128 zero = _mm_setzero_ps();
+		__m128 inside = _mm_and_ps(_mm_cmpge_ps(Wx, zero), _mm_and_ps(_mm_cmpge_ps(Wy, zero), _mm_cmpge_ps(Wz, zero)));
+		int inside_mask = _mm_movemask_ps(inside);
+
+		if (inside_mask == 0xf) {
+			_mm_storeu_ps(wx + i, Wx);
+			_mm_storeu_ps(wy + i, Wy);
+			_mm_storeu_ps(wz + i, Wz);
+		} else {
+			alignas(16) float nx[4], ny[4], nz[4];
+			_mm_store_ps(nx, Wx);
+			_mm_store_ps(ny, Wy);
+			_mm_store_ps(nz, Wz);
+			for (uint32_t l = 0; l < 4; ++l) {
+				if (inside_mask & (1 << l)) {
+					wx[i + l] = nx[l];
+					wy[i + l] = ny[l];
+					wz[i + l] = nz[l];
+				} else {
+					slow_path(i + l);
+				}
+			}
 		}
+	}
+#endif //WALKMESH_USE_SSE
 
+	//scalar version of the above, for leftover points (or all points, without SSE):
+	for (; i < count; ++i) {
+		glm::vec3 delta = barycentric_step(barycentric_transforms[index[i]], glm::vec3(step_x[i], step_y[i], step_z[i]));
+		glm::vec3 weights = glm::vec3(wx[i], wy[i], wz[i]) + delta;
 
-
-		std::unordered_map<glm::uvec2, uint32_t >::const_iterator got = next_vertex.find(glm::uvec2(edge_a, edge_b));
-
-		if (got != next_vertex.end()) {
-			sum_weight += weights_step * 0.2f;
-
-			auto &vertex_a = this->vertices[wp.triangle[0]];
-			auto &vertex_b = this->vertices[wp.triangle[1]];
-			auto &vertex_c = this->vertices[wp.triangle[2]];
-
-			auto new_point = sum_weight.x * vertex_a + sum_weight.y * vertex_b + sum_weight.z * vertex_c;
-
-			wp.triangle[0] = edge_a;
-		    wp.triangle[1] = edge_b;
-		    wp.triangle[2] = got->second;
-
-
-			auto &vertex2_a = this->vertices[wp.triangle[0]];
-			auto &vertex2_b = this->vertices[wp.triangle[1]];
-			auto &vertex2_c = this->vertices[wp.triangle[2]];
-
-
-			auto project_point = closestPointOnTriangle(vertex2_a, vertex2_b, vertex2_c, new_point);
-			auto barycoord  = calculate_barycentric_coord(vertex2_a, vertex2_b, vertex2_c, project_point);
-
-			wp.weights = barycoord;
-
+		if (weights.x >= 0.0f && weights.y >= 0.0f && weights.z >= 0.0f) {
+			wx[i] = weights.x;
+			wy[i] = weights.y;
+			wz[i] = weights.z;
 		} else {
-		    wp.weights = wp.weights + 0.02f * weights_step;
+			slow_path(i);
 		}
 	}
 }
@@ -1,29 +1,122 @@
 #pragma once
 
+#include <glm/glm.hpp>
+
 #include <vector>
-#include <unordered_map>
+#include <string>
+#include <limits>
 
-#define GLM_ENABLE_EXPERIMENTAL
-#include <glm/gtx/hash.hpp> //allows the use of 'uvec2' as an unordered_map key
+struct MappedFile;
 
 struct WalkMesh {
+	//Read-only array that points either into 'storage' (for data built at load time) or into a memory-mapped cooked walkmesh:
+	template< typename T >
+	struct View {
+		T const *ptr = nullptr;
+		size_t count = 0;
+
+		void point_at(T const *ptr_, size_t count_) { ptr = ptr_; count = count_; }
+		void point_at(std::vector< T > const &v) { point_at(v.data(), v.size()); }
+
+		T const &operator[](size_t i) const { return ptr[i]; }
+		size_t size() const { return count; }
+		bool empty() const { return count == 0; }
+		T const *data() const { return ptr; }
+		T const *begin() const { return ptr; }
+		T const *end() const { return ptr + count; }
+	};
+
 	//Walk mesh will keep track of triangles, vertices:
-	std::vector< glm::vec3 > vertices;
-	std::vector< glm::uvec3 > triangles; //CCW-oriented
+	View< glm::vec3 > vertices;
+	View< glm::uvec3 > triangles; //CCW-oriented
 
 	//TODO: consider also loading vertex normals for interpolated "up" direction:
-	std::vector< glm::vec3 > vertex_normals;
+	View< glm::vec3 > vertex_normals;
+
+	//For each triangle, the affine map from world position to barycentric weights, and the triangle's plane:
+	// weights = barycentric_transforms[t] * glm::vec4(p, 1.0f) -- (points off the plane map to the weights of their projection)
+	// dot(glm::vec3(triangle_planes[t]), p) + triangle_planes[t].w is the (signed) height of p above the triangle
+	View< glm::mat4x3 > barycentric_transforms;
+	View< glm::vec4 > triangle_planes;
+	static_assert(sizeof(glm::mat4x3) == 4*3*4, "mat4x3 is packed.");
+
+	//(re-)build barycentric_transforms and triangle_planes from vertices and triangles:
+	void build_barycentric_transforms();
+
+	//For each triangle, the index of the triangle across each of its edges, or -1U for boundary edges:
+	// (.x is across edge [a,b], .y across [b,c], .z across [c,a] of the triangle [a,b,c])
+	View< glm::uvec3 > triangle_neighbors;
+
+	//(re-)build triangle_neighbors from triangles:
+	void build_neighbors();
+
+	//Bounding volume hierarchy over triangles, used to accelerate closest-point queries in start():
+	struct BVHNode {
+		glm::vec3 min = glm::vec3(0.0f);
+		uint32_t first = 0; //leaf: first entry in bvh_triangles; interior: index of second child (first child is the next node)
+		glm::vec3 max = glm::vec3(0.0f);
+		uint32_t count = 0; //leaf: number of entries in bvh_triangles; interior: zero
+	};
+	static_assert(sizeof(BVHNode) == 32, "BVHNode is packed.");
+	View< BVHNode > bvh_nodes; //depth-first order, root at index zero
+	View< uint32_t > bvh_triangles; //triangle indices, arranged so each leaf references a contiguous range
+
+	//(re-)build bvh_nodes and bvh_triangles from vertices and triangles:
+	void build_bvh();
+
+	//Coplanar neighboring triangles merged into convex polygons, giving navigation (PathFinder, FlowField) a smaller graph:
+	// (walking still happens on triangles; each triangle belongs to exactly one polygon)
+	struct Polygon {
+		uint32_t begin = 0; //range of entries in polygon_vertices / polygon_neighbors
+		uint32_t end = 0;
+	};
+	static_assert(sizeof(Polygon) == 8, "Polygon is packed.");
+	View< Polygon > polygons;
+	View< uint32_t > polygon_vertices; //CCW-oriented corners of each polygon
+	View< uint32_t > polygon_neighbors; //polygon across the edge from polygon_vertices[i] to the next corner, or -1U for boundary edges
+	View< uint32_t > triangle_polygons; //polygon containing each triangle
+
+	//(re-)build polygons, polygon_vertices, polygon_neighbors, and triangle_polygons from triangles and triangle_neighbors:
+	void build_polygons();
+
+	//backing storage for the views above when they are not memory-mapped:
+	struct {
+		std::vector< glm::vec3 > vertices;
+		std::vector< glm::uvec3 > triangles;
+		std::vector< glm::vec3 > vertex_normals;
+		std::vector< glm::mat4x3 > barycentric_transforms;
+		std::vector< glm::vec4 > triangle_planes;
+		std::vector< glm::uvec3 > triangle_neighbors;
+		std::vector< BVHNode > bvh_nodes;
+		std::vector< uint32_t > bvh_triangles;
+		std::vector< Polygon > polygons;
+		std::vector< uint32_t > polygon_vertices;
+		std::vector< uint32_t > polygon_neighbors;
+		std::vector< uint32_t > triangle_polygons;
+	} storage;
+
+	//cooked walkmesh file the views point into (if loaded from one):
+	MappedFile *mapped = nullptr;
+
+	//Load from a file:
+	// '.w' files (from export-walkmeshes.py) are parsed, then adjacency and bvh are built;
+	// '.wc' files (from cook_walkmesh) are memory-mapped and used in place.
+	//note: will throw if file fails to read.
+	WalkMesh(std::string const &filename);
+
+	//Construct new WalkMesh and build triangle_neighbors structure:
+	WalkMesh(std::vector< glm::vec3 > const &vertices_, std::vector< glm::uvec3 > const &triangles_);
 
-	//This "next vertex" map includes [a,b]->c, [b,c]->a, and [c,a]->b for each triangle, and is useful for checking what's over an edge from a given point:
-	std::unordered_map< glm::uvec2, uint32_t > next_vertex;
+	~WalkMesh();
+	WalkMesh(WalkMesh const &) = delete;
+	WalkMesh &operator=(WalkMesh const &) = delete;
 
-	WalkMesh(std::string const &wok_filename);
-
-	//Construct new WalkMesh and build next_vertex structure:
-	WalkMesh(std::vector< glm::vec3 > const &vertices_, std::vector< glm::uvec3 > const &triangles_);
+	//Write vertices, normals, triangles, barycentric transforms, planes, adjacency, bvh, and polygons in their in-memory layout, for loading as a '.wc' file:
+	void save_cooked(std::string const &filename) const;
 
 	struct WalkPoint {
-		glm::uvec3 triangle = glm::uvec3(-1U); //indices of current triangle
+		uint32_t triangle_index = -1U; //index of current triangle in 'triangles'
+		glm::uvec3 triangle = glm::uvec3(-1U); //indices of current triangle's vertices
 		glm::vec3 weights = glm::vec3(std::numeric_limits< float >::quiet_NaN()); //barycentric coordinates for current point
 	};
 
@@ -48,6 +141,24 @@ struct WalkMesh {
 			+ wp.weights.z * vertex_normals[wp.triangle.z]);
 	}
 
+	//Structure-of-arrays storage for many walk points, for use with walk_many():
+	struct WalkPoints {
+		std::vector< uint32_t > triangle_index;
+		std::vector< float > weight_x, weight_y, weight_z;
+
+		size_t size() const { return triangle_index.size(); }
+		void push_back(WalkPoint const &wp);
+		void set(size_t i, WalkPoint const &wp);
+	};
+
+	//unpack one entry of a WalkPoints into a WalkPoint:
+	WalkPoint get(WalkPoints const &wps, size_t i) const;
+
+	//update all walk points in 'wps'; step i is (step_x[i], step_y[i], step_z[i]):
+	// steps that stay inside the current triangle are handled four at a time (with SSE, where available);
+	// steps that cross an edge fall back to walk().
+	void walk_many(WalkPoints &wps, float const *step_x, float const *step_y, float const *step_z) const;
+
 };
 
 /*
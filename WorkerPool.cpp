@@ -0,0 +1,82 @@
+#include "WorkerPool.hpp"
+
+#include <algorithm>
+
+WorkerPool::WorkerPool(uint32_t workers) : next(0) {
+	threads.reserve(workers);
+	for (uint32_t i = 0; i < workers; ++i) {
+		threads.emplace_back(&WorkerPool::worker, this);
+	}
+}
+
+WorkerPool::~WorkerPool() {
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		quit = true;
+	}
+	wake.notify_all();
+	for (auto &thread : threads) {
+		thread.join();
+	}
+}
+
+WorkerPool &WorkerPool::shared() {
+	static WorkerPool pool(std::max(1U, std::thread::hardware_concurrency()) - 1);
+	return pool;
+}
+
+void WorkerPool::parallel_for(uint32_t count_, uint32_t grain_, std::function< void(uint32_t, uint32_t) > const &body_) {
+	if (count_ == 0) return;
+	grain_ = std::max(1U, grain_);
+
+	//not worth waking anyone for a single range:
+	if (threads.empty() || count_ <= grain_) {
+		body_(0, count_);
+		return;
+	}
+
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		body = &body_;
+		count = count_;
+		grain = grain_;
+		next = 0;
+		++generation;
+	}
+	wake.notify_all();
+
+	//the calling thread helps out:
+	run_ranges(body_);
+
+	//stop new workers from joining, then wait for those already working:
+	std::unique_lock< std::mutex > lock(mutex);
+	body = nullptr;
+	done.wait(lock, [this](){ return busy == 0; });
+}
+
+void WorkerPool::run_ranges(std::function< void(uint32_t, uint32_t) > const &body_) {
+	while (true) {
+		uint32_t begin = next.fetch_add(grain);
+		if (begin >= count) break;
+		body_(begin, std::min(count, begin + grain));
+	}
+}
+
+void WorkerPool::worker() {
+	uint64_t seen = 0;
+	std::unique_lock< std::mutex > lock(mutex);
+	while (true) {
+		wake.wait(lock, [&](){ return quit || generation != seen; });
+		if (quit) break;
+		seen = generation;
+		if (!body) continue; //(woke after the job was over)
+
+		std::function< void(uint32_t, uint32_t) > const &job = *body;
+		++busy;
+		lock.unlock();
+		run_ranges(job);
+		lock.lock();
+		--busy;
+		if (busy == 0) done.notify_one();
+	}
+}
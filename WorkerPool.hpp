@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+
+//"WorkerPool" keeps a few threads around for splitting big loops (e.g., per-object matrix math in Scene::draw) across cores:
+// threads are started once and sleep between jobs, so handing out a job costs a wake-up rather than a thread launch.
+
+struct WorkerPool {
+	//start 'workers' threads (zero is fine; parallel_for then just runs on the calling thread):
+	WorkerPool(uint32_t workers);
+	~WorkerPool();
+
+	WorkerPool(WorkerPool const &) = delete;
+	WorkerPool &operator=(WorkerPool const &) = delete;
+
+	//call 'body(begin, end)' on disjoint ranges of at most 'grain' items that together cover [0, count),
+	// using the workers and the calling thread; returns once every range is done.
+	//NOTE: 'body' must be safe to call from several threads at once; only one parallel_for may run at a time.
+	void parallel_for(uint32_t count, uint32_t grain, std::function< void(uint32_t begin, uint32_t end) > const &body);
+
+	//pool shared by the whole program, with one worker per extra hardware thread (started on first use):
+	static WorkerPool &shared();
+
+	//internals:
+	std::vector< std::thread > threads;
+	std::mutex mutex;
+	std::condition_variable wake; //signalled when a job starts (or on shutdown)
+	std::condition_variable done; //signalled when the last busy worker leaves a job
+	bool quit = false;
+	uint64_t generation = 0; //bumped for every job
+
+	//current job (set by parallel_for; 'body' is reset to null before it returns, so late-waking workers skip it):
+	std::function< void(uint32_t, uint32_t) > const *body = nullptr;
+	uint32_t count = 0;
+	uint32_t grain = 1;
+	std::atomic< uint32_t > next; //first item not yet handed out
+	uint32_t busy = 0; //workers currently running ranges of the job
+
+	void run_ranges(std::function< void(uint32_t, uint32_t) > const &body);
+	void worker();
+};
@@ -0,0 +1,548 @@
+//bench_scene times the scene's bookkeeping (without drawing anything), checking each part against a straightforward version as it goes:
+// pool: creating, churning, traversing, and deleting 100k transform+object pairs in the scene's pools, vs. new'd objects on intrusive lists (as the scene used to keep them)
+// matrices: DrawList::compute_matrices (the matrix phase of Scene::draw) for 10k, 100k, and 1M objects, vs. the per-object glm math draw() used to do
+// occlusion: OcclusionBuffer::render and box_visible in a generated maze, with the rejected boxes checked by line of sight against the walls
+// tree: 10k spiders wandering a level, kept in the scene's object_tree by update_transforms(); proximity, nearest, and ray queries on it vs. scanning every spider
+//Only the sections named on the command line are run; with none named, all of them are.
+
+#include "Scene.hpp"
+#include "WorkerPool.hpp"
+#include "OcclusionBuffer.hpp"
+#include "TriangleBVH.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <stdexcept>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static double seconds_since(Clock::time_point const &before) {
+	return std::chrono::duration< double >(Clock::now() - before).count();
+}
+
+//------ pool ------
+
+//the scene used to 'new' each thing and link it into a per-type list through pointers stored in it:
+template< typename T >
+struct Listed {
+	template< typename... Args >
+	Listed(Args&&... args) : value(std::forward< Args >(args)...) { }
+	T value;
+	Listed **alloc_prev_next = nullptr;
+	Listed *alloc_next = nullptr;
+};
+
+template< typename T >
+struct List {
+	Listed< T > *first = nullptr;
+	template< typename... Args >
+	Listed< T > *create(Args&&... args) {
+		Listed< T > *t = new Listed< T >(std::forward< Args >(args)...);
+		t->alloc_next = first;
+		if (first) first->alloc_prev_next = &t->alloc_next;
+		t->alloc_prev_next = &first;
+		first = t;
+		return t;
+	}
+	void destroy(Listed< T > *t) {
+		*t->alloc_prev_next = t->alloc_next;
+		if (t->alloc_next) t->alloc_next->alloc_prev_next = t->alloc_prev_next;
+		delete t;
+	}
+};
+
+static void bench_pool() {
+	const uint32_t Count = 100000;
+	const uint32_t Passes = 10;
+
+	struct Times {
+		double create = 0.0, churn = 0.0, traverse = 0.0, destroy = 0.0;
+		uint64_t checksum = 0; //(integer, so it doesn't depend on traversal order)
+	};
+
+	//pooled, through the scene:
+	auto pooled = [&](uint32_t seed) {
+		Times times;
+		std::mt19937 mt(seed);
+		Scene scene;
+		std::vector< Scene::Object * > objects;
+		objects.reserve(Count);
+
+		auto before = Clock::now();
+		for (uint32_t i = 0; i < Count; ++i) {
+			Scene::Transform *transform = scene.new_transform();
+			transform->position.x = float(i);
+			objects.emplace_back(scene.new_object(transform));
+		}
+		times.create = seconds_since(before);
+
+		//delete a random half and make as many again:
+		std::shuffle(objects.begin(), objects.end(), mt);
+		before = Clock::now();
+		for (uint32_t i = 0; i < Count / 2; ++i) {
+			Scene::Transform *transform = objects[i]->transform;
+			scene.delete_object(objects[i]);
+			scene.delete_transform(transform);
+		}
+		for (uint32_t i = 0; i < Count / 2; ++i) {
+			Scene::Transform *transform = scene.new_transform();
+			transform->position.x = float(i);
+			objects[i] = scene.new_object(transform);
+		}
+		times.churn = seconds_since(before);
+
+		before = Clock::now();
+		for (uint32_t pass = 0; pass < Passes; ++pass) {
+			for (Scene::Object *object : scene.objects) {
+				times.checksum += uint64_t(object->transform->position.x) + object->programs[0].count;
+			}
+		}
+		times.traverse = seconds_since(before) / Passes;
+
+		before = Clock::now();
+		for (Scene::Object *object : objects) {
+			Scene::Transform *transform = object->transform;
+			scene.delete_object(object);
+			scene.delete_transform(transform);
+		}
+		times.destroy = seconds_since(before);
+		return times;
+	};
+
+	//new'd and listed, as before:
+	auto listed = [&](uint32_t seed) {
+		Times times;
+		std::mt19937 mt(seed);
+		List< Scene::Transform > transforms;
+		List< Scene::Object > list;
+		std::vector< std::pair< Listed< Scene::Object > *, Listed< Scene::Transform > * > > objects;
+		objects.reserve(Count);
+
+		auto before = Clock::now();
+		for (uint32_t i = 0; i < Count; ++i) {
+			Listed< Scene::Transform > *transform = transforms.create();
+			transform->value.position.x = float(i);
+			objects.emplace_back(list.create(&transform->value), transform);
+		}
+		times.create = seconds_since(before);
+
+		std::shuffle(objects.begin(), objects.end(), mt);
+		before = Clock::now();
+		for (uint32_t i = 0; i < Count / 2; ++i) {
+			list.destroy(objects[i].first);
+			transforms.destroy(objects[i].second);
+		}
+		for (uint32_t i = 0; i < Count / 2; ++i) {
+			Listed< Scene::Transform > *transform = transforms.create();
+			transform->value.position.x = float(i);
+			objects[i] = std::make_pair(list.create(&transform->value), transform);
+		}
+		times.churn = seconds_since(before);
+
+		before = Clock::now();
+		for (uint32_t pass = 0; pass < Passes; ++pass) {
+			for (Listed< Scene::Object > *object = list.first; object; object = object->alloc_next) {
+				times.checksum += uint64_t(object->value.transform->position.x) + object->value.programs[0].count;
+			}
+		}
+		times.traverse = seconds_since(before) / Passes;
+
+		before = Clock::now();
+		for (auto const &object : objects) {
+			list.destroy(object.first);
+			transforms.destroy(object.second);
+		}
+		times.destroy = seconds_since(before);
+		return times;
+	};
+
+	auto report = [](std::string const &name, Times const &times) {
+		std::cout << "  " << std::setw(10) << name << std::setw(10) << times.create * 1000.0 << std::setw(10) << times.churn * 1000.0
+			<< std::setw(10) << times.traverse * 1000.0 << std::setw(10) << times.destroy * 1000.0 << std::endl;
+	};
+
+	//(alternating, so neither side always runs on a warmer heap)
+	for (uint32_t round = 0; round < 3; ++round) {
+		Times p = pooled(round);
+		Times l = listed(round);
+		if (p.checksum != l.checksum) throw std::runtime_error("Pooled and listed traversals disagree.");
+		report("pool", p);
+		report("new+list", l);
+	}
+
+	//random creates and destroys should keep the live list equal to the set of live pointers:
+	std::mt19937 mt(0xfeed);
+	Pool< uint32_t, 8 > pool;
+	std::vector< uint32_t * > live;
+	for (uint32_t i = 0; i < 100000; ++i) {
+		if (live.empty() || mt() % 3) {
+			live.emplace_back(pool.create(i));
+		} else {
+			size_t k = mt() % live.size();
+			pool.destroy(live[k]);
+			live[k] = live.back();
+			live.pop_back();
+		}
+	}
+	std::vector< uint32_t * > listed_live(pool.begin(), pool.end());
+	std::sort(listed_live.begin(), listed_live.end());
+	std::sort(live.begin(), live.end());
+	std::cout << "  random create/destroy: " << live.size() << " live in " << pool.chunks.size() << " chunks, live list "
+		<< (listed_live == live ? "consistent" : "INCONSISTENT") << std::endl;
+}
+
+//------ matrices ------
+
+static void bench_matrices(uint32_t count, bool scaled) {
+	std::mt19937 mt(count);
+	std::uniform_real_distribution< float > unit(-1.0f, 1.0f);
+	Scene scene;
+	for (uint32_t i = 0; i < count; ++i) {
+		Scene::Transform *transform = scene.new_transform();
+		transform->position = 50.0f * glm::vec3(unit(mt), unit(mt), unit(mt));
+		transform->rotation = glm::normalize(glm::quat(unit(mt), unit(mt), unit(mt), unit(mt)));
+		if (scaled) transform->scale = glm::vec3(1.0f) + 0.5f * glm::vec3(unit(mt), unit(mt), unit(mt));
+		scene.new_object(transform);
+	}
+	scene.update_transforms();
+
+	//queue every object, as draw() would after culling and sorting:
+	Scene::DrawList &list = scene.draw_list;
+	list.objects.assign(scene.objects.begin(), scene.objects.end());
+	list.queue.resize(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		list.queue[i].index = i;
+	}
+
+	glm::mat4 world_to_clip = glm::perspective(1.0f, 16.0f / 9.0f, 0.1f, 100.0f);
+	const uint32_t Passes = std::max(3U, 2000000U / count);
+
+	//what draw() used to do for each object:
+	std::vector< glm::mat4 > mvp(count);
+	std::vector< glm::mat3 > itmv(count);
+	auto before = Clock::now();
+	for (uint32_t pass = 0; pass < Passes; ++pass) {
+		for (uint32_t q = 0; q < count; ++q) {
+			glm::mat4 const &local_to_world = list.objects[list.queue[q].index]->transform->local_to_world;
+			mvp[q] = world_to_clip * local_to_world;
+			itmv[q] = glm::inverse(glm::transpose(glm::mat3(local_to_world)));
+		}
+	}
+	double reference = seconds_since(before) / Passes;
+
+	before = Clock::now();
+	for (uint32_t pass = 0; pass < Passes; ++pass) {
+		list.compute_matrices(world_to_clip);
+	}
+	double phase = seconds_since(before) / Passes;
+
+	float error = 0.0f;
+	for (uint32_t q = 0; q < count; ++q) {
+		for (uint32_t c = 0; c < 4; ++c) {
+			for (uint32_t r = 0; r < 4; ++r) {
+				error = std::max(error, std::abs(list.object_to_clip[q][c][r] - mvp[q][c][r]));
+			}
+		}
+		for (uint32_t c = 0; c < 3; ++c) {
+			for (uint32_t r = 0; r < 3; ++r) {
+				error = std::max(error, std::abs(list.normal_to_light[3 * q + c][r] - itmv[q][c][r]));
+			}
+		}
+	}
+
+	std::cout << "  " << std::setw(10) << count << std::setw(8) << (scaled ? "yes" : "no") << std::setw(12) << reference * 1000.0
+		<< std::setw(12) << phase * 1000.0 << std::setw(12) << std::setprecision(1) << std::scientific << error
+		<< std::fixed << std::setprecision(2) << std::endl;
+}
+
+//------ occlusion ------
+
+//the twelve triangles of a box:
+static void add_box(glm::vec3 const &min, glm::vec3 const &max, std::vector< glm::vec3 > *triangles) {
+	auto corner = [&](uint32_t bits) {
+		return glm::vec3((bits & 1 ? max.x : min.x), (bits & 2 ? max.y : min.y), (bits & 4 ? max.z : min.z));
+	};
+	static const uint32_t Faces[6][4] = {
+		{0, 2, 6, 4}, {1, 5, 7, 3}, //-x, +x
+		{0, 4, 5, 1}, {2, 3, 7, 6}, //-y, +y
+		{0, 1, 3, 2}, {4, 6, 7, 5}, //-z, +z
+	};
+	for (auto const &face : Faces) {
+		triangles->insert(triangles->end(), { corner(face[0]), corner(face[1]), corner(face[2]) });
+		triangles->insert(triangles->end(), { corner(face[0]), corner(face[2]), corner(face[3]) });
+	}
+}
+
+static void bench_occlusion(uint32_t width, uint32_t height) {
+	//a 64x64 maze of 2m cells, with a wall (2.5m tall) on about half of the cell edges:
+	const uint32_t Cells = 64;
+	const float Cell = 2.0f;
+	std::mt19937 mt(0x0cc1);
+	std::uniform_real_distribution< float > unit(0.0f, 1.0f);
+	std::vector< glm::vec3 > walls;
+	for (uint32_t y = 0; y <= Cells; ++y) {
+		for (uint32_t x = 0; x <= Cells; ++x) {
+			glm::vec3 corner = glm::vec3(x * Cell, y * Cell, 0.0f);
+			if (x < Cells && (y == 0 || y == Cells || unit(mt) < 0.5f)) {
+				add_box(corner + glm::vec3(0.0f, -0.1f, 0.0f), corner + glm::vec3(Cell, 0.1f, 2.5f), &walls);
+			}
+			if (y < Cells && (x == 0 || x == Cells || unit(mt) < 0.5f)) {
+				add_box(corner + glm::vec3(-0.1f, 0.0f, 0.0f), corner + glm::vec3(0.1f, Cell, 2.5f), &walls);
+			}
+		}
+	}
+
+	OcclusionBuffer occlusion(width, height);
+	occlusion.add_occluders(walls.data(), uint32_t(walls.size()), glm::mat4(1.0f));
+	TriangleBVH bvh;
+	bvh.add_triangles(walls.data(), uint32_t(walls.size()));
+	bvh.build();
+
+	//spider-sized boxes scattered over the floor:
+	auto floor_point = [&]() {
+		return glm::vec3(unit(mt) * Cells * Cell, unit(mt) * Cells * Cell, 0.0f);
+	};
+	std::vector< glm::vec3 > centers, extents;
+	for (uint32_t i = 0; i < 4096; ++i) {
+		centers.emplace_back(floor_point() + glm::vec3(0.0f, 0.0f, 0.25f));
+		extents.emplace_back(0.3f, 0.3f, 0.25f);
+	}
+
+	const uint32_t Views = 100;
+	glm::mat4 projection = glm::perspective(60.0f / 180.0f * 3.1415926f, 16.0f / 9.0f, 0.1f, 200.0f);
+	double render = 0.0, test = 0.0;
+	uint64_t in_view = 0, rejected = 0, wrong = 0;
+	std::vector< uint8_t > visible(centers.size());
+	for (uint32_t v = 0; v < Views; ++v) {
+		glm::vec3 eye = floor_point() + glm::vec3(0.0f, 0.0f, 1.7f);
+		float yaw = unit(mt) * 2.0f * 3.1415926f;
+		glm::mat4 world_to_clip = projection * glm::lookAt(eye, eye + glm::vec3(std::cos(yaw), std::sin(yaw), 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+
+		auto before = Clock::now();
+		occlusion.render(world_to_clip);
+		render += seconds_since(before);
+
+		before = Clock::now();
+		for (uint32_t i = 0; i < centers.size(); ++i) {
+			visible[i] = occlusion.box_visible(centers[i], extents[i]);
+		}
+		test += seconds_since(before);
+
+		//a box is in view if any of a 3x3x3 grid of points on it is; a rejected box is wrong if any of those can see the eye:
+		for (uint32_t i = 0; i < centers.size(); ++i) {
+			bool any_in_view = false, any_seen = false;
+			for (uint32_t s = 0; s < 3 * 3 * 3; ++s) {
+				glm::vec3 point = centers[i] + extents[i] * (glm::vec3(float(s % 3), float(s / 3 % 3), float(s / 9)) - glm::vec3(1.0f));
+				glm::vec4 clip = world_to_clip * glm::vec4(point, 1.0f);
+				if (!(clip.w > 0.1f && std::abs(clip.x) <= clip.w && std::abs(clip.y) <= clip.w)) continue;
+				any_in_view = true;
+				if (visible[i]) break;
+				if (!bvh.occluded(eye, point)) {
+					any_seen = true;
+					break;
+				}
+			}
+			if (!any_in_view) continue;
+			in_view += 1;
+			if (!visible[i]) {
+				rejected += 1;
+				if (any_seen) wrong += 1;
+			}
+		}
+	}
+
+	std::cout << "  " << std::setw(10) << (std::to_string(width) + "x" + std::to_string(height)) << std::setw(10) << render / Views * 1e6
+		<< std::setw(10) << test / (double(Views) * centers.size()) * 1e9 << std::setw(10) << double(in_view) / Views
+		<< std::setw(10) << 100.0 * double(rejected) / double(std::max< uint64_t >(1, in_view)) << std::setw(10) << wrong << std::endl;
+}
+
+//------ tree ------
+
+static void bench_tree() {
+	typedef AABBTree< Scene::Object const * > Tree;
+	const uint32_t Spiders = 10000;
+	const uint32_t Frames = 200;
+	const float Size = 46.0f * std::sqrt(Spiders / 12.0f); //(as crowded as the maze, which is 46m across and has 12 spiders)
+
+	std::mt19937 mt(0x5b1d);
+	std::uniform_real_distribution< float > unit(0.0f, 1.0f);
+
+	//the same spiders with and without bounds, so the difference in update_transforms() is the tree's upkeep:
+	Scene scene, plain_scene;
+	std::vector< Scene::Transform * > spiders, plain_spiders;
+	std::vector< glm::vec2 > headings;
+	for (uint32_t i = 0; i < Spiders; ++i) {
+		glm::vec3 position = glm::vec3(unit(mt) * Size, unit(mt) * Size, 0.0f);
+		float angle = unit(mt) * 2.0f * 3.1415926f;
+		headings.emplace_back(std::cos(angle), std::sin(angle));
+
+		Scene::Transform *transform = scene.new_transform();
+		transform->position = position;
+		Scene::Object *object = scene.new_object(transform);
+		object->has_bounds = true;
+		object->bounds_min = glm::vec3(-0.75f, -0.75f, 0.0f);
+		object->bounds_max = glm::vec3(0.75f, 0.75f, 0.5f);
+		spiders.emplace_back(transform);
+
+		Scene::Transform *plain_transform = plain_scene.new_transform();
+		plain_transform->position = position;
+		plain_scene.new_object(plain_transform);
+		plain_spiders.emplace_back(plain_transform);
+	}
+	auto before = Clock::now();
+	scene.update_transforms();
+	double build = seconds_since(before);
+	plain_scene.update_transforms();
+
+	double update = 0.0, plain_update = 0.0;
+	double proximity_tree = 0.0, proximity_scan = 0.0;
+	uint32_t proximity_queries = 0, mismatches = 0;
+	for (uint32_t frame = 0; frame < Frames; ++frame) {
+		//walk at 2m/s, sometimes turning:
+		for (uint32_t i = 0; i < Spiders; ++i) {
+			if (unit(mt) < 0.01f) {
+				float angle = unit(mt) * 2.0f * 3.1415926f;
+				headings[i] = glm::vec2(std::cos(angle), std::sin(angle));
+			}
+			glm::vec3 step = glm::vec3(headings[i] * (2.0f / 60.0f), 0.0f);
+			spiders[i]->position += step;
+			plain_spiders[i]->position += step;
+		}
+		before = Clock::now();
+		scene.update_transforms();
+		update += seconds_since(before);
+		before = Clock::now();
+		plain_scene.update_transforms();
+		plain_update += seconds_since(before);
+
+		//which spiders are within 0.5m of a player (as GameMode::update checks), for a few players:
+		for (uint32_t p = 0; p < 16; ++p) {
+			glm::vec2 player = glm::vec2(unit(mt) * Size, unit(mt) * Size);
+			uint32_t tree_count = 0, scan_count = 0;
+			before = Clock::now();
+			Tree::Box reach;
+			reach.min = glm::vec3(player - glm::vec2(0.5f), -std::numeric_limits< float >::infinity());
+			reach.max = glm::vec3(player + glm::vec2(0.5f), std::numeric_limits< float >::infinity());
+			scene.object_tree.query_overlap(reach, [&](uint32_t leaf) {
+				glm::vec3 const &at = scene.object_tree.value(leaf)->transform->position;
+				if (glm::distance(glm::vec2(at.x, at.y), player) < 0.5f) tree_count += 1;
+				return true;
+			});
+			proximity_tree += seconds_since(before);
+			before = Clock::now();
+			for (Scene::Transform const *spider : spiders) {
+				if (glm::distance(glm::vec2(spider->position.x, spider->position.y), player) < 0.5f) scan_count += 1;
+			}
+			proximity_scan += seconds_since(before);
+			proximity_queries += 1;
+			if (tree_count != scan_count) mismatches += 1;
+		}
+	}
+
+	//nearest spider to, and first spider along a ray from, random points:
+	const uint32_t Queries = 1000;
+	double nearest_tree = 0.0, nearest_scan = 0.0, ray_tree = 0.0, ray_scan = 0.0;
+	for (uint32_t q = 0; q < Queries; ++q) {
+		glm::vec3 point = glm::vec3(unit(mt) * Size, unit(mt) * Size, 0.25f);
+
+		before = Clock::now();
+		uint32_t leaf = scene.object_tree.query_nearest(point, std::numeric_limits< float >::infinity(), [](uint32_t) { return true; });
+		nearest_tree += seconds_since(before);
+		before = Clock::now();
+		float closest = std::numeric_limits< float >::infinity();
+		for (Scene::Object const *object : scene.objects) {
+			closest = std::min(closest, Tree::distance2(scene.object_tree.box(object->tree_leaf), point));
+		}
+		nearest_scan += seconds_since(before);
+		if (leaf == -1U || Tree::distance2(scene.object_tree.box(leaf), point) != closest) mismatches += 1;
+
+		float angle = unit(mt) * 2.0f * 3.1415926f;
+		glm::vec3 direction = glm::vec3(std::cos(angle), std::sin(angle), 0.0f);
+		glm::vec3 inv_direction = glm::vec3(1.0f) / direction;
+		before = Clock::now();
+		float tree_hit = std::numeric_limits< float >::infinity();
+		scene.object_tree.query_ray(point, direction, 1000.0f, [&](uint32_t, float t) {
+			tree_hit = std::min(tree_hit, t);
+			return t;
+		});
+		ray_tree += seconds_since(before);
+		before = Clock::now();
+		float scan_hit = std::numeric_limits< float >::infinity();
+		for (Scene::Object const *object : scene.objects) {
+			scan_hit = std::min(scan_hit, Tree::ray_enter(scene.object_tree.box(object->tree_leaf), point, inv_direction, 1000.0f));
+		}
+		ray_scan += seconds_since(before);
+		if (tree_hit != scan_hit) mismatches += 1;
+	}
+
+	std::cout << "  insert all: " << build * 1000.0 << " ms; update_transforms: " << update / Frames * 1000.0 << " ms per frame ("
+		<< plain_update / Frames * 1000.0 << " without bounds, so the tree costs " << (update - plain_update) / Frames * 1000.0
+		<< "); tree height " << scene.object_tree.height() << std::endl;
+	std::cout << "  " << std::setw(10) << "query" << std::setw(10) << "tree" << std::setw(10) << "scan" << std::endl;
+	std::cout << "  " << std::setw(10) << "proximity" << std::setw(10) << proximity_tree / proximity_queries * 1e6 << std::setw(10) << proximity_scan / proximity_queries * 1e6 << std::endl;
+	std::cout << "  " << std::setw(10) << "nearest" << std::setw(10) << nearest_tree / Queries * 1e6 << std::setw(10) << nearest_scan / Queries * 1e6 << std::endl;
+	std::cout << "  " << std::setw(10) << "ray" << std::setw(10) << ray_tree / Queries * 1e6 << std::setw(10) << ray_scan / Queries * 1e6 << std::endl;
+	std::cout << "  " << mismatches << " queries disagree with the scans." << std::endl;
+}
+
+int main(int argc, char **argv) {
+	try {
+		std::vector< std::string > sections(argv + 1, argv + argc);
+		for (auto const &section : sections) {
+			if (section != "pool" && section != "matrices" && section != "occlusion" && section != "tree") {
+				std::cerr << "Usage:\n\t./bench_scene [pool|matrices|occlusion|tree]..." << std::endl;
+				return 1;
+			}
+		}
+		auto run = [&sections](std::string const &section) {
+			return sections.empty() || std::find(sections.begin(), sections.end(), section) != sections.end();
+		};
+
+		std::cout << std::fixed << std::setprecision(2);
+
+		if (run("pool")) {
+			std::cout << "pool: 100k transform+object pairs; create all, delete and remake a random half, traverse, delete all (ms)" << std::endl;
+			std::cout << "  " << std::setw(10) << "storage" << std::setw(10) << "create" << std::setw(10) << "churn" << std::setw(10) << "traverse"
+				<< std::setw(10) << "delete" << std::endl;
+			bench_pool();
+		}
+
+		if (run("matrices")) {
+			std::cout << "matrices: object_to_clip and normal matrices for every queued object, glm per object vs. compute_matrices ("
+				<< WorkerPool::shared().threads.size() << " worker threads) (ms per pass)" << std::endl;
+			std::cout << "  " << std::setw(10) << "objects" << std::setw(8) << "scaled" << std::setw(12) << "glm" << std::setw(12) << "phase"
+				<< std::setw(12) << "max error" << std::endl;
+			for (uint32_t count : {10000, 100000, 1000000}) {
+				bench_matrices(count, false);
+				bench_matrices(count, true);
+			}
+		}
+
+		if (run("occlusion")) {
+			std::cout << "occlusion: " << WorkerPool::shared().threads.size() << " worker threads, 100 views of 4096 boxes in a 64x64 maze"
+				<< " (us per render, ns per box test; boxes in view per view, % of those rejected, rejected boxes seen by line of sight)" << std::endl;
+			std::cout << "  " << std::setw(10) << "buffer" << std::setw(10) << "render" << std::setw(10) << "test" << std::setw(10) << "in view"
+				<< std::setw(10) << "rejected" << std::setw(10) << "wrong" << std::endl;
+			bench_occlusion(128, 64);
+			bench_occlusion(256, 128);
+			bench_occlusion(512, 256);
+		}
+
+		if (run("tree")) {
+			std::cout << "tree: 10k spiders walking at 2m/s for 200 frames (us per query)" << std::endl;
+			bench_tree();
+		}
+	} catch (std::exception &e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
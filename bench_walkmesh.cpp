@@ -0,0 +1,592 @@
+//bench_walkmesh times the walkmesh queries, checking each against a straightforward version as it goes:
+// start: WalkMesh::start (through its bvh) vs. a scan over every triangle, on the given walkmesh and on generated grids of growing size
+// walk_many: WalkMesh::walk_many vs. calling walk() for each walk point, for growing numbers of walk points
+// barycentric: weights from WalkMesh::barycentric_transforms vs. computing them from the triangle's vertices (as walk() used to)
+// path: PathFinder::find_path between random pairs of points, without and with the corridor cache, and for agents chasing one goal
+// flow: 10k agents steered toward a wandering goal by a FlowField (plus walk_many), vs. re-planning each of them with PathFinder;
+//  also checks that agents on walkmesh that can't reach the goal stay put
+// ray: TriangleBVH::raycast_many and occluded_many against the walkmesh and its walls (boundary edges raised 2m), vs. testing every triangle
+//Only the sections named on the command line are run; with none named, all of them are.
+
+#include "WalkMesh.hpp"
+#include "PathFinder.hpp"
+#include "FlowField.hpp"
+#include "TriangleBVH.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <stdexcept>
+#include <algorithm>
+#include <memory>
+#include <cmath>
+
+//(defined in WalkMesh.cpp; it's what start() used to call for every triangle)
+glm::vec3 closestPointOnTriangle(const glm::vec3& vertex_a, const glm::vec3& vertex_b, const glm::vec3& vertex_c, const glm::vec3 postion);
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static double seconds_since(Clock::time_point const &before) {
+	return std::chrono::duration< double >(Clock::now() - before).count();
+}
+
+//'count' points scattered over the walkmesh's bounding box (grown by 'margin' on every side):
+static std::vector< glm::vec3 > random_points(WalkMesh const &walk_mesh, uint32_t count, float margin, uint32_t seed) {
+	glm::vec3 min = walk_mesh.vertices[0], max = walk_mesh.vertices[0];
+	for (auto const &v : walk_mesh.vertices) {
+		min = glm::min(min, v);
+		max = glm::max(max, v);
+	}
+	min -= glm::vec3(margin);
+	max += glm::vec3(margin);
+
+	std::mt19937 mt(seed);
+	std::uniform_real_distribution< float > unit(0.0f, 1.0f);
+	std::vector< glm::vec3 > points;
+	points.reserve(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		points.emplace_back(min + glm::vec3(unit(mt), unit(mt), unit(mt)) * (max - min));
+	}
+	return points;
+}
+
+//a rolling 'size' by 'size' grid of unit squares (two triangles each):
+static std::unique_ptr< WalkMesh > make_grid(uint32_t size) {
+	std::vector< glm::vec3 > vertices;
+	vertices.reserve((size + 1) * (size + 1));
+	for (uint32_t y = 0; y <= size; ++y) {
+		for (uint32_t x = 0; x <= size; ++x) {
+			vertices.emplace_back(float(x), float(y), 0.5f * std::sin(0.3f * x) * std::cos(0.2f * y));
+		}
+	}
+	std::vector< glm::uvec3 > triangles;
+	triangles.reserve(2 * size * size);
+	for (uint32_t y = 0; y < size; ++y) {
+		for (uint32_t x = 0; x < size; ++x) {
+			uint32_t a = y * (size + 1) + x;
+			triangles.emplace_back(a, a + 1, a + size + 2);
+			triangles.emplace_back(a, a + size + 2, a + size + 1);
+		}
+	}
+	return std::unique_ptr< WalkMesh >(new WalkMesh(vertices, triangles));
+}
+
+//------ start ------
+
+static void bench_start(WalkMesh const &walk_mesh, std::string const &name) {
+	std::vector< glm::vec3 > points = random_points(walk_mesh, 2000, 1.0f, 1);
+
+	std::vector< float > distances(points.size());
+	auto before = Clock::now();
+	for (uint32_t i = 0; i < points.size(); ++i) {
+		WalkMesh::WalkPoint wp = walk_mesh.start(points[i]);
+		distances[i] = glm::distance(walk_mesh.world_point(wp), points[i]);
+	}
+	double bvh_time = seconds_since(before) / points.size();
+
+	//(the scan is slow on big meshes, so only check a prefix of the points against it)
+	uint32_t scanned = uint32_t(std::min< size_t >(points.size(), std::max< size_t >(20, 20000000 / walk_mesh.triangles.size())));
+	uint32_t mismatches = 0;
+	before = Clock::now();
+	for (uint32_t i = 0; i < scanned; ++i) {
+		float best = std::numeric_limits< float >::infinity();
+		for (auto const &tri : walk_mesh.triangles) {
+			glm::vec3 closest = closestPointOnTriangle(walk_mesh.vertices[tri.x], walk_mesh.vertices[tri.y], walk_mesh.vertices[tri.z], points[i]);
+			best = std::min(best, glm::distance(closest, points[i]));
+		}
+		if (std::abs(best - distances[i]) > 1e-4f) ++mismatches;
+	}
+	double scan_time = seconds_since(before) / scanned;
+
+	std::cout << "  " << std::setw(10) << name << std::setw(10) << walk_mesh.triangles.size()
+		<< std::setw(12) << bvh_time * 1e6 << std::setw(12) << scan_time * 1e6
+		<< "    " << mismatches << "/" << scanned << std::endl;
+}
+
+//------ walk_many ------
+
+//walk points spread over the walkmesh, with a small random step for each:
+struct Walkers {
+	std::vector< WalkMesh::WalkPoint > points;
+	std::vector< float > step_x, step_y, step_z;
+};
+static Walkers make_walkers(WalkMesh const &walk_mesh, uint32_t count, float step, uint32_t seed) {
+	Walkers walkers;
+	for (auto const &p : random_points(walk_mesh, count, 0.0f, seed)) {
+		walkers.points.emplace_back(walk_mesh.start(p));
+	}
+	std::mt19937 mt(seed);
+	std::uniform_real_distribution< float > unit(-1.0f, 1.0f);
+	for (uint32_t i = 0; i < count; ++i) {
+		walkers.step_x.emplace_back(step * unit(mt));
+		walkers.step_y.emplace_back(step * unit(mt));
+		walkers.step_z.emplace_back(0.0f);
+	}
+	return walkers;
+}
+
+static void bench_walk_many(WalkMesh const &walk_mesh, uint32_t count) {
+	Walkers walkers = make_walkers(walk_mesh, count, 0.02f, 3);
+	std::vector< WalkMesh::WalkPoint > &points = walkers.points;
+	WalkMesh::WalkPoints batch;
+	for (auto const &wp : points) batch.push_back(wp);
+
+	const uint32_t Ticks = std::max(10u, 1000000u / count);
+	double walk_time = 0.0, walk_many_time = 0.0;
+	float divergence = 0.0f;
+	for (uint32_t tick = 0; tick < Ticks; ++tick) {
+		auto before = Clock::now();
+		for (uint32_t i = 0; i < count; ++i) {
+			walk_mesh.walk(points[i], glm::vec3(walkers.step_x[i], walkers.step_y[i], walkers.step_z[i]));
+		}
+		walk_time += seconds_since(before);
+
+		before = Clock::now();
+		walk_mesh.walk_many(batch, walkers.step_x.data(), walkers.step_y.data(), walkers.step_z.data());
+		walk_many_time += seconds_since(before);
+	}
+	for (uint32_t i = 0; i < count; ++i) {
+		divergence = std::max(divergence, glm::distance(walk_mesh.world_point(points[i]), walk_mesh.world_point(walk_mesh.get(batch, i))));
+	}
+
+	double steps = double(Ticks) * count;
+	std::cout << "  " << std::setw(10) << count << std::setw(12) << walk_time / steps * 1e9 << std::setw(12) << walk_many_time / steps * 1e9
+		<< std::setw(14) << std::setprecision(6) << divergence << std::setprecision(2) << std::endl;
+}
+
+//------ barycentric ------
+
+//barycentric weights of 'point' (projected onto the triangle's plane) from the triangle's vertices, the way walk() used to:
+static glm::vec3 weights_from_vertices(glm::vec3 const &a, glm::vec3 const &b, glm::vec3 const &c, glm::vec3 const &point) {
+	glm::vec3 edge0 = b - a;
+	glm::vec3 edge1 = c - a;
+	glm::vec3 v0 = point - a;
+
+	float d00 = glm::dot(edge0, edge0);
+	float d01 = glm::dot(edge0, edge1);
+	float d11 = glm::dot(edge1, edge1);
+	float d20 = glm::dot(v0, edge0);
+	float d21 = glm::dot(v0, edge1);
+
+	float denom = d00 * d11 - d01 * d01;
+	float v = (d11 * d20 - d01 * d21) / denom;
+	float w = (d00 * d21 - d01 * d20) / denom;
+	return glm::vec3(1.0f - v - w, v, w);
+}
+
+static void bench_barycentric(WalkMesh const &walk_mesh) {
+	const uint32_t Count = 4096;
+	Walkers walkers = make_walkers(walk_mesh, Count, 0.02f, 7);
+
+	//each tick, find the weights of every walk point's next position (in its current triangle) both ways, then walk():
+	const uint32_t Ticks = 200;
+	std::vector< glm::vec3 > points(Count), from_vertices(Count), from_transforms(Count);
+	double vertices_time = 0.0, transforms_time = 0.0, walk_time = 0.0;
+	float difference = 0.0f;
+	for (uint32_t tick = 0; tick < Ticks; ++tick) {
+		for (uint32_t i = 0; i < Count; ++i) {
+			points[i] = walk_mesh.world_point(walkers.points[i]) + glm::vec3(walkers.step_x[i], walkers.step_y[i], walkers.step_z[i]);
+		}
+
+		auto before = Clock::now();
+		for (uint32_t i = 0; i < Count; ++i) {
+			glm::uvec3 const &tri = walkers.points[i].triangle;
+			from_vertices[i] = weights_from_vertices(walk_mesh.vertices[tri.x], walk_mesh.vertices[tri.y], walk_mesh.vertices[tri.z], points[i]);
+		}
+		vertices_time += seconds_since(before);
+
+		//(walk() only needs the change in weights, which is linear in the step)
+		before = Clock::now();
+		for (uint32_t i = 0; i < Count; ++i) {
+			glm::mat4x3 const &xf = walk_mesh.barycentric_transforms[walkers.points[i].triangle_index];
+			from_transforms[i] = walkers.points[i].weights + xf[0] * walkers.step_x[i] + xf[1] * walkers.step_y[i] + xf[2] * walkers.step_z[i];
+		}
+		transforms_time += seconds_since(before);
+
+		for (uint32_t i = 0; i < Count; ++i) {
+			glm::vec3 d = glm::abs(from_vertices[i] - from_transforms[i]);
+			difference = std::max(difference, std::max(d.x, std::max(d.y, d.z)));
+		}
+
+		before = Clock::now();
+		for (uint32_t i = 0; i < Count; ++i) {
+			walk_mesh.walk(walkers.points[i], glm::vec3(walkers.step_x[i], walkers.step_y[i], walkers.step_z[i]));
+		}
+		walk_time += seconds_since(before);
+	}
+
+	double steps = double(Ticks) * Count;
+	std::cout << "  from vertices " << vertices_time / steps * 1e9 << ", from transforms " << transforms_time / steps * 1e9
+		<< " (largest difference " << std::setprecision(6) << difference << std::setprecision(2) << "); walk() "
+		<< walk_time / steps * 1e9 << std::endl;
+}
+
+//------ path ------
+
+static void bench_path(WalkMesh const &walk_mesh, uint32_t cache_size) {
+	const uint32_t Count = 2000;
+	std::vector< glm::vec3 > from = random_points(walk_mesh, Count, 0.0f, 11);
+	std::vector< glm::vec3 > to = random_points(walk_mesh, Count, 0.0f, 12);
+
+	PathFinder path_finder(walk_mesh, cache_size);
+	std::vector< glm::vec3 > path;
+	std::vector< double > times; //of reachable queries
+	uint32_t unreachable = 0, off_mesh = 0;
+	for (uint32_t i = 0; i < Count; ++i) {
+		WalkMesh::WalkPoint start = walk_mesh.start(from[i]);
+		WalkMesh::WalkPoint goal = walk_mesh.start(to[i]);
+		auto before = Clock::now();
+		bool found = path_finder.find_path(start, goal, &path);
+		double time = seconds_since(before);
+		if (!found) {
+			++unreachable;
+			continue;
+		}
+		times.emplace_back(time);
+
+		//check that the path stays over the walkmesh, by sampling along it:
+		glm::vec3 at = walk_mesh.world_point(start);
+		bool on_mesh = true;
+		for (auto const &waypoint : path) {
+			for (uint32_t s = 1; s < 8; ++s) {
+				glm::vec3 sample = glm::mix(at, waypoint, s / 8.0f);
+				glm::vec3 closest = walk_mesh.world_point(walk_mesh.start(sample));
+				if (glm::length(glm::vec2(closest - sample)) > 0.02f) on_mesh = false;
+			}
+			at = waypoint;
+		}
+		if (!on_mesh) ++off_mesh;
+	}
+
+	std::sort(times.begin(), times.end());
+	double total = 0.0;
+	for (double t : times) total += t;
+	auto percentile = [&times](double p) { return times.empty() ? 0.0 : times[std::min(times.size() - 1, size_t(p * times.size()))]; };
+	std::cout << "  " << std::setw(6) << cache_size << std::setw(10) << (times.empty() ? 0.0 : total / times.size() * 1e6)
+		<< std::setw(10) << percentile(0.5) * 1e6 << std::setw(10) << percentile(0.9) * 1e6 << std::setw(10) << percentile(0.99) * 1e6
+		<< std::setw(10) << percentile(1.0) * 1e6 << "    " << unreachable << " unreachable, " << off_mesh << " leave the walkmesh; "
+		<< path_finder.cache_hits << " cache hits" << std::endl;
+}
+
+static void bench_path_chase(WalkMesh const &walk_mesh) {
+	//12 agents re-plan toward a goal that moves to a new random spot every 'frame':
+	const uint32_t Agents = 12, Frames = 200;
+	std::vector< glm::vec3 > agents = random_points(walk_mesh, Agents, 0.0f, 13);
+	std::vector< glm::vec3 > goals = random_points(walk_mesh, Frames, 0.0f, 14);
+	std::vector< WalkMesh::WalkPoint > starts;
+	for (auto const &p : agents) starts.emplace_back(walk_mesh.start(p));
+
+	PathFinder path_finder(walk_mesh);
+	std::vector< glm::vec3 > path;
+	auto before = Clock::now();
+	for (uint32_t f = 0; f < Frames; ++f) {
+		WalkMesh::WalkPoint goal = walk_mesh.start(goals[f]);
+		for (auto const &start : starts) {
+			path_finder.find_path(start, goal, &path);
+		}
+	}
+	double time = seconds_since(before) / (Agents * Frames);
+	std::cout << "  " << Agents << " agents chasing one goal: " << time * 1e6 << " us per query, "
+		<< path_finder.cache_hits << " cache hits / " << path_finder.cache_misses << " misses" << std::endl;
+}
+
+//------ flow ------
+
+static void bench_flow(WalkMesh const &walk_mesh) {
+	const uint32_t Agents = 10000;
+	const float Tick = 1.0f / 60.0f;
+	const float AgentSpeed = 2.0f, GoalSpeed = 1.0f; //(m/s)
+
+	//agents that can reach the goal:
+	PathFinder path_finder(walk_mesh);
+	auto component = [&](WalkMesh::WalkPoint const &wp) {
+		return path_finder.component[walk_mesh.triangle_polygons[wp.triangle_index]];
+	};
+	WalkMesh::WalkPoint goal = walk_mesh.start(random_points(walk_mesh, 1, 0.0f, 21)[0]);
+	WalkMesh::WalkPoints agents;
+	std::vector< WalkMesh::WalkPoint > agent_points;
+	for (uint32_t seed = 22; agents.size() < Agents; ++seed) {
+		for (auto const &p : random_points(walk_mesh, Agents, 0.0f, seed)) {
+			WalkMesh::WalkPoint wp = walk_mesh.start(p);
+			if (component(wp) != component(goal) || agents.size() == Agents) continue;
+			agents.push_back(wp);
+			agent_points.emplace_back(wp);
+		}
+	}
+
+	//flow field: the goal wanders (turning once a second) for 20s, then waits for 100s while the agents catch up:
+	FlowField flow_field(walk_mesh);
+	std::vector< float > step_x, step_y, step_z;
+	std::mt19937 mt(23);
+	std::uniform_real_distribution< float > unit(-1.0f, 1.0f);
+	glm::vec3 heading = glm::vec3(1.0f, 0.0f, 0.0f);
+	double goal_time = 0.0, steps_time = 0.0, walk_time = 0.0;
+	const uint32_t MovingTicks = 20 * 60, Ticks = 120 * 60;
+	for (uint32_t tick = 0; tick < Ticks; ++tick) {
+		if (tick < MovingTicks) {
+			if (tick % 60 == 0) heading = glm::vec3(unit(mt), unit(mt), 0.0f);
+			walk_mesh.walk(goal, heading * (GoalSpeed * Tick));
+		}
+
+		auto before = Clock::now();
+		flow_field.set_goal(goal);
+		goal_time += seconds_since(before);
+
+		before = Clock::now();
+		flow_field.steps(agents, AgentSpeed * Tick, &step_x, &step_y, &step_z);
+		steps_time += seconds_since(before);
+
+		before = Clock::now();
+		walk_mesh.walk_many(agents, step_x.data(), step_y.data(), step_z.data());
+		walk_time += seconds_since(before);
+
+		if (tick + 1 == MovingTicks) {
+			std::cout << "  flow field, goal moving: set_goal " << goal_time / MovingTicks * 1e6 << " us ("
+				<< flow_field.rebuilds << " rebuilds in " << MovingTicks << " ticks), steps " << steps_time / MovingTicks * 1e6
+				<< " us, walk_many " << walk_time / MovingTicks * 1e6 << " us => " << (goal_time + steps_time + walk_time) / MovingTicks * 1e3
+				<< " ms per tick" << std::endl;
+		}
+	}
+	glm::vec3 goal_point = walk_mesh.world_point(goal);
+	uint32_t arrived = 0;
+	for (uint32_t i = 0; i < agents.size(); ++i) {
+		if (glm::distance(walk_mesh.world_point(walk_mesh.get(agents, i)), goal_point) < 1.0f) ++arrived;
+	}
+	std::cout << "  flow field, goal still for 100s: " << arrived << " of " << agents.size() << " agents within 1m of it" << std::endl;
+
+	//per-agent A*: re-plan every agent once toward the goal (as each agent would every time the goal moved far enough):
+	std::vector< glm::vec3 > path;
+	auto before = Clock::now();
+	for (auto const &wp : agent_points) {
+		path_finder.find_path(wp, goal, &path);
+	}
+	double plan_time = seconds_since(before);
+	std::cout << "  per-agent A*: " << plan_time * 1e3 << " ms to re-plan all " << agent_points.size() << " agents ("
+		<< plan_time / agent_points.size() * 1e6 << " us each; " << path_finder.cache_hits << " cache hits)" << std::endl;
+}
+
+//agents on a piece of walkmesh that doesn't connect to the goal (or with no goal set) should be left where they are:
+static void check_flow_unreachable() {
+	//two 4m squares, 6m apart:
+	std::vector< glm::vec3 > vertices;
+	std::vector< glm::uvec3 > triangles;
+	for (float x : {0.0f, 10.0f}) {
+		uint32_t a = uint32_t(vertices.size());
+		vertices.insert(vertices.end(), { glm::vec3(x, 0.0f, 0.0f), glm::vec3(x + 4.0f, 0.0f, 0.0f), glm::vec3(x + 4.0f, 4.0f, 0.0f), glm::vec3(x, 4.0f, 0.0f) });
+		triangles.emplace_back(a, a + 1, a + 2);
+		triangles.emplace_back(a, a + 2, a + 3);
+	}
+	WalkMesh islands(vertices, triangles);
+	FlowField flow_field(islands);
+
+	WalkMesh::WalkPoints agents;
+	agents.push_back(islands.start(glm::vec3(3.0f, 3.0f, 0.0f))); //(same square as the goal)
+	agents.push_back(islands.start(glm::vec3(12.0f, 2.0f, 0.0f))); //(the other square)
+	glm::vec3 stranded = islands.world_point(islands.get(agents, 1));
+
+	std::vector< float > step_x, step_y, step_z;
+	float moved_without_goal = 0.0f;
+	flow_field.steps(agents, 0.1f, &step_x, &step_y, &step_z);
+	for (uint32_t i = 0; i < agents.size(); ++i) {
+		moved_without_goal = std::max(moved_without_goal, glm::length(glm::vec3(step_x[i], step_y[i], step_z[i])));
+	}
+
+	WalkMesh::WalkPoint goal = islands.start(glm::vec3(1.0f, 1.0f, 0.0f));
+	flow_field.set_goal(goal);
+	float direction = glm::length(flow_field.direction(islands.get(agents, 1)));
+	for (uint32_t tick = 0; tick < 60; ++tick) {
+		flow_field.steps(agents, 0.1f, &step_x, &step_y, &step_z);
+		islands.walk_many(agents, step_x.data(), step_y.data(), step_z.data());
+	}
+	float reached = glm::distance(islands.world_point(islands.get(agents, 0)), islands.world_point(goal));
+	float moved = glm::distance(islands.world_point(islands.get(agents, 1)), stranded);
+
+	std::cout << "  unreachable goal: stranded agent moved " << moved << " m (direction length " << direction
+		<< "), reachable agent ended " << reached << " m from the goal, agents moved up to " << moved_without_goal << " m with no goal set" << std::endl;
+	if (moved != 0.0f || direction != 0.0f || moved_without_goal != 0.0f || reached > 0.01f) {
+		throw std::runtime_error("Flow field moved an agent that can't reach the goal (or failed to move one that can).");
+	}
+}
+
+//------ ray ------
+
+//closest hit of a ray against every triangle (in [0, t_max]), or infinity if none:
+static float raycast_every_triangle(TriangleBVH const &bvh, glm::vec3 const &origin, glm::vec3 const &direction, float t_max) {
+	float closest = std::numeric_limits< float >::infinity();
+	for (auto const &tri : bvh.triangles) {
+		glm::vec3 p = glm::cross(direction, tri.ac);
+		float det = glm::dot(tri.ab, p);
+		if (det == 0.0f) continue;
+		glm::vec3 s = origin - tri.a;
+		float u = glm::dot(s, p) / det;
+		if (u < 0.0f || u > 1.0f) continue;
+		glm::vec3 q = glm::cross(s, tri.ab);
+		float v = glm::dot(direction, q) / det;
+		if (v < 0.0f || u + v > 1.0f) continue;
+		float t = glm::dot(tri.ac, q) / det;
+		if (t >= 0.0f && t <= t_max) closest = std::min(closest, t);
+	}
+	return closest;
+}
+
+static void bench_ray(WalkMesh const &walk_mesh) {
+	//the walkmesh, plus walls along its boundary edges:
+	TriangleBVH bvh;
+	bvh.add_walkmesh(walk_mesh);
+	std::vector< glm::vec3 > walls;
+	for (uint32_t t = 0; t < walk_mesh.triangles.size(); ++t) {
+		for (uint32_t e = 0; e < 3; ++e) {
+			if (walk_mesh.triangle_neighbors[t][e] != -1U) continue;
+			glm::vec3 a = walk_mesh.vertices[walk_mesh.triangles[t][e]];
+			glm::vec3 b = walk_mesh.vertices[walk_mesh.triangles[t][(e + 1) % 3]];
+			glm::vec3 up = glm::vec3(0.0f, 0.0f, 2.0f);
+			walls.insert(walls.end(), {a, b, b + up, a, b + up, a + up});
+		}
+	}
+	bvh.add_triangles(walls.data(), uint32_t(walls.size()));
+	auto before = Clock::now();
+	bvh.build();
+	std::cout << "  " << bvh.triangles.size() << " triangles (" << walls.size() / 3 << " of them walls), " << bvh.nodes.size()
+		<< " nodes, built in " << seconds_since(before) * 1e3 << " ms" << std::endl;
+
+	//random rays from about head height, mostly level:
+	const uint32_t Count = 1000000, Checked = 2000;
+	std::vector< glm::vec3 > origins = random_points(walk_mesh, Count, 1.0f, 31);
+	std::mt19937 mt(32);
+	std::uniform_real_distribution< float > unit(-1.0f, 1.0f);
+	std::vector< TriangleBVH::Ray > rays(Count);
+	for (uint32_t i = 0; i < Count; ++i) {
+		rays[i].origin = origins[i];
+		rays[i].direction = glm::normalize(glm::vec3(unit(mt), unit(mt), 0.3f * unit(mt)));
+	}
+	std::vector< TriangleBVH::Hit > hits(Count);
+	before = Clock::now();
+	bvh.raycast_many(rays.data(), Count, hits.data());
+	double ray_time = seconds_since(before);
+
+	uint32_t hit = 0, mismatches = 0;
+	for (auto const &h : hits) {
+		if (h.triangle != -1U) ++hit;
+	}
+	for (uint32_t i = 0; i < Checked; ++i) {
+		float t = raycast_every_triangle(bvh, rays[i].origin, rays[i].direction, rays[i].t_max);
+		bool expected = (t != std::numeric_limits< float >::infinity());
+		bool got = (hits[i].triangle != -1U);
+		if (expected != got || (expected && std::abs(t - hits[i].t) > 1e-4f)) ++mismatches;
+	}
+	//rays down onto a lone triangle, half of which pass through its leaf's box without hitting it:
+	// (these must come back as misses even though, like the default Ray, they have no t_max)
+	uint32_t false_hits = 0, misses = 0;
+	{
+		TriangleBVH single;
+		glm::vec3 corners[3] = {glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f)};
+		single.add_triangles(corners, 3);
+		single.build();
+		for (uint32_t y = 0; y < 40; ++y) {
+			for (uint32_t x = 0; x < 40; ++x) {
+				TriangleBVH::Ray down;
+				down.origin = glm::vec3((x + 0.5f) / 40.0f, (y + 0.5f) / 40.0f, 1.0f);
+				down.direction = glm::vec3(0.0f, 0.0f, -1.0f);
+				TriangleBVH::Hit h;
+				bool got = single.raycast(down, &h);
+				bool expected = (down.origin.x + down.origin.y <= 1.0f);
+				if (!expected) ++misses;
+				if (got && !expected) ++false_hits;
+				else if (got != expected || (expected && std::abs(h.t - 1.0f) > 1e-6f)) ++mismatches;
+			}
+		}
+	}
+	std::cout << "  raycast_many: " << Count / ray_time * 1e-6 << "M rays/s (" << hit * 100.0 / Count << "% hit); "
+		<< mismatches << "/" << Checked << " disagree with testing every triangle; " << false_hits << "/" << misses << " misses of a lone triangle reported as hits" << std::endl;
+
+	//10m line of sight checks:
+	std::vector< glm::vec3 > from(Count), to(Count);
+	for (uint32_t i = 0; i < Count; ++i) {
+		from[i] = origins[i];
+		to[i] = origins[i] + 10.0f * glm::normalize(glm::vec3(unit(mt), unit(mt), 0.0f));
+	}
+	std::unique_ptr< bool[] > occluded(new bool[Count]);
+	before = Clock::now();
+	bvh.occluded_many(from.data(), to.data(), Count, occluded.get());
+	double occluded_time = seconds_since(before);
+
+	uint32_t blocked = 0;
+	mismatches = 0;
+	for (uint32_t i = 0; i < Count; ++i) {
+		if (occluded[i]) ++blocked;
+	}
+	for (uint32_t i = 0; i < Checked; ++i) {
+		bool expected = (raycast_every_triangle(bvh, from[i], to[i] - from[i], 1.0f) != std::numeric_limits< float >::infinity());
+		if (expected != occluded[i]) ++mismatches;
+	}
+	std::cout << "  occluded_many: " << Count / occluded_time * 1e-6 << "M queries/s (" << blocked * 100.0 / Count << "% blocked); "
+		<< mismatches << "/" << Checked << " disagree with testing every triangle" << std::endl;
+}
+
+int main(int argc, char **argv) {
+	if (argc < 2) {
+		std::cerr << "Usage:\n\t./bench_walkmesh <in.w or in.wc> [start|walk_many|barycentric|path|flow|ray]..." << std::endl;
+		return 1;
+	}
+
+	try {
+		WalkMesh walk_mesh(argv[1]);
+		std::vector< std::string > sections(argv + 2, argv + argc);
+		auto run = [&sections](std::string const &section) {
+			return sections.empty() || std::find(sections.begin(), sections.end(), section) != sections.end();
+		};
+
+		std::cout << std::fixed << std::setprecision(2);
+		std::cout << "'" << argv[1] << "': " << walk_mesh.triangles.size() << " triangles, "
+			<< walk_mesh.polygons.size() << " polygons." << std::endl;
+
+		if (run("start")) {
+			std::cout << "start: closest point queries, bvh vs. scanning every triangle (us per query)" << std::endl;
+			std::cout << "  " << std::setw(10) << "mesh" << std::setw(10) << "triangles" << std::setw(12) << "bvh" << std::setw(12) << "scan"
+				<< "    mismatches" << std::endl;
+			bench_start(walk_mesh, "given");
+			for (uint32_t size : {16, 64, 256, 1024}) {
+				bench_start(*make_grid(size), "grid " + std::to_string(size));
+			}
+		}
+
+		if (run("walk_many")) {
+			std::cout << "walk_many: stepping walk points (each by the same ~2cm step every tick), walk() each vs. walk_many() (ns per point)" << std::endl;
+			std::cout << "  " << std::setw(10) << "points" << std::setw(12) << "walk" << std::setw(12) << "walk_many" << std::setw(14) << "divergence" << std::endl;
+			for (uint32_t count : {64, 1024, 16384}) {
+				bench_walk_many(walk_mesh, count);
+			}
+		}
+
+		if (run("barycentric")) {
+			std::cout << "barycentric: weights of 4096 walk points' next positions (ns per point)" << std::endl;
+			bench_barycentric(walk_mesh);
+		}
+
+		if (run("path")) {
+			std::cout << "path: find_path between 2000 random pairs of points (us per reachable query)" << std::endl;
+			std::cout << "  " << std::setw(6) << "cache" << std::setw(10) << "mean" << std::setw(10) << "p50" << std::setw(10) << "p90"
+				<< std::setw(10) << "p99" << std::setw(10) << "max" << std::endl;
+			bench_path(walk_mesh, 0);
+			bench_path(walk_mesh, 32);
+			bench_path_chase(walk_mesh);
+		}
+
+		if (run("flow")) {
+			std::cout << "flow: 10k agents chasing one goal at 60Hz" << std::endl;
+			bench_flow(walk_mesh);
+			check_flow_unreachable();
+		}
+
+		if (run("ray")) {
+			std::cout << "ray: 1M random rays and 1M 10m line of sight checks" << std::endl;
+			bench_ray(walk_mesh);
+		}
+	} catch (std::exception &e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
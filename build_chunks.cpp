@@ -0,0 +1,384 @@
+//build_chunks splits a level's static scenery into chunks for LevelStreamer (see LevelStreamer.hpp).
+// Every mesh object in the scene whose name doesn't start with a '--keep' prefix is baked to world space and its triangles
+//  are sorted into square chunks on a grid (by centroid), grouped within each chunk by object name.
+// The meshes of the kept objects (e.g., things that move) are written to a separate '.pnct' file that is loaded as usual.
+//NOTE: triangles aren't split at chunk borders, so a chunk's bounds may stick out of its grid square by up to a triangle.
+
+#include "LevelStreamer.hpp"
+#include "read_chunk.hpp"
+
+#include <glm/gtc/quaternion.hpp>
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <map>
+#include <limits>
+#include <cmath>
+#include <cstdlib>
+
+typedef LevelStreamer::Vertex Vertex;
+
+int main(int argc, char **argv) {
+	if (argc < 5) {
+		std::cerr << "Usage:\n\t./build_chunks <in.scene> <in.pnct> <out.chunks> <out.pnct> [--size chunk size] [--keep name prefix]..." << std::endl;
+		return 1;
+	}
+
+	try {
+		auto before = std::chrono::high_resolution_clock::now();
+
+		std::string scene_filename = argv[1];
+		std::string pnct_filename = argv[2];
+		std::string chunks_filename = argv[3];
+		std::string resident_filename = argv[4];
+		float chunk_size = 8.0f;
+		std::vector< std::string > keep;
+		for (int i = 5; i < argc; ++i) {
+			std::string arg = argv[i];
+			if (arg == "--size" && i + 1 < argc) {
+				chunk_size = float(std::atof(argv[++i]));
+			} else if (arg == "--keep" && i + 1 < argc) {
+				keep.emplace_back(argv[++i]);
+			} else {
+				throw std::runtime_error("Unexpected argument '" + arg + "'.");
+			}
+		}
+		if (!(chunk_size > 0.0f)) throw std::runtime_error("Chunk size should be positive.");
+
+		//read the scene's hierarchy and mesh objects (the same layout as Scene::load reads):
+		std::vector< char > scene_names;
+		struct HierarchyEntry {
+			uint32_t parent;
+			uint32_t name_begin;
+			uint32_t name_end;
+			glm::vec3 position;
+			glm::quat rotation;
+			glm::vec3 scale;
+		};
+		static_assert(sizeof(HierarchyEntry) == 4 + 4 + 4 + 4*3 + 4*4 + 4*3, "HierarchyEntry is packed.");
+		std::vector< HierarchyEntry > hierarchy;
+		struct MeshEntry {
+			uint32_t transform;
+			uint32_t name_begin;
+			uint32_t name_end;
+		};
+		static_assert(sizeof(MeshEntry) == 4 + 4 + 4, "MeshEntry is packed.");
+		std::vector< MeshEntry > mesh_entries;
+		{
+			std::ifstream file(scene_filename, std::ios::binary);
+			if (!file) throw std::runtime_error("Failed to open scene file '" + scene_filename + "'.");
+			read_chunk(file, "str0", &scene_names);
+			read_chunk(file, "xfh0", &hierarchy);
+			read_chunk(file, "msh0", &mesh_entries);
+		}
+		auto scene_name = [&](uint32_t begin, uint32_t end) {
+			if (!(begin <= end && end <= scene_names.size())) {
+				throw std::runtime_error("Scene file '" + scene_filename + "' contains invalid name indices.");
+			}
+			return std::string(scene_names.begin() + begin, scene_names.begin() + end);
+		};
+
+		//read the meshes (the same layout as MeshBuffer reads):
+		std::vector< Vertex > vertices;
+		std::vector< char > mesh_names;
+		struct IndexEntry {
+			uint32_t name_begin, name_end;
+			uint32_t vertex_begin, vertex_end;
+		};
+		static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
+		std::vector< IndexEntry > index;
+		struct LodEntry {
+			uint32_t mesh; //index entry of the full-detail mesh
+			uint32_t vertex_begin, vertex_end;
+			float max_size;
+		};
+		static_assert(sizeof(LodEntry) == 16, "LOD entry should be packed");
+		std::vector< LodEntry > lods; //(levels of detail, if build_lods has been run on the file; carried over for kept meshes)
+		{
+			std::ifstream file(pnct_filename, std::ios::binary);
+			if (!file) throw std::runtime_error("Failed to open mesh file '" + pnct_filename + "'.");
+			read_chunk(file, "pnct", &vertices);
+			read_chunk(file, "str0", &mesh_names);
+			read_chunk(file, "idx0", &index);
+			if (file.peek() != EOF) read_chunk(file, "lod0", &lods);
+		}
+		std::map< std::string, uint32_t > mesh_index; //name -> index entry
+		for (uint32_t i = 0; i < index.size(); ++i) {
+			IndexEntry const &entry = index[i];
+			if (!(entry.name_begin <= entry.name_end && entry.name_end <= mesh_names.size())) {
+				throw std::runtime_error("index entry has out-of-range name begin/end");
+			}
+			if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= vertices.size())) {
+				throw std::runtime_error("index entry has out-of-range vertex start/count");
+			}
+			mesh_index.insert(std::make_pair(std::string(mesh_names.begin() + entry.name_begin, mesh_names.begin() + entry.name_end), i));
+		}
+
+		//world matrices for the hierarchy (as in Scene::Transform::make_local_to_world):
+		std::vector< glm::mat4 > local_to_world;
+		local_to_world.reserve(hierarchy.size());
+		for (auto const &h : hierarchy) {
+			glm::mat4 local = glm::mat4(
+				glm::vec4(1.0f, 0.0f, 0.0f, 0.0f),
+				glm::vec4(0.0f, 1.0f, 0.0f, 0.0f),
+				glm::vec4(0.0f, 0.0f, 1.0f, 0.0f),
+				glm::vec4(h.position, 1.0f)
+			)
+			* glm::mat4_cast(h.rotation)
+			* glm::mat4(
+				glm::vec4(h.scale.x, 0.0f, 0.0f, 0.0f),
+				glm::vec4(0.0f, h.scale.y, 0.0f, 0.0f),
+				glm::vec4(0.0f, 0.0f, h.scale.z, 0.0f),
+				glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)
+			);
+			if (h.parent != -1U) {
+				if (h.parent >= local_to_world.size()) {
+					throw std::runtime_error("Scene file '" + scene_filename + "' did not contain transforms in topological-sort order.");
+				}
+				local = local_to_world[h.parent] * local;
+			}
+			local_to_world.emplace_back(local);
+		}
+
+		//bake streamed objects' triangles to world space; gather kept objects' meshes:
+		std::vector< std::string > names; //streamed objects' names
+		std::map< std::string, uint32_t > name_ids;
+		struct Triangle {
+			uint32_t name;
+			Vertex corners[3];
+		};
+		std::vector< Triangle > triangles;
+		std::vector< std::string > kept; //kept meshes' names (in file order)
+		for (auto const &m : mesh_entries) {
+			if (m.transform >= hierarchy.size()) {
+				throw std::runtime_error("Scene file '" + scene_filename + "' contains mesh entry with invalid transform index (" + std::to_string(m.transform) + ")");
+			}
+			std::string object_name = scene_name(hierarchy[m.transform].name_begin, hierarchy[m.transform].name_end);
+			std::string mesh_name = scene_name(m.name_begin, m.name_end);
+			auto f = mesh_index.find(mesh_name);
+			if (f == mesh_index.end()) {
+				throw std::runtime_error("Mesh '" + mesh_name + "' (used by '" + object_name + "') isn't in '" + pnct_filename + "'.");
+			}
+			IndexEntry const &entry = index[f->second];
+
+			bool is_kept = std::any_of(keep.begin(), keep.end(), [&](std::string const &prefix){
+				return object_name.compare(0, prefix.size(), prefix) == 0;
+			});
+			if (is_kept) {
+				if (std::find(kept.begin(), kept.end(), mesh_name) == kept.end()) kept.emplace_back(mesh_name);
+				continue;
+			}
+
+			auto inserted = name_ids.insert(std::make_pair(object_name, uint32_t(names.size())));
+			if (inserted.second) names.emplace_back(object_name);
+
+			glm::mat4 const &xf = local_to_world[m.transform];
+			glm::mat3 normal_xf = glm::inverse(glm::transpose(glm::mat3(xf)));
+			bool flip = (glm::determinant(glm::mat3(xf)) < 0.0f); //(mirrored transforms reverse the winding)
+			for (uint32_t v = entry.vertex_begin; v + 2 < entry.vertex_end; v += 3) {
+				Triangle triangle;
+				triangle.name = inserted.first->second;
+				for (uint32_t c = 0; c < 3; ++c) {
+					Vertex corner = vertices[v + c];
+					corner.Position = glm::vec3(xf * glm::vec4(corner.Position, 1.0f));
+					corner.Normal = glm::normalize(normal_xf * corner.Normal);
+					triangle.corners[flip ? 2 - c : c] = corner;
+				}
+				triangles.emplace_back(triangle);
+			}
+		}
+
+		//lay the grid over the triangles' centroids:
+		LevelStreamer::Header header;
+		header.chunk_size = chunk_size;
+		auto centroid = [](Triangle const &t) {
+			return glm::vec2(t.corners[0].Position + t.corners[1].Position + t.corners[2].Position) / 3.0f;
+		};
+		glm::vec2 min = glm::vec2(std::numeric_limits< float >::infinity());
+		glm::vec2 max = -min;
+		for (auto const &t : triangles) {
+			min = glm::min(min, centroid(t));
+			max = glm::max(max, centroid(t));
+		}
+		if (!triangles.empty()) {
+			header.origin = min;
+			header.width = uint32_t(std::floor((max.x - min.x) / chunk_size)) + 1;
+			header.height = uint32_t(std::floor((max.y - min.y) / chunk_size)) + 1;
+		}
+		auto cell_of = [&](Triangle const &t) {
+			glm::vec2 at = (centroid(t) - header.origin) / chunk_size;
+			uint32_t x = std::min(header.width - 1, uint32_t(std::max(0.0f, at.x)));
+			uint32_t y = std::min(header.height - 1, uint32_t(std::max(0.0f, at.y)));
+			return y * header.width + x;
+		};
+
+		//sort triangles by chunk, then by name within each chunk:
+		std::vector< std::pair< uint64_t, uint32_t > > order; //((cell, name), triangle)
+		order.reserve(triangles.size());
+		for (uint32_t i = 0; i < triangles.size(); ++i) {
+			order.emplace_back((uint64_t(cell_of(triangles[i])) << 32) | triangles[i].name, i);
+		}
+		std::sort(order.begin(), order.end());
+
+		//string table: streamed names, then kept mesh names (for the resident file's own table, below):
+		std::vector< char > strings;
+		std::vector< std::pair< uint32_t, uint32_t > > name_ranges;
+		for (auto const &name : names) {
+			name_ranges.emplace_back(uint32_t(strings.size()), uint32_t(strings.size() + name.size()));
+			strings.insert(strings.end(), name.begin(), name.end());
+		}
+
+		//each chunk's data, plus the per-name positions that stay resident:
+		std::vector< LevelStreamer::ChunkInfo > infos;
+		std::vector< std::vector< char > > datas;
+		std::vector< std::vector< glm::vec3 > > name_positions(names.size());
+		for (uint32_t begin = 0; begin < order.size(); ) {
+			uint32_t cell = uint32_t(order[begin].first >> 32);
+			uint32_t end = begin;
+			while (end < order.size() && uint32_t(order[end].first >> 32) == cell) ++end;
+
+			std::vector< Vertex > chunk_vertices;
+			std::vector< LevelStreamer::ChunkPart > parts;
+			uint32_t part_name = -1U;
+			for (uint32_t i = begin; i < end; ++i) {
+				Triangle const &t = triangles[order[i].second];
+				if (t.name != part_name) {
+					part_name = t.name;
+					parts.emplace_back();
+					LevelStreamer::ChunkPart &part = parts.back();
+					part.name_begin = name_ranges[t.name].first;
+					part.name_end = name_ranges[t.name].second;
+					part.vertex_begin = part.vertex_end = uint32_t(chunk_vertices.size());
+					part.min = glm::vec3(std::numeric_limits< float >::infinity());
+					part.max = -part.min;
+				}
+				LevelStreamer::ChunkPart &part = parts.back();
+				for (auto const &corner : t.corners) {
+					chunk_vertices.emplace_back(corner);
+					part.min = glm::min(part.min, corner.Position);
+					part.max = glm::max(part.max, corner.Position);
+					name_positions[t.name].emplace_back(corner.Position);
+				}
+				part.vertex_end = uint32_t(chunk_vertices.size());
+			}
+
+			LevelStreamer::ChunkInfo info;
+			info.x = cell % header.width;
+			info.y = cell / header.width;
+			info.min = parts[0].min;
+			info.max = parts[0].max;
+			for (auto const &part : parts) {
+				info.min = glm::min(info.min, part.min);
+				info.max = glm::max(info.max, part.max);
+			}
+			info.vertices = uint32_t(chunk_vertices.size());
+			header.max_vertices = std::max(header.max_vertices, info.vertices);
+
+			std::ostringstream data;
+			write_chunk(data, "pnct", chunk_vertices);
+			write_chunk(data, "lcq0", parts);
+			datas.emplace_back();
+			std::string const &str = data.str();
+			datas.back().assign(str.begin(), str.end());
+			info.offset = (infos.empty() ? 0 : infos.back().offset + infos.back().size);
+			info.size = uint32_t(datas.back().size());
+			infos.emplace_back(info);
+
+			begin = end;
+		}
+
+		std::vector< LevelStreamer::ResidentMesh > resident;
+		std::vector< glm::vec3 > positions;
+		for (uint32_t n = 0; n < names.size(); ++n) {
+			LevelStreamer::ResidentMesh r;
+			r.name_begin = name_ranges[n].first;
+			r.name_end = name_ranges[n].second;
+			r.vertex_begin = uint32_t(positions.size());
+			positions.insert(positions.end(), name_positions[n].begin(), name_positions[n].end());
+			r.vertex_end = uint32_t(positions.size());
+			resident.emplace_back(r);
+		}
+
+		//write the chunks file:
+		{
+			std::ofstream file(chunks_filename, std::ios::binary);
+			write_chunk(file, "lch0", std::vector< LevelStreamer::Header >(1, header));
+			write_chunk(file, "str0", strings);
+			write_chunk(file, "lci0", infos);
+			write_chunk(file, "lcm0", resident);
+			write_chunk(file, "lcp0", positions);
+			for (auto const &data : datas) {
+				file.write(data.data(), data.size());
+			}
+			if (!file) throw std::runtime_error("Failed to write '" + chunks_filename + "'.");
+		}
+
+		//write the kept meshes as their own '.pnct' file:
+		uint32_t kept_vertices = 0;
+		{
+			std::vector< Vertex > out_vertices;
+			std::vector< char > out_strings;
+			std::vector< IndexEntry > out_index;
+			std::vector< LodEntry > out_lods;
+			for (auto const &name : kept) {
+				uint32_t m = mesh_index[name];
+				IndexEntry const &entry = index[m];
+				IndexEntry out;
+				out.name_begin = uint32_t(out_strings.size());
+				out_strings.insert(out_strings.end(), name.begin(), name.end());
+				out.name_end = uint32_t(out_strings.size());
+				out.vertex_begin = uint32_t(out_vertices.size());
+				out_vertices.insert(out_vertices.end(), vertices.begin() + entry.vertex_begin, vertices.begin() + entry.vertex_end);
+				out.vertex_end = uint32_t(out_vertices.size());
+				out_index.emplace_back(out);
+				for (auto const &lod : lods) {
+					if (lod.mesh != m) continue;
+					if (!(lod.vertex_begin <= lod.vertex_end && lod.vertex_end <= vertices.size())) {
+						throw std::runtime_error("level-of-detail entry has out-of-range vertex start/count");
+					}
+					LodEntry out_lod = lod;
+					out_lod.mesh = uint32_t(out_index.size() - 1);
+					out_lod.vertex_begin = uint32_t(out_vertices.size());
+					out_vertices.insert(out_vertices.end(), vertices.begin() + lod.vertex_begin, vertices.begin() + lod.vertex_end);
+					out_lod.vertex_end = uint32_t(out_vertices.size());
+					out_lods.emplace_back(out_lod);
+				}
+			}
+			std::ofstream file(resident_filename, std::ios::binary);
+			write_chunk(file, "pnct", out_vertices);
+			write_chunk(file, "str0", out_strings);
+			write_chunk(file, "idx0", out_index);
+			if (!out_lods.empty()) write_chunk(file, "lod0", out_lods);
+			kept_vertices = uint32_t(out_vertices.size());
+		}
+
+		auto after = std::chrono::high_resolution_clock::now();
+
+		std::cout << "Built chunks for '" << scene_filename << "': " << header.width << "x" << header.height << " grid of size " << chunk_size << ", "
+			<< infos.size() << " non-empty chunks of " << names.size() << " objects' " << triangles.size() << " triangles, at most "
+			<< header.max_vertices << " vertices (" << header.max_vertices * sizeof(Vertex) << " bytes) per chunk (built in "
+			<< std::chrono::duration< double >(after - before).count() * 1000.0 << "ms) to '" << chunks_filename << "'; "
+			<< kept.size() << " kept meshes (" << kept_vertices << " vertices) to '" << resident_filename << "'." << std::endl;
+
+		//check that the index reads back:
+		{
+			std::ifstream file(chunks_filename, std::ios::binary);
+			std::vector< LevelStreamer::Header > headers;
+			read_chunk(file, "lch0", &headers);
+			read_chunk(file, "str0", &strings);
+			read_chunk(file, "lci0", &infos);
+			read_chunk(file, "lcm0", &resident);
+			read_chunk(file, "lcp0", &positions);
+			if (headers.size() != 1 || infos.size() != datas.size()) throw std::runtime_error("Chunks file didn't read back.");
+		}
+	} catch (std::exception &e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,223 @@
+//build_lods adds levels of detail to the meshes in a '.pnct' file (see MeshBuffer::Mesh::lods).
+// Each level is made by vertex clustering: the mesh's vertices are snapped to a grid, vertices sharing a grid cell are merged
+//  (at their average position, with averaged normals), and triangles that collapse or duplicate another are dropped.
+// The grid is coarsened until the level has at most half the triangles of the one before it.
+// A level's 'max_size' is set so that, below it, its grid cells (roughly its error) cover less than '--pixels' pixels
+//  on a '--height'-pixel-tall view.
+//The levels' vertices are appended to the file's vertex data, and a "lod0" chunk lists them:
+// "pnct": vertices (the input's, then each level's)
+// "str0", "idx0": as in the input
+// "lod0": for each level, the index entry of its mesh, its vertex range, and its max_size (coarser levels of a mesh come later)
+
+#include "read_chunk.hpp"
+
+#include <glm/glm.hpp>
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <cmath>
+#include <cstdlib>
+
+struct Vertex {
+	glm::vec3 Position;
+	glm::vec3 Normal;
+	glm::u8vec4 Color;
+	glm::vec2 TexCoord;
+};
+static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
+
+struct IndexEntry {
+	uint32_t name_begin, name_end;
+	uint32_t vertex_begin, vertex_end;
+};
+static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
+
+struct LodEntry {
+	uint32_t mesh; //index entry of the full-detail mesh
+	uint32_t vertex_begin, vertex_end;
+	float max_size;
+};
+static_assert(sizeof(LodEntry) == 16, "LOD entry should be packed");
+
+//simplify the triangle list 'in' by merging vertices within the same cell of a grid of size 'cell' anchored at 'origin':
+static std::vector< Vertex > cluster(std::vector< Vertex > const &in, glm::vec3 const &origin, float cell) {
+	//assign each vertex to a cluster:
+	std::unordered_map< uint64_t, uint32_t > cluster_of_cell;
+	std::vector< uint32_t > cluster_of(in.size());
+	struct Cluster {
+		glm::vec3 position_sum = glm::vec3(0.0f);
+		glm::vec3 normal_sum = glm::vec3(0.0f);
+		uint32_t count = 0;
+		uint32_t representative = 0; //(vertex whose color and texcoord the cluster keeps)
+	};
+	std::vector< Cluster > clusters;
+	for (uint32_t v = 0; v < in.size(); ++v) {
+		glm::ivec3 c = glm::ivec3(glm::floor((in[v].Position - origin) / cell));
+		uint64_t key = (uint64_t(uint32_t(c.x) & 0x1fffff) << 42) | (uint64_t(uint32_t(c.y) & 0x1fffff) << 21) | uint64_t(uint32_t(c.z) & 0x1fffff);
+		auto inserted = cluster_of_cell.insert(std::make_pair(key, uint32_t(clusters.size())));
+		if (inserted.second) {
+			clusters.emplace_back();
+			clusters.back().representative = v;
+		}
+		Cluster &cluster = clusters[inserted.first->second];
+		cluster.position_sum += in[v].Position;
+		cluster.normal_sum += in[v].Normal;
+		cluster.count += 1;
+		cluster_of[v] = inserted.first->second;
+	}
+
+	if (clusters.size() > 0x1fffff) throw std::runtime_error("Too many vertices to cluster.");
+
+	std::vector< Vertex > merged;
+	merged.reserve(clusters.size());
+	for (auto const &cluster : clusters) {
+		Vertex vertex = in[cluster.representative];
+		vertex.Position = cluster.position_sum / float(cluster.count);
+		if (glm::length(cluster.normal_sum) > 1e-6f) vertex.Normal = glm::normalize(cluster.normal_sum);
+		merged.emplace_back(vertex);
+	}
+
+	//keep triangles whose corners land in three different clusters (once each, in any rotation):
+	std::vector< Vertex > out;
+	std::unordered_set< uint64_t > seen;
+	for (uint32_t t = 0; t + 2 < in.size(); t += 3) {
+		uint32_t a = cluster_of[t], b = cluster_of[t + 1], c = cluster_of[t + 2];
+		if (a == b || b == c || c == a) continue;
+		//(rotate so the smallest cluster comes first, which keeps the winding)
+		while (a > b || a > c) {
+			uint32_t temp = a; a = b; b = c; c = temp;
+		}
+		uint64_t key = (uint64_t(a) << 42) | (uint64_t(b) << 21) | uint64_t(c);
+		if (!seen.insert(key).second) continue;
+		out.emplace_back(merged[a]);
+		out.emplace_back(merged[b]);
+		out.emplace_back(merged[c]);
+	}
+	return out;
+}
+
+int main(int argc, char **argv) {
+	if (argc < 3) {
+		std::cerr << "Usage:\n\t./build_lods <in.pnct> <out.pnct> [--mesh name prefix]... [--levels count] [--pixels error] [--height view height]" << std::endl;
+		return 1;
+	}
+
+	try {
+		auto before = std::chrono::high_resolution_clock::now();
+
+		std::string in_filename = argv[1];
+		std::string out_filename = argv[2];
+		std::vector< std::string > prefixes; //(all meshes, if none given)
+		uint32_t max_levels = 3;
+		float pixels = 2.0f;
+		float height = 1080.0f;
+		for (int i = 3; i < argc; ++i) {
+			std::string arg = argv[i];
+			if (arg == "--mesh" && i + 1 < argc) {
+				prefixes.emplace_back(argv[++i]);
+			} else if (arg == "--levels" && i + 1 < argc) {
+				max_levels = uint32_t(std::atoi(argv[++i]));
+			} else if (arg == "--pixels" && i + 1 < argc) {
+				pixels = float(std::atof(argv[++i]));
+			} else if (arg == "--height" && i + 1 < argc) {
+				height = float(std::atof(argv[++i]));
+			} else {
+				throw std::runtime_error("Unexpected argument '" + arg + "'.");
+			}
+		}
+		if (!(pixels > 0.0f && height > 0.0f)) throw std::runtime_error("Pixel error and view height should be positive.");
+
+		std::vector< Vertex > vertices;
+		std::vector< char > strings;
+		std::vector< IndexEntry > index;
+		{
+			std::ifstream file(in_filename, std::ios::binary);
+			if (!file) throw std::runtime_error("Failed to open mesh file '" + in_filename + "'.");
+			read_chunk(file, "pnct", &vertices);
+			read_chunk(file, "str0", &strings);
+			read_chunk(file, "idx0", &index);
+			if (file.peek() != EOF) throw std::runtime_error("Mesh file '" + in_filename + "' already has levels of detail (or other trailing data).");
+		}
+
+		std::vector< LodEntry > lods;
+		uint32_t meshes = 0;
+		uint64_t full_triangles = 0, lod_triangles = 0;
+		for (uint32_t m = 0; m < index.size(); ++m) {
+			IndexEntry const &entry = index[m];
+			if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
+				throw std::runtime_error("index entry has out-of-range name begin/end");
+			}
+			if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= vertices.size())) {
+				throw std::runtime_error("index entry has out-of-range vertex start/count");
+			}
+			std::string name(strings.begin() + entry.name_begin, strings.begin() + entry.name_end);
+			if (!prefixes.empty() && std::none_of(prefixes.begin(), prefixes.end(), [&](std::string const &prefix){
+				return name.compare(0, prefix.size(), prefix) == 0;
+			})) continue;
+			if (entry.vertex_end == entry.vertex_begin) continue;
+
+			std::vector< Vertex > level(vertices.begin() + entry.vertex_begin, vertices.begin() + entry.vertex_end);
+			glm::vec3 min = level[0].Position, max = level[0].Position;
+			for (auto const &v : level) {
+				min = glm::min(min, v.Position);
+				max = glm::max(max, v.Position);
+			}
+			float diagonal = glm::length(max - min);
+			if (!(diagonal > 0.0f)) continue;
+
+			std::cout << "  '" << name << "': " << level.size() / 3 << " triangles";
+			++meshes;
+			full_triangles += level.size() / 3;
+
+			//each level starts from the grid the last one stopped at, coarsening until the triangle count halves:
+			float cell = diagonal / 256.0f;
+			for (uint32_t l = 0; l < max_levels; ++l) {
+				std::vector< Vertex > coarser;
+				size_t target = level.size() / 2;
+				do {
+					cell *= 1.25f;
+					coarser = cluster(level, min, cell);
+				} while (coarser.size() > target && cell < diagonal);
+				if (coarser.empty() || coarser.size() > target) break;
+
+				LodEntry lod;
+				lod.mesh = m;
+				lod.vertex_begin = uint32_t(vertices.size());
+				vertices.insert(vertices.end(), coarser.begin(), coarser.end());
+				lod.vertex_end = uint32_t(vertices.size());
+				//(a cell is 'cell / diagonal' of the mesh's size on screen, and should be at most 'pixels' of 'height')
+				lod.max_size = pixels / height * diagonal / cell;
+				lods.emplace_back(lod);
+				lod_triangles += coarser.size() / 3;
+				std::cout << " -> " << coarser.size() / 3 << " (below " << lod.max_size << ")";
+
+				level = coarser;
+			}
+			std::cout << std::endl;
+		}
+
+		{
+			std::ofstream file(out_filename, std::ios::binary);
+			write_chunk(file, "pnct", vertices);
+			write_chunk(file, "str0", strings);
+			write_chunk(file, "idx0", index);
+			write_chunk(file, "lod0", lods);
+		}
+
+		auto after = std::chrono::high_resolution_clock::now();
+
+		std::cout << "Built " << lods.size() << " levels of detail for " << meshes << " meshes of '" << in_filename << "' ("
+			<< full_triangles << " triangles at full detail, " << lod_triangles << " in all coarser levels; built in "
+			<< std::chrono::duration< double >(after - before).count() * 1000.0 << "ms) to '" << out_filename << "'." << std::endl;
+	} catch (std::exception &e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
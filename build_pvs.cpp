@@ -0,0 +1,318 @@
+//build_pvs computes a potentially visible set (see PVS.hpp) for a level from its walkmesh ('.w' or '.wc').
+// The walkmesh is covered with a grid of cells; each cell gets a few sample points on the walkmesh,
+//  and two cells can see each other if some pair of their samples can be joined by a segment that doesn't leave the walkmesh
+//  (i.e., doesn't cross a boundary edge -- in a maze, the boundary edges are the feet of the walls).
+// Visible sets are then grown by one cell in every direction to cover what the samples miss.
+//NOTE: this treats walls as infinitely tall, so it is only suitable for levels where you can't see over them.
+
+#include "WalkMesh.hpp"
+#include "PVS.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <map>
+#include <cmath>
+#include <cstdlib>
+
+//twice the signed area of triangle (a,b,c):
+static float orient(glm::vec2 const &a, glm::vec2 const &b, glm::vec2 const &c) {
+	return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+}
+
+//do segments (a,b) and (c,d) cross? (touching doesn't count, which errs on the side of visibility)
+static bool segments_cross(glm::vec2 const &a, glm::vec2 const &b, glm::vec2 const &c, glm::vec2 const &d) {
+	float abc = orient(a, b, c), abd = orient(a, b, d);
+	float cda = orient(c, d, a), cdb = orient(c, d, b);
+	return ((abc > 0.0f && abd < 0.0f) || (abc < 0.0f && abd > 0.0f))
+	    && ((cda > 0.0f && cdb < 0.0f) || (cda < 0.0f && cdb > 0.0f));
+}
+
+//does triangle (a,b,c) overlap box [min,max]? (separating axis test)
+static bool triangle_overlaps_box(glm::vec2 const &a, glm::vec2 const &b, glm::vec2 const &c, glm::vec2 const &min, glm::vec2 const &max) {
+	if (std::max(a.x, std::max(b.x, c.x)) < min.x || std::min(a.x, std::min(b.x, c.x)) > max.x) return false;
+	if (std::max(a.y, std::max(b.y, c.y)) < min.y || std::min(a.y, std::min(b.y, c.y)) > max.y) return false;
+	glm::vec2 corners[4] = { min, glm::vec2(max.x, min.y), max, glm::vec2(min.x, max.y) };
+	glm::vec2 const *tri[3] = { &a, &b, &c };
+	for (uint32_t i = 0; i < 3; ++i) {
+		glm::vec2 const &p = *tri[i];
+		glm::vec2 const &q = *tri[(i + 1) % 3];
+		glm::vec2 const &r = *tri[(i + 2) % 3];
+		//box is separated if it lies entirely on the other side of edge (p,q) from r:
+		float side = orient(p, q, r);
+		bool all_outside = true;
+		for (auto const &corner : corners) {
+			float o = orient(p, q, corner);
+			if ((side >= 0.0f && o >= 0.0f) || (side <= 0.0f && o <= 0.0f)) all_outside = false;
+		}
+		if (all_outside) return false;
+	}
+	return true;
+}
+
+static bool point_in_triangle(glm::vec2 const &p, glm::vec2 const &a, glm::vec2 const &b, glm::vec2 const &c) {
+	float ab = orient(a, b, p), bc = orient(b, c, p), ca = orient(c, a, p);
+	return (ab >= 0.0f && bc >= 0.0f && ca >= 0.0f) || (ab <= 0.0f && bc <= 0.0f && ca <= 0.0f);
+}
+
+int main(int argc, char **argv) {
+	if (argc != 3 && argc != 4) {
+		std::cerr << "Usage:\n\t./build_pvs <in.w|in.wc> <out.pvs> [cell size]" << std::endl;
+		return 1;
+	}
+
+	try {
+		auto before = std::chrono::high_resolution_clock::now();
+
+		WalkMesh walk_mesh(argv[1]);
+		float cell_size = (argc == 4 ? float(std::atof(argv[3])) : 1.5f);
+		if (!(cell_size > 0.0f)) throw std::runtime_error("Cell size should be positive.");
+
+		auto xy = [&](uint32_t v) { return glm::vec2(walk_mesh.vertices[v]); };
+
+		//lay the grid over the walkmesh:
+		PVS pvs;
+		pvs.cell_size = cell_size;
+		glm::vec2 min = glm::vec2(std::numeric_limits< float >::infinity());
+		glm::vec2 max = -min;
+		for (auto const &v : walk_mesh.vertices) {
+			min = glm::min(min, glm::vec2(v));
+			max = glm::max(max, glm::vec2(v));
+		}
+		pvs.origin = min;
+		pvs.width = std::max(1U, uint32_t(std::ceil((max.x - min.x) / cell_size)));
+		pvs.height = std::max(1U, uint32_t(std::ceil((max.y - min.y) / cell_size)));
+		uint32_t cells = pvs.width * pvs.height;
+
+		auto cell_min = [&](uint32_t cell) {
+			return pvs.origin + cell_size * glm::vec2(float(cell % pvs.width), float(cell / pvs.width));
+		};
+		auto cell_coord = [&](float v, float o, uint32_t limit) {
+			return uint32_t(std::min(float(limit - 1), std::max(0.0f, std::floor((v - o) / cell_size))));
+		};
+
+		//triangles overlapping each cell:
+		std::vector< std::vector< uint32_t > > cell_triangles(cells);
+		for (uint32_t t = 0; t < walk_mesh.triangles.size(); ++t) {
+			glm::uvec3 const &tri = walk_mesh.triangles[t];
+			glm::vec2 a = xy(tri.x), b = xy(tri.y), c = xy(tri.z);
+			glm::vec2 tmin = glm::min(a, glm::min(b, c));
+			glm::vec2 tmax = glm::max(a, glm::max(b, c));
+			for (uint32_t y = cell_coord(tmin.y, pvs.origin.y, pvs.height); y <= cell_coord(tmax.y, pvs.origin.y, pvs.height); ++y) {
+				for (uint32_t x = cell_coord(tmin.x, pvs.origin.x, pvs.width); x <= cell_coord(tmax.x, pvs.origin.x, pvs.width); ++x) {
+					uint32_t cell = y * pvs.width + x;
+					if (triangle_overlaps_box(a, b, c, cell_min(cell), cell_min(cell) + glm::vec2(cell_size))) {
+						cell_triangles[cell].emplace_back(t);
+					}
+				}
+			}
+		}
+
+		//connected pieces of the walkmesh (nothing can be seen from one piece to another without crossing a boundary edge):
+		std::vector< uint32_t > triangle_piece(walk_mesh.triangles.size(), -1U);
+		uint32_t pieces = 0;
+		for (uint32_t seed = 0; seed < walk_mesh.triangles.size(); ++seed) {
+			if (triangle_piece[seed] != -1U) continue;
+			std::vector< uint32_t > todo(1, seed);
+			triangle_piece[seed] = pieces;
+			while (!todo.empty()) {
+				uint32_t t = todo.back();
+				todo.pop_back();
+				for (uint32_t i = 0; i < 3; ++i) {
+					uint32_t n = walk_mesh.triangle_neighbors[t][i];
+					if (n != -1U && triangle_piece[n] == -1U) {
+						triangle_piece[n] = pieces;
+						todo.emplace_back(n);
+					}
+				}
+			}
+			++pieces;
+		}
+
+		//sample points on the walkmesh in each cell (a 4x4 grid, or the triangle centroid nearest the center if none of those land on the walkmesh):
+		const uint32_t Samples = 4;
+		struct Sample {
+			glm::vec2 position;
+			uint32_t piece; //of the walkmesh
+		};
+		std::vector< std::vector< Sample > > cell_samples(cells);
+		std::vector< uint32_t > walkable;
+		for (uint32_t cell = 0; cell < cells; ++cell) {
+			if (cell_triangles[cell].empty()) continue;
+			walkable.emplace_back(cell);
+			auto &samples = cell_samples[cell];
+			for (uint32_t sy = 0; sy < Samples; ++sy) {
+				for (uint32_t sx = 0; sx < Samples; ++sx) {
+					glm::vec2 p = cell_min(cell) + (cell_size / float(Samples)) * glm::vec2(float(sx) + 0.5f, float(sy) + 0.5f);
+					for (uint32_t t : cell_triangles[cell]) {
+						glm::uvec3 const &tri = walk_mesh.triangles[t];
+						if (point_in_triangle(p, xy(tri.x), xy(tri.y), xy(tri.z))) {
+							samples.emplace_back(Sample{p, triangle_piece[t]});
+							break;
+						}
+					}
+				}
+			}
+			if (samples.empty()) {
+				glm::vec2 center = cell_min(cell) + 0.5f * glm::vec2(cell_size);
+				Sample best{glm::vec2(0.0f), -1U};
+				float best_dis2 = std::numeric_limits< float >::infinity();
+				for (uint32_t t : cell_triangles[cell]) {
+					glm::uvec3 const &tri = walk_mesh.triangles[t];
+					glm::vec2 centroid = (xy(tri.x) + xy(tri.y) + xy(tri.z)) / 3.0f;
+					float dis2 = glm::dot(centroid - center, centroid - center);
+					if (dis2 < best_dis2) {
+						best_dis2 = dis2;
+						best = Sample{centroid, triangle_piece[t]};
+					}
+				}
+				samples.emplace_back(best);
+			}
+		}
+
+		//boundary edges, bucketed by the cells their bounding boxes touch:
+		std::vector< std::pair< glm::vec2, glm::vec2 > > edges;
+		std::vector< std::vector< uint32_t > > cell_edges(cells);
+		for (uint32_t t = 0; t < walk_mesh.triangles.size(); ++t) {
+			glm::uvec3 const &tri = walk_mesh.triangles[t];
+			glm::uvec3 const &neighbors = walk_mesh.triangle_neighbors[t];
+			for (uint32_t i = 0; i < 3; ++i) {
+				if (neighbors[i] != -1U) continue;
+				glm::vec2 a = xy(tri[i]), b = xy(tri[(i + 1) % 3]);
+				uint32_t e = uint32_t(edges.size());
+				edges.emplace_back(a, b);
+				glm::vec2 emin = glm::min(a, b), emax = glm::max(a, b);
+				for (uint32_t y = cell_coord(emin.y, pvs.origin.y, pvs.height); y <= cell_coord(emax.y, pvs.origin.y, pvs.height); ++y) {
+					for (uint32_t x = cell_coord(emin.x, pvs.origin.x, pvs.width); x <= cell_coord(emax.x, pvs.origin.x, pvs.width); ++x) {
+						cell_edges[y * pvs.width + x].emplace_back(e);
+					}
+				}
+			}
+		}
+
+		//is the segment from p to q clear of boundary edges? (walks the grid cells along the segment)
+		std::vector< uint32_t > edge_stamp(edges.size(), 0);
+		uint32_t stamp = 0;
+		auto clear = [&](glm::vec2 const &p, glm::vec2 const &q) {
+			++stamp;
+			glm::vec2 d = q - p;
+			int32_t x = int32_t(cell_coord(p.x, pvs.origin.x, pvs.width));
+			int32_t y = int32_t(cell_coord(p.y, pvs.origin.y, pvs.height));
+			int32_t end_x = int32_t(cell_coord(q.x, pvs.origin.x, pvs.width));
+			int32_t end_y = int32_t(cell_coord(q.y, pvs.origin.y, pvs.height));
+			int32_t step_x = (d.x > 0.0f ? 1 : -1);
+			int32_t step_y = (d.y > 0.0f ? 1 : -1);
+			//(parameter along the segment at which it crosses the next vertical / horizontal grid line, and between lines)
+			float next_x = (d.x == 0.0f ? std::numeric_limits< float >::infinity()
+				: (pvs.origin.x + cell_size * float(x + (step_x > 0 ? 1 : 0)) - p.x) / d.x);
+			float next_y = (d.y == 0.0f ? std::numeric_limits< float >::infinity()
+				: (pvs.origin.y + cell_size * float(y + (step_y > 0 ? 1 : 0)) - p.y) / d.y);
+			float delta_x = (d.x == 0.0f ? std::numeric_limits< float >::infinity() : cell_size / std::abs(d.x));
+			float delta_y = (d.y == 0.0f ? std::numeric_limits< float >::infinity() : cell_size / std::abs(d.y));
+			while (true) {
+				for (uint32_t e : cell_edges[uint32_t(y) * pvs.width + uint32_t(x)]) {
+					if (edge_stamp[e] == stamp) continue;
+					edge_stamp[e] = stamp;
+					if (segments_cross(p, q, edges[e].first, edges[e].second)) return false;
+				}
+				if (x == end_x && y == end_y) break;
+				if (next_x < next_y) {
+					if (x == end_x) break; //(rounding; we're past the end)
+					x += step_x;
+					next_x += delta_x;
+				} else {
+					if (y == end_y) break;
+					y += step_y;
+					next_y += delta_y;
+				}
+			}
+			return true;
+		};
+
+		//cell-to-cell visibility:
+		std::vector< std::vector< bool > > sees(cells);
+		for (uint32_t cell : walkable) sees[cell].assign(cells, false);
+		for (uint32_t i = 0; i < walkable.size(); ++i) {
+			uint32_t a = walkable[i];
+			sees[a][a] = true;
+			for (uint32_t j = i + 1; j < walkable.size(); ++j) {
+				uint32_t b = walkable[j];
+				bool visible = false;
+				for (auto const &p : cell_samples[a]) {
+					for (auto const &q : cell_samples[b]) {
+						if (p.piece == q.piece && clear(p.position, q.position)) {
+							visible = true;
+							break;
+						}
+					}
+					if (visible) break;
+				}
+				if (visible) {
+					sees[a][b] = sees[b][a] = true;
+				}
+			}
+		}
+
+		//grow each visible set by a cell in every direction, then pack into (shared) rows of bits covering just the set's bounding rectangle:
+		pvs.cell_rows.assign(cells, -1U);
+		std::map< std::vector< uint32_t >, uint32_t > row_index; //(rectangle, then bits) -> row
+		uint64_t visible_total = 0;
+		std::vector< bool > grown(cells);
+		for (uint32_t cell : walkable) {
+			grown.assign(cells, false);
+			PVS::Row row;
+			row.min_x = pvs.width; row.min_y = pvs.height;
+			for (uint32_t other = 0; other < cells; ++other) {
+				if (!sees[cell][other]) continue;
+				int32_t ox = int32_t(other % pvs.width), oy = int32_t(other / pvs.width);
+				for (int32_t y = std::max(0, oy - 1); y <= std::min(int32_t(pvs.height) - 1, oy + 1); ++y) {
+					for (int32_t x = std::max(0, ox - 1); x <= std::min(int32_t(pvs.width) - 1, ox + 1); ++x) {
+						grown[uint32_t(y) * pvs.width + uint32_t(x)] = true;
+						row.min_x = std::min(row.min_x, uint32_t(x));
+						row.min_y = std::min(row.min_y, uint32_t(y));
+						row.max_x = std::max(row.max_x, uint32_t(x));
+						row.max_y = std::max(row.max_y, uint32_t(y));
+					}
+				}
+			}
+			uint32_t stride = row.max_x - row.min_x + 1;
+			std::vector< uint32_t > key = { row.min_x, row.min_y, row.max_x, row.max_y };
+			key.resize(4 + (stride * (row.max_y - row.min_y + 1) + 31) / 32, 0);
+			for (uint32_t y = row.min_y; y <= row.max_y; ++y) {
+				for (uint32_t x = row.min_x; x <= row.max_x; ++x) {
+					if (!grown[y * pvs.width + x]) continue;
+					uint32_t bit = (y - row.min_y) * stride + (x - row.min_x);
+					key[4 + bit / 32] |= (1U << (bit % 32));
+					++visible_total;
+				}
+			}
+			auto inserted = row_index.insert(std::make_pair(key, uint32_t(pvs.rows.size())));
+			if (inserted.second) {
+				row.first = uint32_t(pvs.bits.size());
+				pvs.bits.insert(pvs.bits.end(), key.begin() + 4, key.end());
+				pvs.rows.emplace_back(row);
+			}
+			pvs.cell_rows[cell] = inserted.first->second;
+		}
+
+		auto after = std::chrono::high_resolution_clock::now();
+
+		pvs.save(argv[2]);
+
+		std::cout << "Built PVS for '" << argv[1] << "': " << pvs.width << "x" << pvs.height << " cells of size " << cell_size << ", "
+			<< walkable.size() << " on the walkmesh, each seeing "
+			<< (walkable.empty() ? 0.0 : 100.0 * double(visible_total) / double(walkable.size()) / double(walkable.size())) << "% of those on average; "
+			<< pvs.rows.size() << " distinct rows, "
+			<< pvs.cell_rows.size() * 4 + pvs.rows.size() * sizeof(PVS::Row) + pvs.bits.size() * 4 << " bytes (built in "
+			<< std::chrono::duration< double >(after - before).count() * 1000.0 << "ms) to '" << argv[2] << "'." << std::endl;
+
+		//check that the file loads:
+		PVS loaded(argv[2]);
+	} catch (std::exception &e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,40 @@
+//cook_walkmesh converts a walkmesh exported by meshes/export-walkmeshes.py ('.w') into a cooked walkmesh ('.wc').
+// Cooked walkmeshes store adjacency, the bvh, and the navigation polygons alongside the geometry, in their final in-memory layout,
+//  so the game can memory-map them and use them without parsing or building anything.
+
+#include "WalkMesh.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+
+int main(int argc, char **argv) {
+	if (argc != 3) {
+		std::cerr << "Usage:\n\t./cook_walkmesh <in.w> <out.wc>" << std::endl;
+		return 1;
+	}
+
+	try {
+		auto before = std::chrono::high_resolution_clock::now();
+		WalkMesh walk_mesh(argv[1]);
+		auto after = std::chrono::high_resolution_clock::now();
+
+		walk_mesh.save_cooked(argv[2]);
+
+		std::cout << "Cooked '" << argv[1] << "' (" << walk_mesh.vertices.size() << " vertices, "
+			<< walk_mesh.triangles.size() << " triangles, " << walk_mesh.bvh_nodes.size() << " bvh nodes, "
+			<< walk_mesh.polygons.size() << " polygons; built in "
+			<< std::chrono::duration< double >(after - before).count() * 1000.0 << "ms) to '" << argv[2] << "'." << std::endl;
+
+		//check that the cooked file loads:
+		before = std::chrono::high_resolution_clock::now();
+		WalkMesh cooked(argv[2]);
+		after = std::chrono::high_resolution_clock::now();
+		std::cout << "Cooked walkmesh maps in " << std::chrono::duration< double >(after - before).count() * 1000.0 << "ms." << std::endl;
+	} catch (std::exception &e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
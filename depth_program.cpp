@@ -1,16 +1,31 @@
 #include "depth_program.hpp"
 
 #include "compile_program.hpp"
+#include "Scene.hpp"
 
 DepthProgram::DepthProgram() {
 	program = compile_program(
 		"#version 330\n"
-		"uniform mat4 object_to_clip;\n"
+		"layout(std140) uniform ObjectConstants {\n" //per-object matrices (see Scene::ObjectConstants)
+		"	mat4 object_to_clip;\n"
+		"	mat4x3 object_to_light;\n"
+		"	mat3 normal_to_light;\n"
+		"};\n"
+		"uniform bool instanced;\n" //if set, transforms come from instance_data instead (see Scene::Object::ProgramInfo)
+		"uniform int instance_base;\n"
+		"uniform mat4 world_to_clip;\n"
+		"uniform samplerBuffer instance_data;\n"
 		"layout(location=0) in vec4 Position;\n" //note: layout keyword used to make sure that the location-0 attribute is always bound to something
 		"in vec3 Normal;\n" //DEBUG
 		"out vec3 color;\n" //DEBUG
 		"void main() {\n"
-		"	gl_Position = object_to_clip * Position;\n"
+		"	mat4 to_clip = object_to_clip;\n"
+		"	if (instanced) {\n"
+		"		int at = 6 * (instance_base + gl_InstanceID);\n"
+		"		mat4x3 to_world = transpose(mat3x4(texelFetch(instance_data, at), texelFetch(instance_data, at+1), texelFetch(instance_data, at+2)));\n"
+		"		to_clip = world_to_clip * mat4(to_world);\n"
+		"	}\n"
+		"	gl_Position = to_clip * Position;\n"
 		"	color = 0.5 + 0.5 * Normal;\n" //DEBUG
 		"}\n"
 		,
@@ -23,7 +38,19 @@ DepthProgram::DepthProgram() {
 		"}\n"
 	);
 
-	object_to_clip_mat4 = glGetUniformLocation(program, "object_to_clip");
+	object_constants_block = glGetUniformBlockIndex(program, "ObjectConstants");
+	glUniformBlockBinding(program, object_constants_block, Scene::ObjectConstantsBinding);
+
+	instanced_bool = glGetUniformLocation(program, "instanced");
+	instance_base_int = glGetUniformLocation(program, "instance_base");
+	world_to_clip_mat4 = glGetUniformLocation(program, "world_to_clip");
+
+	glUseProgram(program);
+
+	GLuint instance_data_samplerBuffer = glGetUniformLocation(program, "instance_data");
+	glUniform1i(instance_data_samplerBuffer, Scene::Object::ProgramInfo::InstanceTextureUnit);
+
+	glUseProgram(0);
 }
 
 Load< DepthProgram > depth_program(LoadTagInit, [](){
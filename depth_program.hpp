@@ -5,8 +5,13 @@ struct DepthProgram {
 	//opengl program object:
 	GLuint program = 0;
 
-	//uniform locations:
-	GLuint object_to_clip_mat4 = -1U;
+	//object matrices (uniform block index; see Scene::Object::ProgramInfo):
+	GLuint object_constants_block = -1U;
+
+	//instancing (see Scene::Object::ProgramInfo; the instance buffer texture is read from unit InstanceTextureUnit):
+	GLuint instanced_bool = -1U;
+	GLuint instance_base_int = -1U;
+	GLuint world_to_clip_mat4 = -1U;
 
 	DepthProgram();
 };
@@ -4,6 +4,9 @@
 #include <vector>
 #include <stdexcept>
 #include <cassert>
+#include <cstring>
+#include <cstdint>
+#include <string>
 
 template< typename T >
 void read_chunk(std::istream &from, std::string const &magic, std::vector< T > *_to) {
@@ -33,3 +36,47 @@ void read_chunk(std::istream &from, std::string const &magic, std::vector< T > *
 		throw std::runtime_error("Failed to read chunk data.");
 	}
 }
+
+//write a vector of structures prefixed by a magic number and size (the inverse of read_chunk):
+template< typename T >
+void write_chunk(std::ostream &to, std::string const &magic, std::vector< T > const &from) {
+	assert(magic.size() == 4);
+	uint32_t size = uint32_t(from.size() * sizeof(T));
+	to.write(magic.c_str(), 4);
+	to.write(reinterpret_cast< char const * >(&size), sizeof(size));
+	if (size) to.write(reinterpret_cast< char const * >(from.data()), size);
+	if (!to) {
+		throw std::runtime_error("Failed to write chunk.");
+	}
+}
+
+//find the chunk at 'at' in an in-memory (e.g. memory-mapped) blob without copying it:
+// points '*data' at its elements, sets '*count', and advances 'at' past the chunk.
+template< typename T >
+void map_chunk(char const *&at, char const *end, std::string const &magic, T const **data, size_t *count) {
+	assert(data && count);
+
+	if (size_t(end - at) < 8) {
+		throw std::runtime_error("Failed to read chunk header");
+	}
+	if (std::string(at, 4) != magic) {
+		throw std::runtime_error("Unexpected magic number in chunk");
+	}
+	uint32_t size = 0;
+	std::memcpy(&size, at + 4, 4);
+	at += 8;
+
+	if (size % sizeof(T) != 0) {
+		throw std::runtime_error("Size of chunk not divisible by element size");
+	}
+	if (size_t(end - at) < size) {
+		throw std::runtime_error("Failed to read chunk data.");
+	}
+	if (reinterpret_cast< uintptr_t >(at) % alignof(T) != 0) {
+		throw std::runtime_error("Chunk data is misaligned.");
+	}
+
+	*data = reinterpret_cast< T const * >(at);
+	*count = size / sizeof(T);
+	at += size;
+}
@@ -2,15 +2,36 @@
 
 #include "compile_program.hpp"
 #include "gl_errors.hpp"
+#include "Scene.hpp"
 
 TextureProgram::TextureProgram() {
+	//per-frame lighting, shared by both stages (layout must match TextureProgram::Lights):
+	std::string lights_block =
+		"layout(std140) uniform Lights {\n"
+		"	vec4 sun_direction;\n"
+		"	vec4 sun_color;\n"
+		"	vec4 sky_direction;\n"
+		"	vec4 sky_color;\n"
+		"	vec4 spot_color;\n"
+		"	vec4 spot_outer_inner;\n"
+		"	vec4 camera_position;\n"
+		"	mat4 light_to_spots[12];\n"
+		"	vec4 spot_positions[12];\n"
+		"	vec4 spot_directions[12];\n"
+		"};\n";
+
 	program = compile_program(
 		"#version 330\n"
-		"uniform mat4 object_to_clip;\n"
-		"uniform mat4x3 object_to_light;\n"
-		"uniform mat3 normal_to_light;\n"
-		"uniform mat4 light_to_spots[12];\n"
-        "uniform mat4 light_to_spot;\n"
+		+ lights_block +
+		"layout(std140) uniform ObjectConstants {\n" //per-object matrices (see Scene::ObjectConstants)
+		"	mat4 object_to_clip;\n"
+		"	mat4x3 object_to_light;\n"
+		"	mat3 normal_to_light;\n"
+		"};\n"
+		"uniform bool instanced;\n" //if set, transforms come from instance_data instead (see Scene::Object::ProgramInfo)
+		"uniform int instance_base;\n"
+		"uniform mat4 world_to_clip;\n"
+		"uniform samplerBuffer instance_data;\n"
 		"layout(location=0) in vec4 Position;\n" //note: layout keyword used to make sure that the location-0 attribute is always bound to something
 		"in vec3 Normal;\n"
 		"in vec4 Color;\n"
@@ -20,30 +41,28 @@ TextureProgram::TextureProgram() {
 		"out vec4 color;\n"
 		"out vec2 texCoord;\n"
 		"out vec4 spotPositions[12];\n"
-        "out vec4 spotPosition;\n"
 		"void main() {\n"
-		"	gl_Position = object_to_clip * Position;\n"
-		"	position = object_to_light * Position;\n"
+		"	mat4 to_clip = object_to_clip;\n"
+		"	mat4x3 to_light = object_to_light;\n"
+		"	mat3 to_light_normal = normal_to_light;\n"
+		"	if (instanced) {\n"
+		"		int at = 6 * (instance_base + gl_InstanceID);\n"
+		"		to_light = transpose(mat3x4(texelFetch(instance_data, at), texelFetch(instance_data, at+1), texelFetch(instance_data, at+2)));\n"
+		"		to_light_normal = transpose(mat3(texelFetch(instance_data, at+3).xyz, texelFetch(instance_data, at+4).xyz, texelFetch(instance_data, at+5).xyz));\n"
+		"		to_clip = world_to_clip * mat4(to_light);\n"
+		"	}\n"
+		"	gl_Position = to_clip * Position;\n"
+		"	position = to_light * Position;\n"
         "   for (int i = 0; i < 12; i++) {\n"
 		"	    spotPositions[i] = light_to_spots[i] * vec4(position, 1.0);\n"
 		"   }\n"
-		"	normal = normal_to_light * Normal;\n"
+		"	normal = to_light_normal * Normal;\n"
 		"	color = Color;\n"
 		"	texCoord = TexCoord;\n"
 		"}\n"
 		,
 		"#version 330\n"
-		"uniform vec3 sun_direction;\n"
-		"uniform vec3 sun_color;\n"
-		"uniform vec3 sky_direction;\n"
-		"uniform vec3 sky_color;\n"
-        "uniform vec3 spot_position;\n"
-        "uniform vec3 spot_direction;\n"
-		"uniform vec3 spot_positions[12];\n"
-		"uniform vec3 spot_directions[12];\n"
-		"uniform vec3 spot_color;\n"
-		"uniform vec2 spot_outer_inner;\n"
-		"uniform vec3 camera_position;\n"
+		+ lights_block +
 		"uniform sampler2D tex;\n"
 		"uniform sampler2DShadow spot_depth_tex;\n"
 		"in vec3 position;\n"
@@ -51,64 +70,57 @@ TextureProgram::TextureProgram() {
 		"in vec4 color;\n"
 		"in vec2 texCoord;\n"
 		"in vec4 spotPositions[12];\n"
-        "in vec4 spotPosition;\n"
 		"out vec4 fragColor;\n"
 		"void main() {\n"
 		"	vec3 total_light = vec3(0.0, 0.0, 0.0);\n"
 		"	vec3 n = normalize(normal);\n"
 		"	{ //sky (hemisphere) light:\n"
-		"		vec3 l = sky_direction;\n"
+		"		vec3 l = sky_direction.xyz;\n"
 		"		float nl = 0.5 + 0.5 * dot(n,l);\n"
-		"		total_light += nl * sky_color;\n"
+		"		total_light += nl * sky_color.rgb;\n"
 		"	}\n"
 		"	{ //sun (directional) light:\n"
-		"		vec3 l = sun_direction;\n"
+		"		vec3 l = sun_direction.xyz;\n"
 		"		float nl = max(0.0, dot(n,l));\n"
-		"		total_light += nl * sun_color;\n"
+		"		total_light += nl * sun_color.rgb;\n"
 		"	}\n"
         "   for (int i = 0; i < 12; i++) \n"
 		"	{ //spot (point with fov + shadow map) light:\n"
-		"		vec3 l = normalize(spot_positions[i] - position);\n"
+		"		vec3 l = normalize(spot_positions[i].xyz - position);\n"
 		"		float nl = max(0.0, dot(n,l));\n"
 		"		//TODO: look up shadow map\n"
-		"		float d = dot(l,-spot_directions[i]);\n"
+		"		float d = dot(l,-spot_directions[i].xyz);\n"
 		"		float amt = smoothstep(spot_outer_inner.x, spot_outer_inner.y, d);\n"
 		"    if (i == 11) {\n"
 		"		float shadow = textureProj(spot_depth_tex, spotPositions[i]);\n"
-		"		total_light += shadow * nl * amt * spot_color;\n"
+		"		total_light += shadow * nl * amt * spot_color.rgb;\n"
 		"    }\n"
 		"    else {\n"
-		"       total_light += nl * amt * spot_color;\n"
+		"       total_light += nl * amt * spot_color.rgb;\n"
 		"    }\n"
 		//"		fragColor = vec4(s,s,s, 1.0);\n" //DEBUG: just show shadow
 		"	}\n"
-		"   vec3 new_color = mix(color.rgb, vec3(0.0, 0.0, 0.0), 0.13 * length(camera_position - position));\n"
+		"   vec3 new_color = mix(color.rgb, vec3(0.0, 0.0, 0.0), 0.13 * length(camera_position.xyz - position));\n"
 		"	fragColor = texture(tex, texCoord) * vec4(new_color * total_light, color.a);\n"
 		"}\n"
 	);
 
-	object_to_clip_mat4 = glGetUniformLocation(program, "object_to_clip");
-	object_to_light_mat4x3 = glGetUniformLocation(program, "object_to_light");
-	normal_to_light_mat3 = glGetUniformLocation(program, "normal_to_light");
-
-	sun_direction_vec3 = glGetUniformLocation(program, "sun_direction");
-	sun_color_vec3 = glGetUniformLocation(program, "sun_color");
-	sky_direction_vec3 = glGetUniformLocation(program, "sky_direction");
-	sky_color_vec3 = glGetUniformLocation(program, "sky_color");
+	//object matrices come from a uniform buffer slice bound (by Scene::draw) at Scene::ObjectConstantsBinding:
+	object_constants_block = glGetUniformBlockIndex(program, "ObjectConstants");
+	glUniformBlockBinding(program, object_constants_block, Scene::ObjectConstantsBinding);
 
-	spot_position_vec3 = glGetUniformLocation(program, "spot_position");
-	spot_direction_vec3 = glGetUniformLocation(program, "spot_direction");
-	spot_color_vec3 = glGetUniformLocation(program, "spot_color");
-	spot_outer_inner_vec2 = glGetUniformLocation(program, "spot_outer_inner");
+	instanced_bool = glGetUniformLocation(program, "instanced");
+	instance_base_int = glGetUniformLocation(program, "instance_base");
+	world_to_clip_mat4 = glGetUniformLocation(program, "world_to_clip");
 
-	spot_position2_vec3 = glGetUniformLocation(program, "spot_position2");
-	spot_direction2_vec3 = glGetUniformLocation(program, "spot_direction2");
-	light_to_spot2_mat4 = glGetUniformLocation(program, "light_to_spot2");
+	//lighting comes from a uniform buffer bound at LightsBinding:
+	GLuint lights_index = glGetUniformBlockIndex(program, "Lights");
+	glUniformBlockBinding(program, lights_index, LightsBinding);
 
-
-	light_to_spot_mat4 = glGetUniformLocation(program, "light_to_spot");
-
-	camera_position_vec3 = glGetUniformLocation(program, "camera_position");
+	glGenBuffers(1, &lights_buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, lights_buffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(Lights), nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
 
 	glUseProgram(program);
 
@@ -118,6 +130,9 @@ TextureProgram::TextureProgram() {
 	GLuint spot_depth_tex_sampler2D = glGetUniformLocation(program, "spot_depth_tex");
 	glUniform1i(spot_depth_tex_sampler2D, 1);
 
+	GLuint instance_data_samplerBuffer = glGetUniformLocation(program, "instance_data");
+	glUniform1i(instance_data_samplerBuffer, Scene::Object::ProgramInfo::InstanceTextureUnit);
+
 	glUseProgram(0);
 
 	GL_ERRORS();
@@ -1,33 +1,39 @@
 #include "GL.hpp"
 #include "Load.hpp"
 
+#include <glm/glm.hpp>
+
 //TextureProgram draws a surface lit by two lights (a distant directional and a hemispherical light) where the surface color is drawn from texture unit 0:
 struct TextureProgram {
 	//opengl program object:
 	GLuint program = 0;
 
-	//uniform locations:
-	GLuint object_to_clip_mat4 = -1U;
-	GLuint object_to_light_mat4x3 = -1U;
-	GLuint normal_to_light_mat3 = -1U;
-
-	GLuint sun_direction_vec3 = -1U; //direction *to* sun
-	GLuint sun_color_vec3 = -1U;
-	GLuint sky_direction_vec3 = -1U; //direction *to* sky
-	GLuint sky_color_vec3 = -1U;
-
-	GLuint spot_position_vec3 = -1U;
-	GLuint spot_direction_vec3 = -1U; //direction *from* spotlight
-	GLuint spot_color_vec3 = -1U;
-	GLuint spot_outer_inner_vec2 = -1U; //color fades from zero to one as dot(spot_direction, spot_to_position) varies from outer_inner.x to outer_inner.y
-	GLuint light_to_spot_mat4 = -1U; //projects from lighting space (/world space) to spot light depth map space
-
-
-	GLuint spot_position2_vec3 = -1U;
-	GLuint spot_direction2_vec3 = -1U; //direction *from* spotlight
-	GLuint light_to_spot2_mat4 = -1U; //projects from lighting space (/world space) to spot light depth map space
-
-	GLuint camera_position_vec3 = -1U;
+	//object matrices (uniform block index; see Scene::Object::ProgramInfo):
+	GLuint object_constants_block = -1U;
+
+	//instancing (see Scene::Object::ProgramInfo; the instance buffer texture is read from unit InstanceTextureUnit):
+	GLuint instanced_bool = -1U;
+	GLuint instance_base_int = -1U;
+	GLuint world_to_clip_mat4 = -1U;
+
+	//per-frame lighting lives in a uniform buffer (std140 block "Lights"), filled with one upload per frame:
+	enum : uint32_t { SpotCount = 12 }; //(must match the arrays in the shader)
+	// (the per-spot arrays are left uninitialized; fill all SpotCount entries)
+	struct Lights {
+		glm::vec4 sun_direction = glm::vec4(0.0f); //xyz: direction *to* sun
+		glm::vec4 sun_color = glm::vec4(0.0f);
+		glm::vec4 sky_direction = glm::vec4(0.0f); //xyz: direction *to* sky
+		glm::vec4 sky_color = glm::vec4(0.0f);
+		glm::vec4 spot_color = glm::vec4(0.0f);
+		glm::vec4 spot_outer_inner = glm::vec4(0.0f); //xy: color fades from zero to one as dot(spot_direction, spot_to_position) varies from outer_inner.x to outer_inner.y
+		glm::vec4 camera_position = glm::vec4(0.0f);
+		glm::mat4 light_to_spots[SpotCount]; //project from lighting space (/world space) to spot light depth map space
+		glm::vec4 spot_positions[SpotCount];
+		glm::vec4 spot_directions[SpotCount]; //xyz: direction *from* spotlight
+	};
+	static_assert(sizeof(Lights) == 7*16 + SpotCount*(64 + 16 + 16), "Lights is laid out as in std140.");
+	enum : GLuint { LightsBinding = 0 }; //uniform buffer binding point the block reads from
+	GLuint lights_buffer = 0; //sizeof(Lights) bytes; bind to LightsBinding before drawing
 
 	//textures:
 	//texture0 - texture for the surface